@@ -0,0 +1,115 @@
+#include "allocationcounter.h"
+#include <cstdlib>
+
+#if defined(BLUEBANK_COUNT_ALLOCATIONS)
+
+namespace {
+
+// Plain thread_local: no constructor, so it is safe inside malloc itself
+thread_local quint64 t_allocations = 0;
+
+} // namespace
+
+#if defined(__GLIBC__)
+
+#include <cerrno>
+
+// Every allocator entry point, forwarded to glibc's own. Qt containers and
+// SQLite allocate with malloc, so operator new alone would miss most of it.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+}
+
+extern "C" void *malloc(size_t size) {
+    ++t_allocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    ++t_allocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    ++t_allocations;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+    ++t_allocations;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+    ++t_allocations;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    ++t_allocations;
+    void *p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+extern "C" void *valloc(size_t size) {
+    ++t_allocations;
+    return __libc_valloc(size);
+}
+
+extern "C" void *pvalloc(size_t size) {
+    ++t_allocations;
+    return __libc_pvalloc(size);
+}
+
+#else
+
+#include <new>
+
+// Without glibc only C++ allocations (operator new) are counted
+void *operator new(std::size_t size) {
+    ++t_allocations;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    ++t_allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+    return ::operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+#endif
+
+bool AllocationCounter::available() { return true; }
+quint64 AllocationCounter::count() { return t_allocations; }
+
+#else
+
+bool AllocationCounter::available() { return false; }
+quint64 AllocationCounter::count() { return 0; }
+
+#endif
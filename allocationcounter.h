@@ -0,0 +1,17 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Heap allocations made by the calling thread, for the batch tool's
+// benchmarks. Off unless built with -DBLUEBANK_COUNT_ALLOCATIONS=ON, and
+// then available() is true. On glibc every allocator entry point (malloc,
+// calloc, realloc and the aligned ones) is replaced with a counting wrapper
+// around glibc's own; elsewhere only operator new is counted.
+class AllocationCounter {
+public:
+    static bool available();
+    static quint64 count();
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,154 @@
+#include "bankapi.h"
+#include "dbmanager.h"
+#include "slowquerylog.h"
+#include "riskengine.h"
+#include <QSqlQuery>
+#include <QVariant>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QMutexLocker>
+
+namespace {
+
+HttpResponse json(int status, const QJsonValue &value) {
+    HttpResponse response;
+    response.status = status;
+    response.body = value.isArray() ? QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact)
+                                    : QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+HttpResponse error(int status, const QString &message) {
+    return json(status, QJsonObject{{"error", message}});
+}
+
+} // namespace
+
+HttpResponse BankApi::handle(const HttpRequest &request) {
+    if (request.path == "/login") {
+        if (request.method != "POST") return error(405, "use POST");
+        return login(request);
+    }
+
+    const int userId = userForRequest(request);
+    if (userId <= 0) return error(401, "missing or unknown bearer token");
+
+    if (request.path == "/accounts" && request.method == "GET") return accounts(userId);
+    if (request.path == "/statements" && request.method == "GET") return statements(userId, request);
+
+    static const QList<QByteArray> postings = {"/deposit", "/withdraw", "/transfer", "/interac", "/paybill"};
+    if (postings.contains(request.path)) {
+        if (request.method != "POST") return error(405, "use POST");
+        return posting(userId, request.path, request);
+    }
+    return error(404, "no such route");
+}
+
+int BankApi::userForRequest(const HttpRequest &request) {
+    const QByteArray auth = request.headers.value("authorization");
+    if (!auth.startsWith("Bearer ")) return -1;
+    QMutexLocker locker(&m_sessionsLock);
+    return m_sessions.value(QString::fromLatin1(auth.mid(7).trimmed()), -1);
+}
+
+QString BankApi::createSession(int userId) {
+    quint64 words[4];
+    QRandomGenerator::system()->fillRange(words);
+    const QString token = QString::fromLatin1(
+        QByteArray(reinterpret_cast<const char *>(words), sizeof(words)).toHex());
+
+    QMutexLocker locker(&m_sessionsLock);
+    m_sessions.insert(token, userId);
+    return token;
+}
+
+bool BankApi::ownsAccount(int userId, int accountId) {
+    QSqlQuery q(DBManager::userDatabase(userId));
+    q.prepare("SELECT 1 FROM accounts WHERE id = :id AND user_id = :user");
+    q.bindValue(":id", accountId);
+    q.bindValue(":user", userId);
+    return SlowQueryLog::exec(q) && q.next();
+}
+
+HttpResponse BankApi::login(const HttpRequest &request) {
+    const QJsonObject body = QJsonDocument::fromJson(request.body).object();
+    const int userId = DBManager::authenticateUser(body["email"].toString(), body["password"].toString());
+    if (userId <= 0) return error(401, "invalid credentials");
+    return json(200, QJsonObject{{"token", createSession(userId)}, {"userId", userId}});
+}
+
+HttpResponse BankApi::accounts(int userId) {
+    RowSet<AccountBalanceRow> rows;
+    if (!DBManager::accountBalances(userId, &rows)) return error(500, "query failed");
+
+    QJsonArray list;
+    for (const AccountBalanceRow &row : rows) {
+        list.append(QJsonObject{
+            {"id", row.id},
+            {"number", rows.string(row.number)},
+            {"type", rows.string(row.type)},
+            {"balance", row.balance},
+            {"rate", row.interestRate},
+        });
+    }
+    return json(200, list);
+}
+
+HttpResponse BankApi::posting(int userId, const QByteArray &route, const HttpRequest &request) {
+    const QJsonObject body = QJsonDocument::fromJson(request.body).object();
+    const double amount = body["amount"].toDouble();
+    const int fromId = body[route == "/deposit" || route == "/withdraw" ? "accountId" : "fromAccountId"].toInt();
+    if (!ownsAccount(userId, fromId)) return error(403, "account does not belong to this client");
+
+    bool ok = false;
+    if (route == "/deposit") {
+        ok = DBManager::deposit(fromId, amount);
+    } else if (route == "/withdraw") {
+        ok = DBManager::withdraw(fromId, amount);
+    } else if (route == "/transfer") {
+        const int toId = body["toAccountId"].toInt();
+        if (!ownsAccount(userId, toId)) return error(403, "account does not belong to this client");
+        ok = DBManager::transferAccountToAccount(fromId, toId, amount);
+    } else if (route == "/interac") {
+        ok = DBManager::interacTransfer(fromId, body["email"].toString(), amount);
+    } else if (route == "/paybill") {
+        ok = DBManager::payBill(userId, fromId, body["payeeId"].toInt(), amount);
+    }
+
+    if (!ok) {
+        const QString rule = RiskEngine::takeLastDenial();
+        return rule.isEmpty() ? error(409, "posting rejected") : error(429, "blocked by the " + rule);
+    }
+    return json(200, QJsonObject{{"ok", true}});
+}
+
+HttpResponse BankApi::statements(int userId, const HttpRequest &request) {
+    const int accountId = request.query.value("account").toInt();
+    if (!ownsAccount(userId, accountId)) return error(403, "account does not belong to this client");
+
+    const int size = qBound(1, request.query.value("size", "50").toInt(), 500);
+    const qint64 before = request.query.value("before").toLongLong();
+
+    // Keyset paging: pass the smallest id of a page as 'before' to get the next one
+    RowSet<StatementRow> page;
+    page.reserve(size, size * 64);
+    if (!DBManager::statementPage(accountId, before, size, &page)) return error(500, "query failed");
+
+    QJsonArray rows;
+    for (const StatementRow &row : page) {
+        rows.append(QJsonObject{
+            {"id", row.id},
+            {"timestamp", page.string(row.timestamp)},
+            {"type", page.string(row.type)},
+            {"amount", row.amount},
+            {"description", page.string(row.description)},
+            {"balance_after", row.balanceAfter ? QJsonValue(*row.balanceAfter) : QJsonValue()},
+        });
+    }
+
+    QJsonObject result{{"rows", rows}};
+    if (page.size() == size) result["next_before"] = page.last().id;
+    return json(200, result);
+}
@@ -0,0 +1,40 @@
+#ifndef BANKAPI_H
+#define BANKAPI_H
+
+#include "httpserver.h"
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// JSON routes over DBManager for the local HTTP service.
+//
+//   POST /login        {"email", "password"}          -> {"token", "userId"}
+//   GET  /accounts                                     -> [{id, number, type, balance, rate}]
+//   POST /deposit      {"accountId", "amount"}
+//   POST /withdraw     {"accountId", "amount"}
+//   POST /transfer     {"fromAccountId", "toAccountId", "amount"}
+//   POST /interac      {"fromAccountId", "email", "amount"}
+//   POST /paybill      {"fromAccountId", "payeeId", "amount"}
+//   GET  /statements?account=<id>&size=<n>[&before=<txId>]
+//
+// Every route except /login needs "Authorization: Bearer <token>".
+// handle() is called on HTTP worker threads and is thread-safe.
+class BankApi {
+public:
+    HttpResponse handle(const HttpRequest &request);
+
+private:
+    int userForRequest(const HttpRequest &request);
+    QString createSession(int userId);
+    static bool ownsAccount(int userId, int accountId);
+
+    HttpResponse login(const HttpRequest &request);
+    HttpResponse accounts(int userId);
+    HttpResponse posting(int userId, const QByteArray &route, const HttpRequest &request);
+    HttpResponse statements(int userId, const HttpRequest &request);
+
+    QMutex m_sessionsLock;
+    QHash<QString, int> m_sessions;
+};
+
+#endif // BANKAPI_H
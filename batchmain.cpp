@@ -0,0 +1,436 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+#include <cstdio>
+#include "dbmanager.h"
+#include "batchrunner.h"
+#include "sqlitebackend.h"
+#include "memorybackend.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "httpserver.h"
+#include "bankapi.h"
+#include "loadgen.h"
+#include "onlinebackup.h"
+#include "bulkimporter.h"
+#include "riskengine.h"
+#include <QHostAddress>
+#include <QDate>
+#include <QThread>
+#include <QElapsedTimer>
+#include <memory>
+
+// Headless entry point for end-of-day and bulk processing. No Widgets, no
+// display: commands are read from a file or stdin and executed through a
+// StorageBackend (SQLite by default).
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("BlueBankBatch");
+    app.setOrganizationName("A project by Group-9");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Sudbury Student Bank batch processor.\n\n"
+        "Commands:\n"
+        "  run [file|-]                 execute banking commands (default: stdin)\n"
+        "  generate <users>             create synthetic clients for benchmarks\n"
+        "  serve                        JSON-over-HTTP service on 127.0.0.1\n"
+        "  loadgen                      drive a running 'serve' and report latency\n"
+        "  bench-export [postings]      posting latency during a concurrent export\n"
+        "  bench-postings [per-thread]  posting throughput across threads and shards\n"
+        "  bench-search [words...]      type-ahead statement search latency\n"
+        "  bench-init                   time to open the database and check its schema\n"
+        "  backup <file>                online backup while the database is in use\n"
+        "  restore <file>               verify a backup and restore it over --db\n"
+        "  bench-backup [postings]      posting latency during an online backup\n"
+        "  bench-atomic [postings]      old multi-statement postings vs atomic ones\n"
+        "  bench-cardcycle [date]       close every card's billing cycle, then re-run it\n"
+        "  close-statements [date]      month-end close of every month before date\n"
+        "  repair-balances [missing]    rebuild running balances on journal rows\n"
+        "  export-txlog <file>          archive transactions to a binary log\n"
+        "  replay-txlog <file>          rebuild balance movements from a binary log\n"
+        "  import <kind> <file.csv>     stream users|accounts|balances|interac|payees from CSV\n"
+        "  bench-import [rows]          generate and import users, accounts and balances\n"
+        "  bench-risk [postings]        withdrawal throughput with velocity checks off and on\n"
+        "  bench-reads [reads]          balance and statement-page reads, QVariant vs typed rows\n"
+        "  bench-native [postings]      postings per second through QSqlQuery vs native SQLite");
+    parser.addHelpOption();
+
+    QCommandLineOption dbOption("db", "SQLite database file.", "path", "bank.db");
+    QCommandLineOption backendOption("backend", "Storage engine: sqlite or memory.", "name", "sqlite");
+    QCommandLineOption batchOption("batch", "Postings per transaction.", "n", "500");
+    QCommandLineOption quietOption("quiet", "Do not print per-operation results.");
+    QCommandLineOption metricsOption("metrics", "Write per-operation latency JSON to file.", "file");
+    QCommandLineOption slowOption("slow-query-ms", "Log statements slower than this.", "ms");
+    QCommandLineOption cardsOption("cards", "generate: credit cards per user.", "n", "0");
+    QCommandLineOption schedulesOption("schedules", "generate: scheduled payments per user.", "n", "0");
+    QCommandLineOption portOption("port", "serve/loadgen: TCP port.", "port", "8080");
+    QCommandLineOption workersOption("workers", "serve: worker threads.", "n",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption maxQueuedOption("max-queued", "serve: requests waiting before 503.", "n", "256");
+    QCommandLineOption connectionsOption("connections", "loadgen: concurrent connections.", "n", "8");
+    QCommandLineOption requestsOption("requests", "loadgen: requests per connection.", "n", "10000");
+    QCommandLineOption pipelineOption("pipeline", "loadgen: requests in flight per connection.", "n", "4");
+    QCommandLineOption emailOption("email", "loadgen: client login email.", "email", "alice@example.com");
+    QCommandLineOption passwordOption("password", "loadgen: client password.", "password", "Password123!");
+    QCommandLineOption shardsOption("shards", "Shard files for a new database (fixed once created).", "n", "0");
+    QCommandLineOption threadsOption("threads", "bench-postings/repair-balances/bench-cardcycle: worker threads.", "n",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption crossShardOption("cross-shard", "bench-postings: percent of transfers to another shard.", "pct", "0");
+    QCommandLineOption verifyOption("verify", "replay-txlog: compare with the transactions tables.");
+    QCommandLineOption pagesOption("pages", "backup: pages copied per step.", "n", "64");
+    QCommandLineOption pauseOption("pause-ms", "backup: pause between steps.", "ms", "5");
+    QCommandLineOption sampleDataOption("sample-data", "Add the demo clients to a database without clients.");
+    QCommandLineOption rejectsOption("rejects", "import: reject file (default <file.csv>.rejects).", "file");
+    QCommandLineOption commitRowsOption("commit-rows", "import/bench-import: rows per transaction.", "n", "50000");
+    QCommandLineOption qtSqlOption("qtsql-postings", "Post through QSqlQuery instead of native SQLite statements.");
+    QCommandLineOption riskOption("risk-rules", "Velocity limits: 'default' or a rule list (off by default).", "rules");
+    QCommandLineOption historyOption("history", "bench-export: transactions in the exported account.", "n", "200000");
+    parser.addOptions({dbOption, backendOption, batchOption, quietOption, metricsOption, slowOption,
+                       cardsOption, schedulesOption, portOption, workersOption, maxQueuedOption,
+                       connectionsOption, requestsOption, pipelineOption, emailOption, passwordOption,
+                       historyOption, shardsOption, threadsOption, crossShardOption, verifyOption,
+                       sampleDataOption, pagesOption, pauseOption, rejectsOption, commitRowsOption,
+                       riskOption, qtSqlOption});
+    parser.addPositionalArgument("command", "run | generate | serve | loadgen | bench-export | bench-postings"
+                                            " | bench-search | bench-init | export-txlog | replay-txlog"
+                                            " | backup | restore | bench-backup | bench-atomic | bench-cardcycle"
+                                            " | close-statements | repair-balances | import | bench-import | bench-risk"
+                                            " | bench-reads | bench-native");
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    const QString command = positional.value(0, "run");
+
+    if (parser.isSet(metricsOption)) OpMetrics::setEnabled(true);
+    if (parser.isSet(slowOption)) {
+        SlowQueryLog::enable("slow_queries.log", parser.value(slowOption).toInt());
+    }
+
+    QTextStream err(stderr);
+
+    if (parser.isSet(qtSqlOption)) DBManager::setNativePostings(false);
+    if (parser.isSet(riskOption)) {
+        QVector<RiskEngine::Rule> rules = RiskEngine::defaultRules();
+        if (parser.value(riskOption) != "default" && !RiskEngine::parseRules(parser.value(riskOption), &rules)) {
+            qCritical() << "Invalid --risk-rules:" << parser.value(riskOption);
+            return 2;
+        }
+        RiskEngine::instance().setRules(rules);
+    }
+
+    // The load generator is a pure client and never touches the database
+    if (command == "loadgen") {
+        LoadGenOptions options;
+        options.port = quint16(parser.value(portOption).toUInt());
+        options.connections = qMax(1, parser.value(connectionsOption).toInt());
+        options.requestsPerConnection = qMax(1, parser.value(requestsOption).toInt());
+        options.pipeline = qMax(1, parser.value(pipelineOption).toInt());
+        options.email = parser.value(emailOption);
+        options.password = parser.value(passwordOption);
+
+        const LoadGenReport report = runLoadGenerator(options);
+        err << QString("requests=%1 errors=%2 elapsed_ms=%3 rps=%4 p50_ms=%5 p99_ms=%6 p999_ms=%7 max_ms=%8\n")
+                   .arg(report.requests).arg(report.errors).arg(report.elapsedMs)
+                   .arg(report.requestsPerSecond(), 0, 'f', 1)
+                   .arg(report.p50Ms, 0, 'f', 3).arg(report.p99Ms, 0, 'f', 3)
+                   .arg(report.p999Ms, 0, 'f', 3).arg(report.maxMs, 0, 'f', 3);
+        return report.errors > 0 ? 1 : 0;
+    }
+
+    // Restore replaces the files, so it runs before anything opens them
+    if (command == "restore") {
+        QString error;
+        if (positional.value(1).isEmpty()) {
+            qCritical() << "restore needs a backup file";
+            return 2;
+        }
+        if (!OnlineBackup::restore(positional.value(1), parser.value(dbOption), &error)) {
+            qCritical() << "Restore failed:" << error;
+            return 1;
+        }
+        err << QString("restored %1 into %2 (verified)\n").arg(positional.value(1), parser.value(dbOption));
+        return 0;
+    }
+
+    std::unique_ptr<StorageBackend> backend;
+    qint64 initMs = -1;
+    if (parser.value(backendOption) == "memory") {
+        if (command == "serve" || command == "bench-export" || command == "bench-search"
+            || command == "bench-init" || command == "backup" || command == "bench-backup"
+            || command == "bench-atomic" || command == "bench-cardcycle" || command == "close-statements"
+            || command == "repair-balances"
+            || command == "export-txlog"
+            || command == "replay-txlog"
+            || command == "import" || command == "bench-import"
+            || command == "bench-risk" || command == "bench-reads" || command == "bench-native") {
+            qCritical() << command << "needs the sqlite backend";
+            return 2;
+        }
+        auto memory = std::make_unique<MemoryBackend>();
+        if (parser.isSet(sampleDataOption)) memory->seedSampleData();
+        backend = std::move(memory);
+    } else if (parser.value(backendOption) == "sqlite") {
+        QElapsedTimer initClock;
+        initClock.start();
+        if (!DBManager::init(parser.value(dbOption), parser.value(shardsOption).toInt())) {
+            qCritical() << "Could not initialize database" << parser.value(dbOption);
+            return 2;
+        }
+        initMs = initClock.elapsed();
+        if (parser.isSet(sampleDataOption)) DBManager::seedSampleData();
+        backend = std::make_unique<SqliteBackend>();
+    } else {
+        qCritical() << "Unknown backend" << parser.value(backendOption);
+        return 2;
+    }
+
+    int exitCode = 0;
+
+    if (command == "run") {
+        QFile input;
+        const QString source = positional.value(1, "-");
+        bool opened = false;
+        if (source == "-") {
+            opened = input.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+        } else {
+            input.setFileName(source);
+            opened = input.open(QIODevice::ReadOnly | QIODevice::Text);
+        }
+        if (!opened) {
+            qCritical() << "Cannot read" << source << ":" << input.errorString();
+            return 2;
+        }
+
+        QTextStream in(&input);
+        QTextStream out(stdout);
+        BatchRunner runner(*backend, parser.value(batchOption).toInt());
+        BatchStats stats = runner.run(in, parser.isSet(quietOption) ? nullptr : &out);
+
+        err << QString("operations=%1 ok=%2 failed=%3 elapsed_ms=%4 ops_per_sec=%5\n")
+                   .arg(stats.operations).arg(stats.succeeded).arg(stats.failed)
+                   .arg(stats.elapsedMs).arg(stats.opsPerSecond(), 0, 'f', 1);
+        exitCode = stats.failed > 0 ? 1 : 0;
+    } else if (command == "generate") {
+        bool ok = false;
+        const int users = positional.value(1).toInt(&ok);
+        if (!ok || users <= 0) {
+            qCritical() << "generate needs a positive user count";
+            return 2;
+        }
+        if (!backend->generate(users, parser.value(cardsOption).toInt(),
+                               parser.value(schedulesOption).toInt())) {
+            exitCode = 1;
+        }
+        err << QString("generated users=%1\n").arg(users);
+    } else if (command == "bench-export") {
+        const int postings = qMax(1, positional.value(1, "2000").toInt());
+        const ExportBenchStats stats = BatchRunner::benchExport(postings, parser.value(historyOption).toInt());
+        err << QString("idle:   p50_us=%1 p99_us=%2 max_us=%3\n")
+                   .arg(stats.idleP50Us, 0, 'f', 1).arg(stats.idleP99Us, 0, 'f', 1).arg(stats.idleMaxUs, 0, 'f', 1);
+        err << QString("export: p50_us=%1 p99_us=%2 max_us=%3 passes=%4 rows=%5\n")
+                   .arg(stats.busyP50Us, 0, 'f', 1).arg(stats.busyP99Us, 0, 'f', 1).arg(stats.busyMaxUs, 0, 'f', 1)
+                   .arg(stats.exportPasses).arg(stats.exportedRows);
+    } else if (command == "bench-postings") {
+        const int perThread = qMax(1, positional.value(1, "10000").toInt());
+        const int threads = qMax(1, parser.value(threadsOption).toInt());
+        const BatchStats stats = BatchRunner::benchPostings(*backend, threads, perThread,
+                                                            qBound(0, parser.value(crossShardOption).toInt(), 100));
+        err << QString("backend=%1 shards=%2 threads=%3 postings=%4 failed=%5 elapsed_ms=%6 postings_per_sec=%7\n")
+                   .arg(backend->name()).arg(backend->partitionCount()).arg(threads).arg(stats.operations).arg(stats.failed)
+                   .arg(stats.elapsedMs).arg(stats.opsPerSecond(), 0, 'f', 1);
+    } else if (command == "bench-search") {
+        QStringList words = positional.mid(1);
+        if (words.isEmpty()) words = {"benchmark", "history", "deposit", "hydro", "interac", "123.25"};
+        const SearchBenchStats stats = BatchRunner::benchSearch(words);
+        err << QString("index=%1 history=%2 keystrokes=%3 p50_ms=%4 p99_ms=%5 max_ms=%6\n")
+                   .arg(stats.indexed ? "fts5" : "like").arg(stats.historyRows).arg(stats.queries)
+                   .arg(stats.p50Ms, 0, 'f', 2).arg(stats.p99Ms, 0, 'f', 2).arg(stats.maxMs, 0, 'f', 2);
+    } else if (command == "bench-init") {
+        err << QString("init_ms=%1 schema=%2 shards=%3\n")
+                   .arg(initMs).arg(DBManager::schemaMigrated() ? "migrated" : "current")
+                   .arg(DBManager::shardCount());
+    } else if (command == "backup") {
+        const QString path = positional.value(1);
+        if (path.isEmpty()) {
+            qCritical() << "backup needs a destination file";
+            return 2;
+        }
+        OnlineBackup backup(parser.value(pagesOption).toInt(), parser.value(pauseOption).toInt());
+        QElapsedTimer clock;
+        clock.start();
+        backup.start(path);
+        const bool ok = backup.wait();
+        QString error;
+        bool verified = ok && OnlineBackup::verifyFile(path, &error);
+        for (int shard = 0; verified && DBManager::shardCount() > 1 && shard < DBManager::shardCount(); ++shard) {
+            verified = OnlineBackup::verifyFile(DBManager::shardPath(path, shard), &error);
+        }
+        err << QString("pages=%1 steps=%2 elapsed_ms=%3 verified=%4\n")
+                   .arg(backup.pagesTotal()).arg(backup.steps()).arg(clock.elapsed())
+                   .arg(verified ? "yes" : "no");
+        if (!verified) {
+            qCritical() << (ok ? error : backup.errorString());
+            exitCode = 1;
+        }
+    } else if (command == "bench-backup") {
+        const int postings = qMax(1, positional.value(1, "2000").toInt());
+        const BackupBenchStats stats = BatchRunner::benchBackup(parser.value(dbOption) + ".bench-backup", postings,
+                                                                parser.value(pagesOption).toInt(),
+                                                                parser.value(pauseOption).toInt());
+        err << QString("idle:   p50_us=%1 p99_us=%2\n")
+                   .arg(stats.idleP50Us, 0, 'f', 1).arg(stats.idleP99Us, 0, 'f', 1);
+        err << QString("backup: p50_us=%1 p99_us=%2 max_us=%3 postings=%4 backup_ms=%5 pages=%6 steps=%7\n")
+                   .arg(stats.busyP50Us, 0, 'f', 1).arg(stats.busyP99Us, 0, 'f', 1).arg(stats.busyMaxUs, 0, 'f', 1)
+                   .arg(stats.postingsDuringBackup).arg(stats.backupMs).arg(stats.pages).arg(stats.steps);
+        exitCode = stats.ok ? 0 : 1;
+    } else if (command == "close-statements") {
+        const QDate asOf = positional.size() > 1 ? QDate::fromString(positional[1], "yyyy-MM-dd")
+                                                 : QDate::currentDate();
+        if (!asOf.isValid()) {
+            qCritical() << "close-statements needs a yyyy-MM-dd date";
+            return 2;
+        }
+        const StatementCloseStats stats = DBManager::closeMonthlyStatements(asOf);
+        err << QString("accounts=%1 statements=%2 elapsed_ms=%3\n")
+                   .arg(stats.accounts).arg(stats.statements).arg(stats.elapsedMs);
+    } else if (command == "repair-balances") {
+        const RunningBalanceStats stats = DBManager::rebuildRunningBalances(parser.value(threadsOption).toInt(),
+                                                                            positional.value(1) == "missing");
+        err << QString("accounts=%1 rows=%2 elapsed_ms=%3\n")
+                   .arg(stats.accounts).arg(stats.rows).arg(stats.elapsedMs);
+    } else if (command == "bench-atomic") {
+        const AtomicBenchStats stats = BatchRunner::benchAtomic(qMax(2, positional.value(1, "10000").toInt()));
+        const auto report = [&](const char *label, const AtomicBenchStats::Path &path) {
+            err << QString("%1 postings=%2 failed=%3 elapsed_ms=%4 postings_per_sec=%5 p50_us=%6 p99_us=%7\n")
+                       .arg(label).arg(stats.postings).arg(path.failed).arg(path.elapsedMs)
+                       .arg(path.elapsedMs > 0 ? stats.postings * 1000.0 / path.elapsedMs : 0.0, 0, 'f', 1)
+                       .arg(path.p50Us, 0, 'f', 1).arg(path.p99Us, 0, 'f', 1);
+        };
+        report("legacy:", stats.legacy);
+        report("atomic:", stats.atomic);
+    } else if (command == "bench-cardcycle") {
+        const QDate date = QDate::fromString(positional.value(1), "yyyy-MM-dd");
+        if (positional.size() > 1 && !date.isValid()) {
+            qCritical() << "bench-cardcycle needs a yyyy-MM-dd date";
+            return 2;
+        }
+        const CardCycleBenchStats stats = BatchRunner::benchCardCycle(date, parser.value(threadsOption).toInt());
+        err << QString("date=%1 threads=%2 cards=%3 interest=%4 elapsed_ms=%5 cards_per_sec=%6 "
+                       "rerun_cards=%7 rerun_ms=%8\n")
+                   .arg(stats.statementDate.toString("yyyy-MM-dd")).arg(stats.threads)
+                   .arg(stats.first.cardsClosed).arg(stats.first.totalInterest, 0, 'f', 2)
+                   .arg(stats.first.elapsedMs).arg(stats.cardsPerSecond(), 0, 'f', 0)
+                   .arg(stats.rerun.cardsClosed).arg(stats.rerun.elapsedMs);
+        if (stats.rerun.cardsClosed != 0) exitCode = 1;
+    } else if (command == "export-txlog" || command == "replay-txlog") {
+        const QString path = positional.value(1);
+        if (path.isEmpty()) {
+            qCritical() << command << "needs a log file";
+            return 2;
+        }
+        if (command == "export-txlog") {
+            const qint64 records = BatchRunner::exportTxLog(path);
+            if (records < 0) return 1;
+            err << QString("records=%1\n").arg(records);
+        } else {
+            const TxReplayStats stats = BatchRunner::replayTxLog(path, parser.isSet(verifyOption));
+            err << QString("records=%1 accounts=%2 bytes=%3 replay_ms=%4 gb_per_sec=%5")
+                       .arg(stats.records).arg(stats.accounts).arg(stats.bytes)
+                       .arg(stats.replayNs / 1e6, 0, 'f', 2).arg(stats.gigabytesPerSecond(), 0, 'f', 2);
+            if (stats.sqlMs >= 0) {
+                err << QString(" sql_ms=%1 mismatches=%2").arg(stats.sqlMs).arg(stats.mismatches);
+                exitCode = stats.mismatches > 0 ? 1 : 0;
+            }
+            err << '\n';
+        }
+    } else if (command == "import") {
+        BulkImporter::Kind kind;
+        if (!BulkImporter::parseKind(positional.value(1), &kind) || positional.value(2).isEmpty()) {
+            qCritical() << "import needs a kind (users, accounts, balances, interac, payees) and a CSV file";
+            return 2;
+        }
+        BulkImporter importer(parser.value(commitRowsOption).toInt());
+        const ImportStats stats = importer.run(kind, positional[2], parser.value(rejectsOption));
+        err << QString("records=%1 imported=%2 rejected=%3 commits=%4 elapsed_ms=%5 rows_per_sec=%6\n")
+                   .arg(stats.records).arg(stats.imported).arg(stats.rejected).arg(stats.commits)
+                   .arg(stats.elapsedMs).arg(stats.rowsPerSecond(), 0, 'f', 1);
+        exitCode = stats.ok && stats.rejected == 0 ? 0 : 1;
+    } else if (command == "bench-import") {
+        const int rows = qMax(1, positional.value(1, "100000").toInt());
+        const ImportBenchStats stats = BatchRunner::benchImport(rows, parser.value(dbOption) + ".bench-import",
+                                                                parser.value(commitRowsOption).toInt());
+        const auto report = [&](const char *label, const ImportStats &kind) {
+            err << QString("%1 records=%2 imported=%3 rejected=%4 elapsed_ms=%5 rows_per_sec=%6\n")
+                       .arg(label).arg(kind.records).arg(kind.imported).arg(kind.rejected)
+                       .arg(kind.elapsedMs).arg(kind.rowsPerSecond(), 0, 'f', 1);
+        };
+        report("users:   ", stats.users);
+        report("accounts:", stats.accounts);
+        report("balances:", stats.balances);
+        err << QString("csv_bytes=%1 peak_rss_kb=%2\n").arg(stats.csvBytes).arg(stats.peakRssKb);
+        exitCode = stats.users.ok && stats.accounts.ok && stats.balances.ok ? 0 : 1;
+    } else if (command == "bench-risk") {
+        const RiskBenchStats stats = BatchRunner::benchRisk(qMax(1, positional.value(1, "20000").toInt()));
+        const auto report = [&](const char *label, const RiskBenchStats::Path &path) {
+            err << QString("%1 postings=%2 failed=%3 elapsed_ms=%4 postings_per_sec=%5 p50_us=%6 p99_us=%7\n")
+                       .arg(label).arg(stats.postings).arg(path.failed).arg(path.elapsedMs)
+                       .arg(path.elapsedMs > 0 ? stats.postings * 1000.0 / path.elapsedMs : 0.0, 0, 'f', 1)
+                       .arg(path.p50Us, 0, 'f', 1).arg(path.p99Us, 0, 'f', 1);
+        };
+        report("checks off:", stats.off);
+        report("checks on: ", stats.on);
+        err << QString("check alone: checks=%1 keys=%2 ns_per_check=%3\n")
+                   .arg(stats.checks).arg(stats.keys).arg(stats.nsPerCheck, 0, 'f', 1);
+        exitCode = stats.on.failed > stats.off.failed ? 1 : 0;
+    } else if (command == "bench-reads") {
+        const ReadBenchStats stats = BatchRunner::benchReads(qMax(1, positional.value(1, "2000").toInt()));
+        const auto report = [&](const char *label, int rows, const ReadBenchStats::Path &path) {
+            err << QString("%1 reads=%2 rows=%3 mean_us=%4 p99_us=%5 allocs_per_read=%6\n")
+                       .arg(label).arg(stats.reads).arg(rows)
+                       .arg(path.meanUs, 0, 'f', 1).arg(path.p99Us, 0, 'f', 1)
+                       .arg(path.allocationsPerRead < 0 ? QString("n/a")
+                                                        : QString::number(path.allocationsPerRead, 'f', 1));
+        };
+        report("balances qvariant:", stats.balanceRows, stats.balancesVariant);
+        report("balances typed:   ", stats.balanceRows, stats.balancesTyped);
+        report("page qvariant:    ", stats.pageRows, stats.pageVariant);
+        report("page typed:       ", stats.pageRows, stats.pageTyped);
+        exitCode = stats.reads > 0 ? 0 : 1;
+    } else if (command == "bench-native") {
+        const NativeBenchStats stats = BatchRunner::benchNative(qMax(2, positional.value(1, "20000").toInt()));
+        const auto report = [&](const char *label, const NativeBenchStats::Path &path) {
+            err << QString("%1 postings=%2 failed=%3 elapsed_ms=%4 postings_per_sec=%5 p50_us=%6 p99_us=%7"
+                           " allocs_per_posting=%8\n")
+                       .arg(label).arg(stats.postings).arg(path.failed).arg(path.elapsedMs)
+                       .arg(path.elapsedMs > 0 ? stats.postings * 1000.0 / path.elapsedMs : 0.0, 0, 'f', 1)
+                       .arg(path.p50Us, 0, 'f', 1).arg(path.p99Us, 0, 'f', 1)
+                       .arg(path.allocationsPerPosting < 0 ? QString("n/a")
+                                                           : QString::number(path.allocationsPerPosting, 'f', 1));
+        };
+        report("qtsql: ", stats.qtSql);
+        report("native:", stats.native);
+        exitCode = stats.qtSql.failed == 0 && stats.native.failed == 0 ? 0 : 1;
+    } else if (command == "serve") {
+        BankApi api;
+        HttpServer server([&api](const HttpRequest &request) { return api.handle(request); },
+                          parser.value(workersOption).toInt(), parser.value(maxQueuedOption).toInt());
+        server.setWorkerCleanup(&DBManager::releaseThreadConnection);
+        const quint16 port = quint16(parser.value(portOption).toUInt());
+        if (!server.listen(QHostAddress::LocalHost, port)) return 2;
+        DBManager::scheduleTransferRecovery(&app);
+        err << QString("listening on 127.0.0.1:%1 workers=%2\n")
+                   .arg(server.serverPort()).arg(parser.value(workersOption));
+        err.flush();
+        exitCode = app.exec();
+    } else {
+        parser.showHelp(2);
+    }
+
+    if (parser.isSet(metricsOption)) {
+        OpMetrics::dumpJson(parser.value(metricsOption));
+    }
+    return exitCode;
+}
@@ -0,0 +1,814 @@
+#include "batchrunner.h"
+#include "dbmanager.h"
+#include "storagebackend.h"
+#include "slowquerylog.h"
+#include "opmetrics.h"
+#include "txlog.h"
+#include "onlinebackup.h"
+#include "riskengine.h"
+#include "allocationcounter.h"
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include <QRegularExpression>
+#include <QThread>
+#include <atomic>
+#include <vector>
+
+namespace {
+
+bool toInt(const QString &text, int *value) {
+    bool ok = false;
+    *value = text.toInt(&ok);
+    return ok;
+}
+
+bool toAmount(const QString &text, double *value) {
+    bool ok = false;
+    *value = text.toDouble(&ok);
+    return ok;
+}
+
+QDate dateArg(const QStringList &args, int index) {
+    return args.size() > index ? QDate::fromString(args[index], "yyyy-MM-dd")
+                               : QDate::currentDate();
+}
+
+// The posting paths before they became single transactions, kept for
+// bench-atomic: autocommitted statements and a separate balance read.
+bool legacyDeposit(int accountId, double amount) {
+    QSqlQuery q(DBManager::database());
+    q.prepare("UPDATE accounts SET balance = balance + :amt WHERE id = :id");
+    q.bindValue(":amt", amount);
+    q.bindValue(":id", accountId);
+    if (!SlowQueryLog::exec(q)) return false;
+
+    QSqlQuery t(DBManager::database());
+    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
+              "VALUES (:acc, 'Deposit', :amt, 'Cash deposit')");
+    t.bindValue(":acc", accountId);
+    t.bindValue(":amt", amount);
+    return SlowQueryLog::exec(t);
+}
+
+bool legacyWithdraw(int accountId, double amount) {
+    QSqlQuery balQ(DBManager::database());
+    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
+    balQ.bindValue(":id", accountId);
+    if (!SlowQueryLog::exec(balQ) || !balQ.next()) return false;
+    if (balQ.value(0).toDouble() < amount) return false;
+    balQ.finish();
+
+    QSqlQuery q(DBManager::database());
+    q.prepare("UPDATE accounts SET balance = balance - :amt WHERE id = :id");
+    q.bindValue(":amt", amount);
+    q.bindValue(":id", accountId);
+    if (!SlowQueryLog::exec(q)) return false;
+
+    QSqlQuery t(DBManager::database());
+    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
+              "VALUES (:acc, 'Withdrawal', :amt, 'Cash withdrawal')");
+    t.bindValue(":acc", accountId);
+    t.bindValue(":amt", amount);
+    return SlowQueryLog::exec(t);
+}
+
+// Peak resident set size in KB (VmHWM), or -1 off Linux
+qint64 peakResidentKb() {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return -1;
+    for (const QByteArray &line : status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+    }
+    return -1;
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(StorageBackend &backend, int batchSize)
+    : m_backend(backend),
+      m_batchSize(qMax(1, batchSize)),
+      m_pending(0) {
+}
+
+void BatchRunner::flushBatch() {
+    if (m_pending == 0) return;
+    if (!m_backend.commitBatch()) {
+        qWarning() << "Batch commit failed on" << m_backend.name();
+    }
+    m_pending = 0;
+}
+
+BatchStats BatchRunner::run(QTextStream &in, QTextStream *results) {
+    BatchStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // Fields may be separated by tabs or runs of spaces
+    static const QRegularExpression whitespace("\\s+");
+    int lineNo = 0;
+    while (!in.atEnd()) {
+        const QString line = in.readLine();
+        ++lineNo;
+
+        const QString command = line.section('#', 0, 0).trimmed();
+        if (command.isEmpty()) continue;
+        const QStringList args = command.split(whitespace, Qt::SkipEmptyParts);
+        const QString verb = args.first().toLower();
+
+        const bool endOfDayJob = verb == "cardcycle" || verb == "scheduled"
+                                 || (verb == "interest" && args.value(1) == "all");
+        if (endOfDayJob) {
+            flushBatch();
+        } else if (m_pending == 0) {
+            m_backend.beginBatch();
+        }
+
+        QString detail;
+        const bool ok = execute(args, &detail);
+        ++stats.operations;
+        if (ok) ++stats.succeeded; else ++stats.failed;
+
+        if (!endOfDayJob && ++m_pending >= m_batchSize) {
+            flushBatch();
+        }
+
+        if (results) {
+            *results << lineNo << '\t' << command << '\t' << (ok ? "OK" : "FAIL");
+            if (!detail.isEmpty()) *results << '\t' << detail;
+            *results << '\n';
+        }
+    }
+    flushBatch();
+    if (results) results->flush();
+
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+bool BatchRunner::execute(const QStringList &args, QString *detail) {
+    const QString verb = args.first().toLower();
+    int a = 0, b = 0, c = 0;
+    double amount = 0.0;
+
+    if (verb == "createuser" && args.size() >= 4) {
+        QDate dob = args.size() > 4 ? QDate::fromString(args[4], "yyyy-MM-dd") : QDate();
+        return m_backend.createUser(args[1], args[2], args[3], dob);
+    }
+    if (verb == "createaccount" && args.size() >= 4 && toInt(args[1], &a) && toAmount(args[3], &amount)) {
+        double rate = args.size() > 4 ? args[4].toDouble() : 0.0;
+        int id = m_backend.createAccount(a, args[2], amount, rate);
+        *detail = QString("account=%1").arg(id);
+        return id > 0;
+    }
+    if (verb == "deposit" && args.size() == 3 && toInt(args[1], &a) && toAmount(args[2], &amount)) {
+        return m_backend.deposit(a, amount);
+    }
+    if (verb == "withdraw" && args.size() == 3 && toInt(args[1], &a) && toAmount(args[2], &amount)) {
+        return m_backend.withdraw(a, amount);
+    }
+    if (verb == "transfer" && args.size() == 4 && toInt(args[1], &a) && toInt(args[2], &b)
+        && toAmount(args[3], &amount)) {
+        return m_backend.transferAccountToAccount(a, b, amount);
+    }
+    if (verb == "interac" && args.size() == 4 && toInt(args[1], &a) && toAmount(args[3], &amount)) {
+        return m_backend.interacTransfer(a, args[2], amount);
+    }
+    if (verb == "paybill" && args.size() == 5 && toInt(args[1], &a) && toInt(args[2], &b)
+        && toInt(args[3], &c) && toAmount(args[4], &amount)) {
+        return m_backend.payBill(a, b, c, amount);
+    }
+    if (verb == "cardspend" && args.size() == 3 && toInt(args[1], &a) && toAmount(args[2], &amount)) {
+        return m_backend.spendOnCard(a, amount);
+    }
+    if (verb == "cardpay" && args.size() == 5 && toInt(args[1], &a) && toInt(args[2], &b)
+        && toInt(args[3], &c) && toAmount(args[4], &amount)) {
+        return m_backend.payCreditCard(a, b, c, amount);
+    }
+    if (verb == "interest" && args.size() == 2) {
+        if (args[1] == "all") {
+            *detail = QString("accounts=%1").arg(m_backend.applyMonthlyInterestForAllUsers());
+            return true;
+        }
+        if (!toInt(args[1], &a)) return false;
+        m_backend.applyMonthlyInterestForUser(a);
+        return true;
+    }
+    if (verb == "cardcycle") {
+        QDate date = dateArg(args, 1);
+        if (!date.isValid()) return false;
+        CardCycleStats cycle = m_backend.closeCardBillingCycle(date, 0);
+        *detail = QString("cards=%1 interest=%2 ms=%3")
+                      .arg(cycle.cardsClosed).arg(cycle.totalInterest, 0, 'f', 2).arg(cycle.elapsedMs);
+        return true;
+    }
+    if (verb == "scheduled") {
+        QDate date = dateArg(args, 1);
+        if (!date.isValid()) return false;
+        ScheduledRunStats run = m_backend.runDueScheduledPayments(date, -1);
+        *detail = QString("due=%1 paid=%2 retried=%3 failed=%4 ms=%5")
+                      .arg(run.due).arg(run.paid).arg(run.retried).arg(run.failed).arg(run.elapsedMs);
+        return true;
+    }
+
+    *detail = "unknown command or bad arguments";
+    return false;
+}
+
+BatchStats BatchRunner::benchPostings(StorageBackend &backend, int threads, int postingsPerThread,
+                                      int crossShardPercent) {
+    BatchStats stats;
+    const int shards = backend.partitionCount();
+
+    // Each thread posts between the accounts of one shard
+    std::vector<QList<int>> accounts(shards);
+    for (int s = 0; s < shards; ++s) {
+        accounts[s] = backend.accountIds(s, 1000);
+        if (accounts[s].size() < 2) {
+            qWarning() << "bench-postings: shard" << s << "needs at least two accounts (run generate first)";
+            return stats;
+        }
+    }
+
+    std::atomic<qint64> succeeded{0};
+    std::atomic<qint64> failed{0};
+    std::vector<QThread *> workers;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(QThread::create([&, t]() {
+            const QList<int> &own = accounts[t % shards];
+            const QList<int> &other = accounts[(t + 1) % shards];
+            for (int i = 0; i < postingsPerThread; ++i) {
+                const int from = own[(i + t) % own.size()];
+                bool ok;
+                if (i % 2 == 0) {
+                    ok = backend.deposit(from, 1.0);
+                } else if (crossShardPercent > 0 && (i / 2) % 100 < crossShardPercent) {
+                    ok = backend.transferAccountToAccount(from, other[i % other.size()], 0.5);
+                } else {
+                    ok = backend.transferAccountToAccount(from, own[(i + t + 1) % own.size()], 0.5);
+                }
+                if (ok) ++succeeded; else ++failed;
+            }
+            DBManager::releaseThreadConnection();
+        }));
+        workers.back()->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    stats.elapsedMs = timer.elapsed();
+    stats.succeeded = succeeded.load();
+    stats.failed = failed.load();
+    stats.operations = stats.succeeded + stats.failed;
+    return stats;
+}
+
+ExportBenchStats BatchRunner::benchExport(int postings, int historyRows) {
+    ExportBenchStats stats;
+    QSqlDatabase db = DBManager::database();
+
+    QSqlQuery first(db);
+    if (!SlowQueryLog::exec(first, "SELECT MIN(id) FROM accounts") || !first.next()
+        || first.value(0).isNull()) {
+        qWarning() << "bench-export: no accounts";
+        return stats;
+    }
+    const int accountId = first.value(0).toInt();
+
+    QSqlQuery count(db);
+    count.prepare("SELECT COUNT(*) FROM transactions WHERE account_id = ?");
+    count.addBindValue(accountId);
+    int existing = 0;
+    if (SlowQueryLog::exec(count) && count.next()) existing = count.value(0).toInt();
+
+    QSqlQuery history(db);
+    history.prepare("INSERT INTO transactions (account_id, type, amount, description) "
+                    "VALUES (?, 'Deposit', ?, 'Benchmark history')");
+    db.transaction();
+    for (int i = existing; i < historyRows; ++i) {
+        history.addBindValue(accountId);
+        history.addBindValue(double(i % 500) + 0.25);
+        SlowQueryLog::exec(history);
+    }
+    db.commit();
+
+    auto timePostings = [&](LatencyHistogram *histogram) {
+        QElapsedTimer timer;
+        for (int i = 0; i < postings; ++i) {
+            timer.start();
+            DBManager::deposit(accountId, 1.0);
+            histogram->record(quint64(timer.nsecsElapsed()));
+        }
+    };
+
+    LatencyHistogram idle;
+    timePostings(&idle);
+
+    std::atomic<bool> stop{false};
+    std::atomic<qint64> exportedRows{0};
+    std::atomic<int> passes{0};
+    QThread *exporter = QThread::create([&]() {
+        while (!stop.load()) {
+            ReadSnapshot snapshot;
+            QSqlQuery q(snapshot.database());
+            q.setForwardOnly(true);
+            q.prepare("SELECT timestamp, type, amount, description FROM transactions "
+                      "WHERE account_id = ? ORDER BY datetime(timestamp) DESC");
+            q.addBindValue(accountId);
+            SlowQueryLog::exec(q);
+            // Format like the PDF export so the reader holds its snapshot
+            // for a realistic amount of time
+            QString row;
+            while (q.next() && !stop.load()) {
+                row = q.value(0).toString() + q.value(1).toString()
+                      + QString::number(q.value(2).toDouble(), 'f', 2) + q.value(3).toString();
+                ++exportedRows;
+            }
+            ++passes;
+        }
+        DBManager::releaseThreadConnection();
+    });
+    exporter->start();
+    // Let the export get going before the writes start
+    QThread::msleep(50);
+
+    LatencyHistogram busy;
+    timePostings(&busy);
+    stop = true;
+    exporter->wait();
+    delete exporter;
+
+    stats.idleP50Us = idle.percentile(50) / 1000.0;
+    stats.idleP99Us = idle.percentile(99) / 1000.0;
+    stats.idleMaxUs = idle.maxNanos() / 1000.0;
+    stats.busyP50Us = busy.percentile(50) / 1000.0;
+    stats.busyP99Us = busy.percentile(99) / 1000.0;
+    stats.busyMaxUs = busy.maxNanos() / 1000.0;
+    stats.exportedRows = exportedRows.load();
+    stats.exportPasses = passes.load();
+    return stats;
+}
+
+BackupBenchStats BatchRunner::benchBackup(const QString &destPath, int postings,
+                                          int pagesPerStep, int pauseMs) {
+    BackupBenchStats stats;
+    QSqlQuery first(DBManager::database());
+    if (!SlowQueryLog::exec(first, "SELECT MIN(id) FROM accounts") || !first.next()
+        || first.value(0).isNull()) {
+        qWarning() << "bench-backup: no accounts";
+        return stats;
+    }
+    const int accountId = first.value(0).toInt();
+    first.finish();
+
+    QElapsedTimer timer;
+    LatencyHistogram idle;
+    for (int i = 0; i < postings; ++i) {
+        timer.start();
+        DBManager::deposit(accountId, 1.0);
+        idle.record(quint64(timer.nsecsElapsed()));
+    }
+
+    // Keep posting for the whole backup, however long it takes
+    OnlineBackup backup(pagesPerStep, pauseMs);
+    QElapsedTimer backupClock;
+    backupClock.start();
+    if (!backup.start(destPath)) return stats;
+    LatencyHistogram busy;
+    while (backup.isRunning()) {
+        timer.start();
+        DBManager::deposit(accountId, 1.0);
+        busy.record(quint64(timer.nsecsElapsed()));
+    }
+    stats.ok = backup.wait();
+    stats.backupMs = backupClock.elapsed();
+
+    stats.idleP50Us = idle.percentile(50) / 1000.0;
+    stats.idleP99Us = idle.percentile(99) / 1000.0;
+    stats.busyP50Us = busy.percentile(50) / 1000.0;
+    stats.busyP99Us = busy.percentile(99) / 1000.0;
+    stats.busyMaxUs = busy.maxNanos() / 1000.0;
+    stats.postingsDuringBackup = qint64(busy.count());
+    stats.pages = backup.pagesTotal();
+    stats.steps = backup.steps();
+    return stats;
+}
+
+AtomicBenchStats BatchRunner::benchAtomic(int postings) {
+    AtomicBenchStats stats;
+    QSqlQuery first(DBManager::database());
+    if (!SlowQueryLog::exec(first, "SELECT MIN(id) FROM accounts") || !first.next()
+        || first.value(0).isNull()) {
+        qWarning() << "bench-atomic: no accounts";
+        return stats;
+    }
+    const int accountId = first.value(0).toInt();
+    first.finish();
+
+    // Alternating $1 deposits and withdrawals leave the balance unchanged
+    auto timePath = [&](bool (*depositFn)(int, double), bool (*withdrawFn)(int, double),
+                        AtomicBenchStats::Path *path) {
+        LatencyHistogram histogram;
+        QElapsedTimer total;
+        QElapsedTimer timer;
+        total.start();
+        for (int i = 0; i < postings; ++i) {
+            timer.start();
+            const bool ok = (i % 2 == 0) ? depositFn(accountId, 1.0) : withdrawFn(accountId, 1.0);
+            histogram.record(quint64(timer.nsecsElapsed()));
+            if (!ok) ++path->failed;
+        }
+        path->elapsedMs = total.elapsed();
+        path->p50Us = histogram.percentile(50) / 1000.0;
+        path->p99Us = histogram.percentile(99) / 1000.0;
+    };
+
+    timePath(&legacyDeposit, &legacyWithdraw, &stats.legacy);
+    timePath(&DBManager::deposit, &DBManager::withdraw, &stats.atomic);
+    stats.postings = postings;
+    return stats;
+}
+
+CardCycleBenchStats BatchRunner::benchCardCycle(const QDate &statementDate, int threadCount) {
+    CardCycleBenchStats stats;
+    stats.threads = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+    stats.statementDate = statementDate;
+    if (!stats.statementDate.isValid()) {
+        stats.statementDate = QDate::currentDate();
+        for (int shard = 0; shard < DBManager::shardCount(); ++shard) {
+            QSqlQuery latest(DBManager::shardDatabase(shard));
+            if (!SlowQueryLog::exec(latest, "SELECT MAX(last_statement_date) FROM credit_cards")
+                || !latest.next() || latest.value(0).isNull()) {
+                continue;
+            }
+            const QDate next = QDate::fromString(latest.value(0).toString(), "yyyy-MM-dd").addDays(1);
+            if (next > stats.statementDate) stats.statementDate = next;
+        }
+    }
+
+    stats.first = DBManager::closeCardBillingCycle(stats.statementDate, stats.threads);
+    stats.rerun = DBManager::closeCardBillingCycle(stats.statementDate, stats.threads);
+    return stats;
+}
+
+NativeBenchStats BatchRunner::benchNative(int postings) {
+    NativeBenchStats stats;
+    QSqlQuery first(DBManager::database());
+    if (!SlowQueryLog::exec(first, "SELECT MIN(id) FROM accounts") || !first.next()
+        || first.value(0).isNull()) {
+        qWarning() << "bench-native: no accounts";
+        return stats;
+    }
+    const int accountId = first.value(0).toInt();
+    first.finish();
+
+    // Alternating $1 deposits and withdrawals leave the balance unchanged.
+    // A warm-up pair per path keeps statement preparation out of the timing.
+    auto timePath = [&](NativeBenchStats::Path *path) {
+        DBManager::deposit(accountId, 1.0);
+        DBManager::withdraw(accountId, 1.0);
+        LatencyHistogram histogram;
+        QElapsedTimer total;
+        QElapsedTimer timer;
+        const quint64 allocations = AllocationCounter::count();
+        total.start();
+        for (int i = 0; i < postings; ++i) {
+            timer.start();
+            const bool ok = (i % 2 == 0) ? DBManager::deposit(accountId, 1.0) : DBManager::withdraw(accountId, 1.0);
+            histogram.record(quint64(timer.nsecsElapsed()));
+            if (!ok) ++path->failed;
+        }
+        path->elapsedMs = total.elapsed();
+        if (AllocationCounter::available()) {
+            path->allocationsPerPosting = double(AllocationCounter::count() - allocations) / postings;
+        }
+        path->p50Us = histogram.percentile(50) / 1000.0;
+        path->p99Us = histogram.percentile(99) / 1000.0;
+    };
+
+    const bool saved = DBManager::nativePostings();
+    DBManager::setNativePostings(false);
+    timePath(&stats.qtSql);
+    DBManager::setNativePostings(true);
+    timePath(&stats.native);
+    DBManager::setNativePostings(saved);
+    stats.postings = postings;
+    return stats;
+}
+
+RiskBenchStats BatchRunner::benchRisk(int postings) {
+    RiskBenchStats stats;
+    QSqlQuery first(DBManager::database());
+    if (!SlowQueryLog::exec(first, "SELECT MIN(id) FROM accounts") || !first.next()
+        || first.value(0).isNull()) {
+        qWarning() << "bench-risk: no accounts";
+        return stats;
+    }
+    const int accountId = first.value(0).toInt();
+    first.finish();
+
+    RiskEngine &risk = RiskEngine::instance();
+    const QVector<RiskEngine::Rule> saved = risk.rules();
+    QVector<RiskEngine::Rule> loose = RiskEngine::defaultRules();
+    for (RiskEngine::Rule &rule : loose) {
+        if (rule.maxCount > 0) rule.maxCount = qMax<qint64>(rule.maxCount, qint64(postings) * 4);
+        if (rule.maxCents > 0) rule.maxCents = qMax<qint64>(rule.maxCents, qint64(postings) * 400);
+    }
+
+    // Each phase first deposits what it withdraws, so the balance ends where it started
+    auto timePath = [&](RiskBenchStats::Path *path) {
+        DBManager::deposit(accountId, postings);
+        LatencyHistogram histogram;
+        QElapsedTimer total;
+        QElapsedTimer timer;
+        total.start();
+        for (int i = 0; i < postings; ++i) {
+            timer.start();
+            const bool ok = DBManager::withdraw(accountId, 1.0);
+            histogram.record(quint64(timer.nsecsElapsed()));
+            if (!ok) ++path->failed;
+        }
+        path->elapsedMs = total.elapsed();
+        path->p50Us = histogram.percentile(50) / 1000.0;
+        path->p99Us = histogram.percentile(99) / 1000.0;
+    };
+
+    risk.setRules({});
+    timePath(&stats.off);
+    risk.reset();
+    risk.setRules(loose);
+    timePath(&stats.on);
+
+    // The check alone: spread over many keys, as under real traffic
+    stats.keys = 10000;
+    stats.checks = 1000000;
+    risk.reset();
+    QElapsedTimer clock;
+    clock.start();
+    const qint64 start = RiskEngine::nowMs();
+    for (quint64 i = 0; i < stats.checks; ++i) {
+        risk.admit(RiskEngine::Scope::Account, int(i % quint64(stats.keys)) + 1, 100, start + qint64(i / 1000));
+    }
+    stats.nsPerCheck = double(clock.nsecsElapsed()) / double(stats.checks);
+
+    risk.reset();
+    risk.setRules(saved);
+    stats.postings = postings;
+    return stats;
+}
+
+ReadBenchStats BatchRunner::benchReads(int reads) {
+    ReadBenchStats stats;
+    QSqlQuery busiest(DBManager::shardDatabase(0));
+    if (!SlowQueryLog::exec(busiest, "SELECT t.account_id, a.user_id FROM transactions t "
+                                     "JOIN accounts a ON a.id = t.account_id "
+                                     "GROUP BY t.account_id ORDER BY COUNT(*) DESC LIMIT 1")
+        || !busiest.next()) {
+        qWarning() << "bench-reads: no transactions";
+        return stats;
+    }
+    const int accountId = busiest.value(0).toInt();
+    const int userId = busiest.value(1).toInt();
+    busiest.finish();
+    const int pageSize = 50;
+
+    // One warm-up read, then 'reads' timed ones; returns the rows per read
+    const auto measure = [reads](ReadBenchStats::Path *path, const auto &read) {
+        int rows = read();
+        LatencyHistogram histogram;
+        QElapsedTimer timer;
+        const quint64 before = AllocationCounter::count();
+        for (int i = 0; i < reads; ++i) {
+            timer.start();
+            rows = read();
+            histogram.record(quint64(timer.nsecsElapsed()));
+        }
+        if (AllocationCounter::available()) {
+            path->allocationsPerRead = double(AllocationCounter::count() - before) / reads;
+        }
+        path->meanUs = histogram.meanNanos() / 1000.0;
+        path->p99Us = histogram.percentile(99) / 1000.0;
+        return rows;
+    };
+
+    struct VariantAccount { qint64 id; QString number; QString type; double balance; double rate; };
+    struct VariantRow { qint64 id; QString timestamp; QString type; double amount; QString description; QVariant balanceAfter; };
+    const QSqlDatabase db = DBManager::readDatabase(DBManager::shardForUser(userId));
+
+    stats.balanceRows = measure(&stats.balancesVariant, [&] {
+        QVector<VariantAccount> rows;
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare("SELECT id, account_number, type, balance, interest_rate FROM accounts "
+                  "WHERE user_id = :user ORDER BY id");
+        q.bindValue(":user", userId);
+        if (SlowQueryLog::exec(q)) {
+            while (q.next()) {
+                rows.push_back({q.value(0).toLongLong(), q.value(1).toString(), q.value(2).toString(),
+                                q.value(3).toDouble(), q.value(4).toDouble()});
+            }
+        }
+        return int(rows.size());
+    });
+    measure(&stats.balancesTyped, [&] {
+        RowSet<AccountBalanceRow> rows;
+        DBManager::accountBalances(userId, &rows);
+        return rows.size();
+    });
+
+    stats.pageRows = measure(&stats.pageVariant, [&] {
+        QVector<VariantRow> rows;
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare("SELECT id, timestamp, type, amount, description, balance_after FROM transactions "
+                  "WHERE account_id = :acc ORDER BY id DESC LIMIT :n");
+        q.bindValue(":acc", accountId);
+        q.bindValue(":n", pageSize);
+        if (SlowQueryLog::exec(q)) {
+            while (q.next()) {
+                rows.push_back({q.value(0).toLongLong(), q.value(1).toString(), q.value(2).toString(),
+                                q.value(3).toDouble(), q.value(4).toString(), q.value(5)});
+            }
+        }
+        return int(rows.size());
+    });
+    measure(&stats.pageTyped, [&] {
+        RowSet<StatementRow> rows;
+        DBManager::statementPage(accountId, 0, pageSize, &rows);
+        return rows.size();
+    });
+
+    stats.reads = reads;
+    return stats;
+}
+
+ImportBenchStats BatchRunner::benchImport(int rows, const QString &workDir, int rowsPerTransaction) {
+    ImportBenchStats stats;
+    QDir().mkpath(workDir);
+    const QString usersPath = QDir(workDir).filePath("users.csv");
+    const QString accountsPath = QDir(workDir).filePath("accounts.csv");
+    const QString balancesPath = QDir(workDir).filePath("balances.csv");
+
+    // A tag per run keeps emails and account numbers unique across reruns
+    const QString tag = QString::number(QDateTime::currentSecsSinceEpoch());
+    {
+        QFile users(usersPath);
+        QFile accounts(accountsPath);
+        QFile balances(balancesPath);
+        if (!users.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || !accounts.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || !balances.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "bench-import: cannot write to" << workDir;
+            return stats;
+        }
+        users.write("email,password,username,dob\n");
+        accounts.write("user_email,account_number,type,interest_rate\n");
+        balances.write("account_number,amount\n");
+        for (int i = 0; i < rows; ++i) {
+            const QByteArray email = QString("import%1-%2@bench.example").arg(tag).arg(i).toUtf8();
+            const QByteArray number = QString("7%1%2").arg(tag).arg(i, 9, 10, QChar('0')).toUtf8();
+            if (i % 1000 == 999) {
+                users.write("not-an-email,Password123!,\"Broken, Row\",1990-01-01\n");
+            } else {
+                users.write(email + ",Password123!,\"Client " + QByteArray::number(i) + "\",1990-01-01\n");
+            }
+            accounts.write(email + "," + number + (i % 2 ? ",Savings,0.012\n" : ",Chequing,\n"));
+            balances.write(number + "," + QByteArray::number(100 + i % 5000) + ".50\n");
+        }
+        stats.csvBytes = users.size() + accounts.size() + balances.size();
+    }
+
+    BulkImporter importer(rowsPerTransaction);
+    stats.users = importer.run(BulkImporter::Kind::Users, usersPath);
+    stats.accounts = importer.run(BulkImporter::Kind::Accounts, accountsPath);
+    stats.balances = importer.run(BulkImporter::Kind::Balances, balancesPath);
+    stats.peakRssKb = peakResidentKb();
+    return stats;
+}
+
+qint64 BatchRunner::exportTxLog(const QString &path) {
+    TxLogWriter log;
+    if (!log.open(path, true)) return -1;
+
+    for (int shard = 0; shard < DBManager::shardCount(); ++shard) {
+        QSqlQuery q(DBManager::shardDatabase(shard));
+        q.setForwardOnly(true);
+        if (!SlowQueryLog::exec(q, "SELECT account_id, COALESCE(related_account_id, 0), type, "
+                                   "COALESCE(description, ''), amount, timestamp "
+                                   "FROM transactions ORDER BY id")) {
+            qWarning() << "export-txlog: read failed:" << q.lastError().text();
+            return -1;
+        }
+
+        // Postings of one batch share a timestamp, so parse each one once
+        QString lastStamp;
+        qint64 lastMs = 0;
+        while (q.next()) {
+            const QString type = q.value(2).toString();
+            const QString stamp = q.value(5).toString();
+            if (stamp != lastStamp) {
+                QDateTime when = QDateTime::fromString(stamp, "yyyy-MM-dd HH:mm:ss");
+                when.setTimeSpec(Qt::UTC);
+                lastMs = when.isValid() ? when.toMSecsSinceEpoch() : 0;
+                lastStamp = stamp;
+            }
+            const qint64 cents = qRound64(q.value(4).toDouble() * 100.0)
+                                 * (DBManager::creditsAccount(type) ? 1 : -1);
+            if (!log.append(q.value(0).toInt(), q.value(1).toInt(), type, q.value(3).toString(),
+                            cents, lastMs)) {
+                return -1;
+            }
+        }
+    }
+
+    const qint64 written = log.recordCount();
+    return log.flush() ? written : -1;
+}
+
+TxReplayStats BatchRunner::replayTxLog(const QString &path, bool verify) {
+    TxReplayStats stats;
+    TxLogReader log;
+    if (!log.open(path)) return stats;
+
+    QElapsedTimer timer;
+    timer.start();
+    const QHash<qint32, qint64> balances = log.netBalances();
+    stats.replayNs = timer.nsecsElapsed();
+    stats.records = log.count();
+    stats.bytes = log.bytes();
+    stats.accounts = balances.size();
+    if (!verify) return stats;
+
+    timer.start();
+    QHash<qint32, qint64> expected;
+    for (int shard = 0; shard < DBManager::shardCount(); ++shard) {
+        QSqlQuery q(DBManager::shardDatabase(shard));
+        q.setForwardOnly(true);
+        if (!SlowQueryLog::exec(q, QString("SELECT account_id, SUM(CASE WHEN %1 "
+                                           "THEN amount ELSE -amount END) "
+                                           "FROM transactions GROUP BY account_id")
+                                       .arg(DBManager::creditTypeCondition("type")))) {
+            continue;
+        }
+        while (q.next()) expected.insert(q.value(0).toInt(), qRound64(q.value(1).toDouble() * 100.0));
+    }
+    stats.sqlMs = timer.elapsed();
+
+    // A cent of slack for rounding the float sums
+    for (auto it = expected.constBegin(); it != expected.constEnd(); ++it) {
+        if (qAbs(balances.value(it.key()) - it.value()) > 1) ++stats.mismatches;
+    }
+    for (auto it = balances.constBegin(); it != balances.constEnd(); ++it) {
+        if (!expected.contains(it.key())) ++stats.mismatches;
+    }
+    return stats;
+}
+
+SearchBenchStats BatchRunner::benchSearch(const QStringList &words) {
+    SearchBenchStats stats;
+    stats.indexed = DBManager::searchIndexed();
+
+    QSqlQuery busiest(DBManager::shardDatabase(0));
+    if (!SlowQueryLog::exec(busiest, "SELECT account_id, COUNT(*) FROM transactions "
+                                     "GROUP BY account_id ORDER BY COUNT(*) DESC LIMIT 1")
+        || !busiest.next()) {
+        qWarning() << "bench-search: no transactions";
+        return stats;
+    }
+    const int accountId = busiest.value(0).toInt();
+    stats.historyRows = busiest.value(1).toLongLong();
+    busiest.finish();
+
+    LatencyHistogram histogram;
+    QElapsedTimer timer;
+    QSqlQuery q(DBManager::readDatabase(0));
+    q.setForwardOnly(true);
+    for (const QString &word : words) {
+        for (int length = DBManager::searchMinWordLength; length <= word.size(); ++length) {
+            timer.start();
+            if (DBManager::searchTransactions(q, accountId, word.left(length), 100, 0)) {
+                while (q.next()) {}
+            }
+            histogram.record(quint64(timer.nsecsElapsed()));
+            ++stats.queries;
+        }
+    }
+
+    stats.p50Ms = histogram.percentile(50) / 1e6;
+    stats.p99Ms = histogram.percentile(99) / 1e6;
+    stats.maxMs = histogram.maxNanos() / 1e6;
+    return stats;
+}
@@ -0,0 +1,258 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QDate>
+#include "bulkimporter.h"
+#include "dbmanager.h"
+
+class QTextStream;
+class StorageBackend;
+
+// Posting latency measured alone and while a full statement export of the
+// same account runs on another thread (see BatchRunner::benchExport)
+struct ExportBenchStats {
+    double idleP50Us = 0.0;
+    double idleP99Us = 0.0;
+    double idleMaxUs = 0.0;
+    double busyP50Us = 0.0;
+    double busyP99Us = 0.0;
+    double busyMaxUs = 0.0;
+    qint64 exportedRows = 0;
+    int exportPasses = 0;
+};
+
+// Type-ahead statement search latency (see BatchRunner::benchSearch)
+struct SearchBenchStats {
+    int queries = 0;
+    qint64 historyRows = 0;
+    bool indexed = false;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+// Posting latency alone and during an online backup (see BatchRunner::benchBackup)
+struct BackupBenchStats {
+    double idleP50Us = 0.0;
+    double idleP99Us = 0.0;
+    double busyP50Us = 0.0;
+    double busyP99Us = 0.0;
+    double busyMaxUs = 0.0;
+    qint64 postingsDuringBackup = 0;
+    qint64 backupMs = 0;
+    qint64 pages = 0;
+    int steps = 0;
+    bool ok = false;
+};
+
+// Deposits and withdrawals through the old multi-statement paths and the
+// single-transaction primitives (see BatchRunner::benchAtomic)
+struct AtomicBenchStats {
+    struct Path {
+        qint64 elapsedMs = 0;
+        qint64 failed = 0;
+        double p50Us = 0.0;
+        double p99Us = 0.0;
+    };
+    int postings = 0;
+    Path legacy;
+    Path atomic;
+};
+
+// Posting throughput through QSqlQuery and through NativeStatement
+// (see BatchRunner::benchNative)
+struct NativeBenchStats {
+    struct Path {
+        qint64 elapsedMs = 0;
+        qint64 failed = 0;
+        double p50Us = 0.0;
+        double p99Us = 0.0;
+        double allocationsPerPosting = -1.0; // -1 where allocations are not counted
+    };
+    int postings = 0;
+    Path qtSql;
+    Path native;
+};
+
+// Withdrawal throughput with the velocity checks off and on, and the cost
+// of one check on its own (see BatchRunner::benchRisk)
+struct RiskBenchStats {
+    struct Path {
+        qint64 elapsedMs = 0;
+        qint64 failed = 0;
+        double p50Us = 0.0;
+        double p99Us = 0.0;
+    };
+    int postings = 0;
+    Path off;
+    Path on;
+    quint64 checks = 0;
+    int keys = 0;
+    double nsPerCheck = 0.0;
+};
+
+// One billing-cycle close over every card, then the same close again,
+// which finds every card already closed (see BatchRunner::benchCardCycle)
+struct CardCycleBenchStats {
+    QDate statementDate;
+    int threads = 0;
+    CardCycleStats first;
+    CardCycleStats rerun;
+
+    double cardsPerSecond() const {
+        return first.elapsedMs > 0 ? first.cardsClosed * 1000.0 / first.elapsedMs : double(first.cardsClosed);
+    }
+};
+
+// Hot reads decoded through QSqlQuery::value() and through TypedQuery
+// (see BatchRunner::benchReads)
+struct ReadBenchStats {
+    struct Path {
+        double meanUs = 0.0;
+        double p99Us = 0.0;
+        double allocationsPerRead = -1.0; // -1 where allocations are not counted
+    };
+    int reads = 0;
+    int balanceRows = 0;
+    int pageRows = 0;
+    Path balancesVariant;
+    Path balancesTyped;
+    Path pageVariant;
+    Path pageTyped;
+};
+
+// Generated users, accounts and opening balances loaded through
+// BulkImporter (see BatchRunner::benchImport)
+struct ImportBenchStats {
+    ImportStats users;
+    ImportStats accounts;
+    ImportStats balances;
+    qint64 csvBytes = 0;
+    qint64 peakRssKb = -1; // high-water mark of the whole process
+};
+
+// Balance rebuild from a binary transaction log (see BatchRunner::replayTxLog)
+struct TxReplayStats {
+    qint64 records = 0;
+    qint64 bytes = 0;
+    int accounts = 0;
+    qint64 replayNs = 0;
+    // Same per-account totals computed by SQLite; only when verifying
+    qint64 sqlMs = -1;
+    int mismatches = 0;
+
+    double gigabytesPerSecond() const { return replayNs > 0 ? double(bytes) / replayNs : 0.0; }
+};
+
+struct BatchStats {
+    qint64 operations = 0;
+    qint64 succeeded = 0;
+    qint64 failed = 0;
+    qint64 elapsedMs = 0;
+
+    double opsPerSecond() const {
+        return elapsedMs > 0 ? operations * 1000.0 / elapsedMs : double(operations);
+    }
+};
+
+// Executes a stream of banking commands through a StorageBackend without
+// any GUI.
+// One command per line, whitespace separated, '#' starts a comment:
+//
+//   createuser <email> <password> <username> [yyyy-MM-dd]
+//   createaccount <userId> <Chequing|Savings> <balance> [rate]
+//   deposit <accountId> <amount>
+//   withdraw <accountId> <amount>
+//   transfer <fromAccountId> <toAccountId> <amount>
+//   interac <fromAccountId> <email> <amount>
+//   paybill <userId> <fromAccountId> <payeeId> <amount>
+//   cardspend <cardId> <amount>
+//   cardpay <userId> <fromAccountId> <cardId> <amount>
+//   interest <userId|all>
+//   cardcycle [yyyy-MM-dd]
+//   scheduled [yyyy-MM-dd]
+//
+// Consecutive postings are committed together, batchSize per transaction.
+// End-of-day jobs (interest all, cardcycle, scheduled) flush the open batch
+// first because they manage their own transactions.
+class BatchRunner {
+public:
+    explicit BatchRunner(StorageBackend &backend, int batchSize = 500);
+
+    // Writes one "<line>\t<command>\tOK|FAIL\t<detail>" row per command to
+    // results (may be null).
+    BatchStats run(QTextStream &in, QTextStream *results);
+
+    // Posting throughput: each thread alternates deposits and transfers
+    // between accounts of shard (thread % shardCount). crossShardPercent of
+    // the transfers go to the next shard instead.
+    static BatchStats benchPostings(StorageBackend &backend, int threads, int postingsPerThread,
+                                    int crossShardPercent);
+
+    // Tops the first account up to historyRows transactions, then times
+    // 'postings' deposits into it, first alone and then while another
+    // thread repeatedly exports its full history from a read snapshot.
+    static ExportBenchStats benchExport(int postings, int historyRows);
+
+    // Times 'postings' deposits into the first account alone, then keeps
+    // depositing while an OnlineBackup copies the database to destPath.
+    static BackupBenchStats benchBackup(const QString &destPath, int postings,
+                                        int pagesPerStep, int pauseMs);
+
+    // Alternates $1 deposits and withdrawals on the first account, first
+    // as separate autocommitted statements with a balance read (the old
+    // paths), then through DBManager's one-transaction postings.
+    static AtomicBenchStats benchAtomic(int postings);
+
+    // Alternates $1 deposits and withdrawals on the first account, first
+    // with postings bound and stepped through QSqlQuery, then through
+    // NativeStatement. Restores the previous setting.
+    static NativeBenchStats benchNative(int postings);
+
+    // Times 'postings' $1 withdrawals from the first account with the risk
+    // engine off, then with rules shaped like the defaults but too loose to
+    // trip, then times checks alone across 10000 keys. Restores the rules.
+    static RiskBenchStats benchRisk(int postings);
+
+    // Closes the billing cycle of every card on statementDate with
+    // threadCount workers (0 = one per core), then closes it again. An
+    // invalid date picks the day after the latest closed statement, or
+    // today, so repeated runs on one database each close every card.
+    static CardCycleBenchStats benchCardCycle(const QDate &statementDate, int threadCount);
+
+    // Reads the balances of the client owning shard 0's busiest account,
+    // and that account's newest 50-row statement page, 'reads' times each:
+    // first decoded cell by cell through QVariant into QString fields (the
+    // old paths), then through DBManager's typed reads
+    static ReadBenchStats benchReads(int reads);
+
+    // Writes CSV files of 'rows' users, one account each and their opening
+    // balances into workDir (every 1000th user row is invalid, to exercise
+    // the reject file), then imports them in that order.
+    static ImportBenchStats benchImport(int rows, const QString &workDir, int rowsPerTransaction);
+
+    // Replays typing each of 'words' one keystroke at a time against the
+    // account with the most history, timing the first result page of every
+    // keystroke.
+    static SearchBenchStats benchSearch(const QStringList &words);
+
+    // Archives every shard's transactions table into a binary log at path
+    // (replacing it). Returns the records written, or -1.
+    static qint64 exportTxLog(const QString &path);
+    // Rebuilds each account's net balance movement from the log. With
+    // verify, also totals the transactions tables and counts accounts whose
+    // totals differ.
+    static TxReplayStats replayTxLog(const QString &path, bool verify);
+
+private:
+    bool execute(const QStringList &args, QString *detail);
+    void flushBatch();
+
+    StorageBackend &m_backend;
+    int m_batchSize;
+    int m_pending;
+};
+
+#endif // BATCHRUNNER_H
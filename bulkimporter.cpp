@@ -0,0 +1,751 @@
+#include "bulkimporter.h"
+#include "dbmanager.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "sessioncache.h"
+#include <QSqlError>
+#include <QDate>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Mapped at a time; a record must fit in one window
+constexpr qint64 kWindowBytes = 64 * 1024 * 1024;
+// Placeholders per statement stay under SQLite's oldest limit (999)
+constexpr int kMaxVariables = 999;
+
+// Splits CSV records out of a mapped byte range. Fields are views into the
+// range; only a quoted field with doubled quotes is copied, to undo them.
+class CsvTokenizer {
+public:
+    enum Result { Record, Malformed, NeedMore, End };
+    using Fields = QVarLengthArray<QByteArrayView, 8>;
+
+    // Parses the record at pos and moves pos past it. NeedMore leaves pos
+    // alone: the record runs past end and end is not the end of the file.
+    Result next(const char *&pos, const char *end, bool atEof) {
+        m_fields.clear();
+        m_unescaped.clear();
+        const char *p = pos;
+        if (p == end) return atEof ? End : NeedMore;
+
+        for (;;) {
+            if (p < end && *p == '"') {
+                const char *start = ++p;
+                const char *fieldEnd = nullptr;
+                bool doubled = false;
+                while (!fieldEnd) {
+                    const char *quote = static_cast<const char *>(std::memchr(p, '"', size_t(end - p)));
+                    if (!quote) return atEof ? malformed(pos, end, end, atEof) : NeedMore;
+                    if (quote + 1 == end && !atEof) return NeedMore;
+                    if (quote + 1 < end && quote[1] == '"') {
+                        doubled = true;
+                        p = quote + 2;
+                    } else {
+                        fieldEnd = quote;
+                        p = quote + 1;
+                    }
+                }
+                if (doubled) {
+                    m_unescaped.append(QByteArray(start, fieldEnd - start).replace("\"\"", "\""));
+                    m_fields.append(QByteArrayView(m_unescaped.last()));
+                } else {
+                    m_fields.append(QByteArrayView(start, fieldEnd - start));
+                }
+                if (p < end && *p != ',' && *p != '\n' && *p != '\r') return malformed(pos, p, end, atEof);
+            } else {
+                const char *start = p;
+                while (p < end && *p != ',' && *p != '\n' && *p != '\r') ++p;
+                if (p == end && !atEof) return NeedMore;
+                m_fields.append(QByteArrayView(start, p - start));
+            }
+
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            m_raw = QByteArrayView(pos, p - pos);
+            if (p < end && *p == '\r') {
+                ++p;
+                if (p == end && !atEof) return NeedMore;
+            }
+            if (p < end && *p == '\n') ++p;
+            pos = p;
+            return Record;
+        }
+    }
+
+    const Fields &fields() const { return m_fields; }
+    QByteArrayView raw() const { return m_raw; }
+
+private:
+    // Skips the rest of the line the error is on
+    Result malformed(const char *&pos, const char *at, const char *end, bool atEof) {
+        const char *newline = static_cast<const char *>(std::memchr(at, '\n', size_t(end - at)));
+        if (!newline && !atEof) return NeedMore;
+        const char *lineEnd = newline ? newline : end;
+        m_raw = QByteArrayView(pos, lineEnd - pos);
+        pos = newline ? newline + 1 : end;
+        return Malformed;
+    }
+
+    Fields m_fields;
+    QList<QByteArray> m_unescaped;
+    QByteArrayView m_raw;
+};
+
+QString text(QByteArrayView field) {
+    return QString::fromUtf8(field).trimmed();
+}
+
+bool plausibleEmail(const QString &email) {
+    const int at = email.indexOf('@');
+    return at > 0 && at < email.size() - 1 && !email.contains(' ') && email.size() <= 254;
+}
+
+bool plausibleAccountNumber(const QString &number) {
+    if (number.size() > 32) return false;
+    for (QChar c : number) {
+        if (!c.isDigit()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+BulkImporter::BulkImporter(int rowsPerTransaction, int rowsPerStatement)
+    : m_rowsPerTransaction(qMax(1, rowsPerTransaction)),
+      m_rowsPerStatement(qBound(1, rowsPerStatement, kMaxVariables / 5)) {}
+
+bool BulkImporter::parseKind(const QString &name, Kind *kind) {
+    static const QHash<QString, Kind> kinds{{"users", Kind::Users},
+                                            {"accounts", Kind::Accounts},
+                                            {"balances", Kind::Balances},
+                                            {"interac", Kind::Interac},
+                                            {"payees", Kind::Payees}};
+    const auto it = kinds.constFind(name.toLower());
+    if (it == kinds.constEnd()) return false;
+    *kind = it.value();
+    return true;
+}
+
+ImportStats BulkImporter::run(Kind kind, const QString &csvPath, const QString &rejectPath) {
+    OpTimer timer("BulkImporter::run");
+    QElapsedTimer clock;
+    clock.start();
+    m_kind = kind;
+    m_stats = ImportStats();
+    m_pending.clear();
+    m_pending.reserve(m_rowsPerStatement);
+    m_sinceCommit = 0;
+    m_uncommitted = 0;
+
+    QFile file(csvPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << csvPath << ":" << file.errorString();
+        timer.finish(false);
+        return m_stats;
+    }
+    m_rejects.setFileName(rejectPath.isEmpty() ? csvPath + ".rejects" : rejectPath);
+    if (!m_rejects.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write" << m_rejects.fileName() << ":" << m_rejects.errorString();
+        timer.finish(false);
+        return m_stats;
+    }
+    if (!beginAll()) {
+        m_rejects.close();
+        timer.finish(false);
+        return m_stats;
+    }
+
+    // One window mapped at a time; a record cut by the window's end is
+    // parsed again at the start of the next one
+    CsvTokenizer tokenizer;
+    const qint64 size = file.size();
+    qint64 offset = 0;
+    qint64 record = 0;
+    bool ok = true;
+    while (offset < size) {
+        const qint64 length = qMin(kWindowBytes, size - offset);
+        const bool atEof = offset + length == size;
+        uchar *map = file.map(offset, length);
+        if (!map) {
+            qWarning() << "Cannot map" << csvPath << ":" << file.errorString();
+            ok = false;
+            break;
+        }
+        const char *begin = reinterpret_cast<const char *>(map);
+        const char *pos = begin;
+        for (;;) {
+            const CsvTokenizer::Result result = tokenizer.next(pos, begin + length, atEof);
+            if (result == CsvTokenizer::NeedMore || result == CsvTokenizer::End) break;
+            ++record;
+            const Fields &fields = tokenizer.fields();
+            if (result == CsvTokenizer::Record && fields.size() == 1 && text(fields[0]).isEmpty()) continue;
+            if (record == 1 && result == CsvTokenizer::Record && isHeader(fields)) continue;
+
+            ++m_stats.records;
+            Row row;
+            row.record = record;
+            QString reason = "malformed CSV";
+            if (result == CsvTokenizer::Malformed || !validate(fields, row, &reason)) {
+                reject(record, reason, tokenizer.raw());
+                continue;
+            }
+            row.raw = tokenizer.raw().toByteArray();
+            m_pending.append(std::move(row));
+            if (m_pending.size() >= m_rowsPerStatement && !flush()) {
+                ok = false;
+                break;
+            }
+        }
+        file.unmap(map);
+        if (!ok) break;
+
+        if (pos == begin && !atEof) {
+            qWarning() << "Record" << record + 1 << "is longer than" << kWindowBytes << "bytes";
+            ok = false;
+            break;
+        }
+        offset += pos - begin;
+        if (atEof) break;
+    }
+
+    if (ok) ok = flush();
+    // A failed commit or begin has already ended the transaction
+    if (m_open) ok = commitAll() && ok;
+    m_rejects.close();
+    m_statements.clear();
+
+    m_stats.bytes = offset;
+    m_stats.ok = ok;
+    m_stats.elapsedMs = clock.elapsed();
+    timer.finish(ok);
+    return m_stats;
+}
+
+bool BulkImporter::isHeader(const Fields &fields) const {
+    static const QHash<int, QString> firstColumn{{int(Kind::Users), "email"},
+                                                 {int(Kind::Accounts), "user_email"},
+                                                 {int(Kind::Balances), "account_number"},
+                                                 {int(Kind::Interac), "email"},
+                                                 {int(Kind::Payees), "name"}};
+    return text(fields[0]).toLower() == firstColumn.value(int(m_kind));
+}
+
+bool BulkImporter::validate(const Fields &fields, Row &row, QString *reason) const {
+    auto columns = [&](int least, int most) {
+        if (fields.size() >= least && fields.size() <= most) return true;
+        *reason = least == most ? QString("expected %1 columns").arg(least)
+                                : QString("expected %1 to %2 columns").arg(least).arg(most);
+        return false;
+    };
+
+    switch (m_kind) {
+    case Kind::Users: {
+        if (!columns(3, 4)) return false;
+        const QString email = text(fields[0]);
+        const QString password = QString::fromUtf8(fields[1]);
+        const QString username = text(fields[2]);
+        const QString dobText = fields.size() > 3 ? text(fields[3]) : QString();
+        const QDate dob = QDate::fromString(dobText, "yyyy-MM-dd");
+        if (!plausibleEmail(email)) *reason = "invalid email";
+        else if (password.isEmpty()) *reason = "empty password";
+        else if (username.isEmpty()) *reason = "empty username";
+        else if (!dobText.isEmpty() && !dob.isValid()) *reason = "invalid date of birth";
+        else {
+            row.values = {email, password, username, dob.isValid() ? dob.toString("yyyy-MM-dd") : QString()};
+            return true;
+        }
+        return false;
+    }
+    case Kind::Accounts: {
+        if (!columns(3, 4)) return false;
+        const QString email = text(fields[0]);
+        const QString number = text(fields[1]);
+        const QString type = text(fields[2]).toLower();
+        bool rateOk = true;
+        const QString rateText = fields.size() > 3 ? text(fields[3]) : QString();
+        double rate = rateText.isEmpty() ? (type == "savings" ? 0.012 : 0.0) : rateText.toDouble(&rateOk);
+        if (!plausibleEmail(email)) *reason = "invalid user email";
+        else if (!plausibleAccountNumber(number)) *reason = "invalid account number";
+        else if (type != "chequing" && type != "savings") *reason = "type must be Chequing or Savings";
+        else if (!rateOk || rate < 0.0 || rate > 1.0) *reason = "invalid interest rate";
+        else {
+            row.values = {email, number, QString(type == "savings" ? "Savings" : "Chequing"), rate};
+            return true;
+        }
+        return false;
+    }
+    case Kind::Balances: {
+        if (!columns(2, 2)) return false;
+        const QString number = text(fields[0]);
+        bool amountOk = false;
+        const double amount = text(fields[1]).toDouble(&amountOk);
+        if (number.isEmpty() || !plausibleAccountNumber(number)) *reason = "invalid account number";
+        else if (!amountOk || !std::isfinite(amount) || amount <= 0.0) *reason = "amount must be positive";
+        else {
+            row.values = {number, std::round(amount * 100.0) / 100.0};
+            return true;
+        }
+        return false;
+    }
+    case Kind::Interac: {
+        if (!columns(2, 2)) return false;
+        const QString email = text(fields[0]).toLower();
+        const QString number = text(fields[1]);
+        if (!plausibleEmail(email)) *reason = "invalid email";
+        else if (number.isEmpty() || !plausibleAccountNumber(number)) *reason = "invalid account number";
+        else {
+            row.values = {email, number};
+            return true;
+        }
+        return false;
+    }
+    case Kind::Payees: {
+        if (!columns(1, 2)) return false;
+        const QString name = text(fields[0]);
+        if (name.isEmpty()) {
+            *reason = "empty payee name";
+            return false;
+        }
+        row.values = {name, fields.size() > 1 ? text(fields[1]) : QString()};
+        return true;
+    }
+    }
+    return false;
+}
+
+bool BulkImporter::flush() {
+    if (m_pending.isEmpty()) return true;
+    const int rows = m_pending.size();
+    switch (m_kind) {
+    case Kind::Users: flushUsers(); break;
+    case Kind::Accounts: flushAccounts(); break;
+    case Kind::Balances: flushBalances(); break;
+    case Kind::Interac: flushInterac(); break;
+    case Kind::Payees: flushPayees(); break;
+    }
+
+    m_sinceCommit += rows;
+    if (m_sinceCommit < m_rowsPerTransaction) return true;
+    m_sinceCommit = 0;
+    return commitAll() && beginAll();
+}
+
+void BulkImporter::flushUsers() {
+    const int n = m_pending.size();
+    QSqlQuery q = statement(DBManager::directoryDatabase(),
+                            "INSERT OR IGNORE INTO users (email, password, username, dob) VALUES "
+                            + tuples(n, "(?,?,?,?)") + " RETURNING id, email",
+                            n == m_rowsPerStatement);
+    QHash<QString, int> rowByEmail;
+    for (int i = 0; i < n; ++i) {
+        for (int c = 0; c < 4; ++c) q.bindValue(i * 4 + c, m_pending[i].values[c]);
+        if (!rowByEmail.contains(m_pending[i].values[0].toString())) {
+            rowByEmail.insert(m_pending[i].values[0].toString(), i);
+        }
+    }
+    if (!SlowQueryLog::exec(q)) {
+        settle("database error: " + q.lastError().text());
+        return;
+    }
+    // Emails that were already taken insert nothing and return nothing
+    QVector<QVector<QPair<int, int>>> byShard(qMax(1, DBManager::shardCount()));
+    while (q.next()) {
+        const int i = rowByEmail.value(q.value(1).toString(), -1);
+        if (i < 0) continue;
+        const int userId = q.value(0).toInt();
+        m_pending[i].done = true;
+        byShard[DBManager::shardForUser(userId)].append({userId, i});
+    }
+    q.finish();
+
+    // Copy of each user on its home shard, as createUser makes
+    for (int shard = 0; DBManager::shardCount() > 1 && shard < byShard.size(); ++shard) {
+        const auto &placed = byShard[shard];
+        if (placed.isEmpty()) continue;
+        QSqlQuery home = statement(DBManager::shardDatabase(shard),
+                                   "INSERT INTO users (id, email, password, username, dob) VALUES "
+                                   + tuples(placed.size(), "(?,?,'',?,?)")
+                                   + " ON CONFLICT(id) DO UPDATE SET email = excluded.email, "
+                                     "username = excluded.username, dob = excluded.dob",
+                                   placed.size() == m_rowsPerStatement);
+        for (int k = 0; k < placed.size(); ++k) {
+            const Row &row = m_pending[placed[k].second];
+            home.bindValue(k * 4, placed[k].first);
+            home.bindValue(k * 4 + 1, row.values[0]);
+            home.bindValue(k * 4 + 2, row.values[2]);
+            home.bindValue(k * 4 + 3, row.values[3]);
+        }
+        if (!SlowQueryLog::exec(home)) {
+            // As in createUser: a login without its shard row is undone
+            qWarning() << "Failed to place imported users on shard" << shard << ":" << home.lastError().text();
+            QSqlQuery undo = statement(DBManager::directoryDatabase(),
+                                       "DELETE FROM users WHERE id IN (" + tuples(placed.size(), "?") + ")",
+                                       placed.size() == m_rowsPerStatement);
+            for (int k = 0; k < placed.size(); ++k) undo.bindValue(k, placed[k].first);
+            if (!SlowQueryLog::exec(undo)) qWarning() << "Failed to undo imported users:" << undo.lastError().text();
+            for (const auto &user : placed) {
+                Row &row = m_pending[user.second];
+                row.done = false;
+                row.reason = "database error: " + home.lastError().text();
+            }
+        }
+    }
+    settle("email already registered");
+}
+
+void BulkImporter::flushAccounts() {
+    const int n = m_pending.size();
+    QSqlQuery find = statement(DBManager::directoryDatabase(),
+                               "SELECT id, email FROM users WHERE email IN (" + tuples(n, "?") + ")",
+                               n == m_rowsPerStatement);
+    for (int i = 0; i < n; ++i) find.bindValue(i, m_pending[i].values[0]);
+    if (!SlowQueryLog::exec(find)) {
+        settle("database error: " + find.lastError().text());
+        return;
+    }
+    QHash<QString, int> userByEmail;
+    while (find.next()) userByEmail.insert(find.value(1).toString(), find.value(0).toInt());
+    find.finish();
+
+    QVector<QVector<int>> byShard(qMax(1, DBManager::shardCount()));
+    for (int i = 0; i < n; ++i) {
+        Row &row = m_pending[i];
+        const int userId = userByEmail.value(row.values[0].toString(), -1);
+        if (userId < 0) {
+            row.reason = "unknown user";
+            continue;
+        }
+        row.values[0] = userId;
+        if (row.values[1].toString().isEmpty()) row.values[1] = DBManager::generateAccountNumber();
+        byShard[DBManager::shardForUser(userId)].append(i);
+    }
+
+    const QString today = QDate::currentDate().toString("yyyy-MM-dd");
+    for (int shard = 0; shard < byShard.size(); ++shard) {
+        const QVector<int> &rows = byShard[shard];
+        if (rows.isEmpty()) continue;
+        QSqlQuery q = statement(DBManager::shardDatabase(shard),
+                                "INSERT OR IGNORE INTO accounts "
+                                "(user_id, account_number, type, interest_rate, last_interest_applied) VALUES "
+                                + tuples(rows.size(), "(?,?,?,?,?)") + " RETURNING account_number",
+                                rows.size() == m_rowsPerStatement);
+        QHash<QString, int> rowByNumber;
+        for (int k = 0; k < rows.size(); ++k) {
+            const Row &row = m_pending[rows[k]];
+            for (int c = 0; c < 4; ++c) q.bindValue(k * 5 + c, row.values[c]);
+            q.bindValue(k * 5 + 4, today);
+            if (!rowByNumber.contains(row.values[1].toString())) rowByNumber.insert(row.values[1].toString(), rows[k]);
+        }
+        if (!SlowQueryLog::exec(q)) {
+            for (int i : rows) m_pending[i].reason = "database error: " + q.lastError().text();
+            continue;
+        }
+        while (q.next()) {
+            const int i = rowByNumber.value(q.value(0).toString(), -1);
+            if (i >= 0) m_pending[i].done = true;
+        }
+        q.finish();
+    }
+    settle("account number already exists");
+}
+
+void BulkImporter::flushBalances() {
+    // One opening balance per account: repeats within the batch are
+    // rejected so each journal row matches the amount applied
+    QHash<QString, int> rowByNumber;
+    QVector<int> remaining;
+    for (int i = 0; i < m_pending.size(); ++i) {
+        const QString number = m_pending[i].values[0].toString();
+        if (rowByNumber.contains(number)) {
+            m_pending[i].reason = "repeated account number";
+            continue;
+        }
+        rowByNumber.insert(number, i);
+        remaining.append(i);
+    }
+
+    const int shards = qMax(1, DBManager::shardCount());
+    for (int shard = 0; shard < shards && !remaining.isEmpty(); ++shard) {
+        QSqlDatabase db = DBManager::shardDatabase(shard);
+        // Credits and their journal rows stand or fall together
+        QSqlQuery savepoint(db);
+        SlowQueryLog::exec(savepoint, "SAVEPOINT opening_balances");
+        QSqlQuery q = statement(db,
+                                "UPDATE accounts SET balance = balance + v.column2 FROM (VALUES "
+                                + tuples(remaining.size(), "(?,?)") + ") AS v "
+                                "WHERE accounts.account_number = v.column1 "
+                                "AND NOT EXISTS (SELECT 1 FROM transactions t WHERE t.account_id = accounts.id) "
+                                "RETURNING accounts.id, accounts.account_number, accounts.balance",
+                                remaining.size() == m_rowsPerStatement);
+        for (int k = 0; k < remaining.size(); ++k) {
+            q.bindValue(k * 2, m_pending[remaining[k]].values[0]);
+            q.bindValue(k * 2 + 1, m_pending[remaining[k]].values[1]);
+        }
+        if (!SlowQueryLog::exec(q)) {
+            for (int i : remaining) m_pending[i].reason = "database error: " + q.lastError().text();
+            SlowQueryLog::exec(savepoint, "RELEASE opening_balances");
+            break;
+        }
+        struct Credit {
+            int accountId;
+            int row;
+            double balance;
+        };
+        QVector<Credit> credits;
+        while (q.next()) {
+            const int i = rowByNumber.value(q.value(1).toString(), -1);
+            if (i >= 0) credits.append({q.value(0).toInt(), i, q.value(2).toDouble()});
+        }
+        q.finish();
+        if (credits.isEmpty()) {
+            SlowQueryLog::exec(savepoint, "RELEASE opening_balances");
+            continue;
+        }
+
+        QSqlQuery journal = statement(db,
+                                      "INSERT INTO transactions (account_id, type, amount, description, balance_after) "
+                                      "VALUES " + tuples(credits.size(), "(?,'Deposit',?,'Opening balance',?)"),
+                                      credits.size() == m_rowsPerStatement);
+        for (int k = 0; k < credits.size(); ++k) {
+            journal.bindValue(k * 3, credits[k].accountId);
+            journal.bindValue(k * 3 + 1, m_pending[credits[k].row].values[1]);
+            journal.bindValue(k * 3 + 2, credits[k].balance);
+        }
+        if (!SlowQueryLog::exec(journal)) {
+            qWarning() << "Failed to journal opening balances:" << journal.lastError().text();
+            for (int i : remaining) m_pending[i].reason = "database error: " + journal.lastError().text();
+            SlowQueryLog::exec(savepoint, "ROLLBACK TO opening_balances");
+            SlowQueryLog::exec(savepoint, "RELEASE opening_balances");
+            break;
+        }
+        SlowQueryLog::exec(savepoint, "RELEASE opening_balances");
+        for (const Credit &credit : credits) m_pending[credit.row].done = true;
+
+        QVector<int> unmatched;
+        for (int i : remaining) {
+            if (!m_pending[i].done) unmatched.append(i);
+        }
+        remaining = unmatched;
+    }
+    settle("unknown account, or account already has transactions");
+}
+
+void BulkImporter::flushInterac() {
+    struct Registration {
+        int userId;
+        int accountId;
+        int row;
+    };
+    QVector<Registration> found;
+    QVector<int> remaining;
+    for (int i = 0; i < m_pending.size(); ++i) remaining.append(i);
+
+    const int shards = qMax(1, DBManager::shardCount());
+    for (int shard = 0; shard < shards && !remaining.isEmpty(); ++shard) {
+        QSqlQuery q = statement(DBManager::shardDatabase(shard),
+                                "SELECT id, user_id, account_number FROM accounts WHERE account_number IN ("
+                                + tuples(remaining.size(), "?") + ")",
+                                remaining.size() == m_rowsPerStatement);
+        for (int k = 0; k < remaining.size(); ++k) q.bindValue(k, m_pending[remaining[k]].values[1]);
+        if (!SlowQueryLog::exec(q)) {
+            settle("database error: " + q.lastError().text());
+            return;
+        }
+        QHash<QString, QPair<int, int>> accounts;
+        while (q.next()) {
+            accounts.insert(q.value(2).toString(), {q.value(1).toInt(), q.value(0).toInt()});
+        }
+        q.finish();
+
+        QVector<int> unmatched;
+        for (int i : remaining) {
+            const auto it = accounts.constFind(m_pending[i].values[1].toString());
+            if (it == accounts.constEnd()) unmatched.append(i);
+            else found.append({it->first, it->second, i});
+        }
+        remaining = unmatched;
+    }
+
+    if (!found.isEmpty()) {
+        // Same replace semantics as registerInteracEmail: the last row wins
+        QSqlQuery q = statement(DBManager::directoryDatabase(),
+                                "INSERT OR REPLACE INTO interac_registrations (user_id, account_id, email) VALUES "
+                                + tuples(found.size(), "(?,?,?)"),
+                                found.size() == m_rowsPerStatement);
+        for (int k = 0; k < found.size(); ++k) {
+            q.bindValue(k * 3, found[k].userId);
+            q.bindValue(k * 3 + 1, found[k].accountId);
+            q.bindValue(k * 3 + 2, m_pending[found[k].row].values[0]);
+        }
+        if (!SlowQueryLog::exec(q)) {
+            settle("database error: " + q.lastError().text());
+            return;
+        }
+        for (const Registration &registration : found) m_pending[registration.row].done = true;
+    }
+    settle("unknown account");
+}
+
+void BulkImporter::flushPayees() {
+    const int n = m_pending.size();
+    // A payee already on file (same name and category) inserts nothing
+    QSqlQuery q = statement(DBManager::directoryDatabase(),
+                            "INSERT INTO bill_payees (name, category) VALUES " + tuples(n, "(?,?)")
+                            + " ON CONFLICT DO NOTHING RETURNING id, name, COALESCE(category, '')",
+                            n == m_rowsPerStatement);
+    QHash<QString, int> rowByKey;
+    for (int i = 0; i < n; ++i) {
+        q.bindValue(i * 2, m_pending[i].values[0]);
+        q.bindValue(i * 2 + 1, m_pending[i].values[1]);
+        const QString key = m_pending[i].values[0].toString() + '\n' + m_pending[i].values[1].toString();
+        if (!rowByKey.contains(key)) rowByKey.insert(key, i);
+    }
+    if (!SlowQueryLog::exec(q)) {
+        settle("database error: " + q.lastError().text());
+        return;
+    }
+    QVector<QVariantList> inserted;
+    while (q.next()) {
+        const int i = rowByKey.value(q.value(1).toString() + '\n' + q.value(2).toString(), -1);
+        if (i < 0) continue;
+        m_pending[i].done = true;
+        inserted.append({q.value(0), q.value(1), q.value(2)});
+    }
+    q.finish();
+
+    // Payees carry the same IDs on every shard
+    for (int shard = 0; !inserted.isEmpty() && DBManager::shardCount() > 1 && shard < DBManager::shardCount(); ++shard) {
+        QSqlQuery copy = statement(DBManager::shardDatabase(shard),
+                                   "INSERT INTO bill_payees (id, name, category) VALUES "
+                                   + tuples(inserted.size(), "(?,?,?)")
+                                   + " ON CONFLICT(id) DO UPDATE SET name = excluded.name, "
+                                     "category = excluded.category",
+                                   inserted.size() == m_rowsPerStatement);
+        for (int k = 0; k < inserted.size(); ++k) {
+            for (int c = 0; c < 3; ++c) copy.bindValue(k * 3 + c, inserted[k][c]);
+        }
+        if (SlowQueryLog::exec(copy)) continue;
+
+        // Not payable from every shard: take the batch back out of the
+        // directory. Copies already on earlier shards are unreferenced.
+        qWarning() << "Failed to copy imported payees to shard" << shard << ":" << copy.lastError().text();
+        QSqlQuery undo = statement(DBManager::directoryDatabase(),
+                                   "DELETE FROM bill_payees WHERE id IN (" + tuples(inserted.size(), "?") + ")",
+                                   inserted.size() == m_rowsPerStatement);
+        for (int k = 0; k < inserted.size(); ++k) undo.bindValue(k, inserted[k][0]);
+        if (!SlowQueryLog::exec(undo)) qWarning() << "Failed to undo imported payees:" << undo.lastError().text();
+        for (Row &row : m_pending) {
+            if (!row.done) continue;
+            row.done = false;
+            row.reason = "database error: " + copy.lastError().text();
+        }
+        break;
+    }
+    settle("payee already exists");
+}
+
+void BulkImporter::settle(const QString &reason) {
+    for (const Row &row : std::as_const(m_pending)) {
+        if (row.done) {
+            ++m_stats.imported;
+            ++m_uncommitted;
+        } else {
+            reject(row.record, row.reason.isEmpty() ? reason : row.reason, row.raw);
+        }
+    }
+    m_pending.clear();
+}
+
+void BulkImporter::reject(qint64 record, const QString &reason, QByteArrayView raw) {
+    ++m_stats.rejected;
+    QByteArray line = QByteArray::number(record) + '\t' + reason.toUtf8() + '\t';
+    line.append(raw);
+    line.append('\n');
+    m_rejects.write(line);
+}
+
+QList<QSqlDatabase> BulkImporter::files() const {
+    QList<QSqlDatabase> all{DBManager::directoryDatabase()};
+    for (int shard = 0; DBManager::shardCount() > 1 && shard < DBManager::shardCount(); ++shard) {
+        all << DBManager::shardDatabase(shard);
+    }
+    return all;
+}
+
+bool BulkImporter::beginAll() {
+    const QList<QSqlDatabase> all = files();
+    for (int i = 0; i < all.size(); ++i) {
+        QSqlQuery q(all[i]);
+        if (!SlowQueryLog::exec(q, "BEGIN IMMEDIATE")) {
+            qWarning() << "Cannot start import transaction:" << q.lastError().text();
+            // The files already begun would stay locked
+            rollbackFrom(all, 0, i);
+            return false;
+        }
+    }
+    m_open = true;
+    return true;
+}
+
+bool BulkImporter::commitAll() {
+    // Shards first: a directory row is never committed before the shard
+    // rows that depend on it
+    QList<QSqlDatabase> all = files();
+    std::reverse(all.begin(), all.end());
+    m_open = false;
+    for (int i = 0; i < all.size(); ++i) {
+        QSqlQuery q(all[i]);
+        if (SlowQueryLog::exec(q, "COMMIT")) continue;
+        qWarning() << "Import commit failed:" << q.lastError().text() << "-" << m_uncommitted
+                   << "imported rows rolled back";
+        // Nothing after the failure commits, the directory included
+        rollbackFrom(all, i, all.size());
+        m_stats.imported -= m_uncommitted;
+        m_uncommitted = 0;
+        return false;
+    }
+    if (m_uncommitted > 0) {
+        if (m_kind == Kind::Payees) SessionCache::invalidatePayees();
+        if (m_kind == Kind::Accounts || m_kind == Kind::Balances) SessionCache::invalidateAllAccounts();
+    }
+    m_uncommitted = 0;
+    ++m_stats.commits;
+    return true;
+}
+
+void BulkImporter::rollbackFrom(const QList<QSqlDatabase> &all, int first, int end) {
+    for (int i = first; i < end; ++i) {
+        QSqlQuery q(all[i]);
+        SlowQueryLog::exec(q, "ROLLBACK");
+    }
+}
+
+QSqlQuery BulkImporter::statement(const QSqlDatabase &db, const QString &sql, bool reuse) {
+    const QString key = db.connectionName() + '\n' + sql;
+    if (reuse) {
+        const auto it = m_statements.constFind(key);
+        if (it != m_statements.constEnd()) return it.value();
+    }
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.prepare(sql)) qWarning() << "Import statement failed to prepare:" << q.lastError().text();
+    if (reuse) m_statements.insert(key, q);
+    return q;
+}
+
+QString BulkImporter::tuples(int rows, const QString &tuple) {
+    QString sql;
+    sql.reserve(rows * (tuple.size() + 1));
+    for (int i = 0; i < rows; ++i) {
+        if (i) sql += ',';
+        sql += tuple;
+    }
+    return sql;
+}
@@ -0,0 +1,104 @@
+#ifndef BULKIMPORTER_H
+#define BULKIMPORTER_H
+
+#include <QString>
+#include <QVector>
+#include <QVariant>
+#include <QVarLengthArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+struct ImportStats {
+    qint64 records = 0;
+    qint64 imported = 0;
+    qint64 rejected = 0;
+    qint64 bytes = 0;
+    qint64 commits = 0;
+    qint64 elapsedMs = 0;
+    bool ok = false; // false if the file could not be read
+
+    double rowsPerSecond() const {
+        return elapsedMs > 0 ? records * 1000.0 / elapsedMs : double(records);
+    }
+};
+
+// Streaming CSV loader for onboarding a migrated customer book. One kind
+// of record per file, optional header line:
+//
+//   users      email,password,username[,dob yyyy-MM-dd]
+//   accounts   user_email,account_number,Chequing|Savings[,interest_rate]
+//              (an empty account_number gets a generated one)
+//   balances   account_number,amount
+//              (journalled as an "Opening balance" deposit; accounts that
+//              already have transactions are rejected, so reruns are safe)
+//   interac    email,account_number
+//   payees     name[,category]
+//
+// The file is mapped a window at a time and split into fields without
+// copying. Valid rows are inserted rowsPerStatement at a time with
+// multi-row statements, inside transactions of rowsPerTransaction rows on
+// every file involved. Rows that fail validation, duplicate an existing
+// email, account number or payee, or refer to an unknown user or account go to
+// the reject file as "<record>\t<reason>\t<original record>". Memory use
+// depends on the window and statement sizes, not on the file size.
+// Writers wait while an import transaction is open.
+class BulkImporter {
+public:
+    enum class Kind { Users, Accounts, Balances, Interac, Payees };
+
+    explicit BulkImporter(int rowsPerTransaction = 50000, int rowsPerStatement = 150);
+
+    static bool parseKind(const QString &name, Kind *kind);
+
+    // Loads csvPath; rejectPath empty = <csvPath>.rejects
+    ImportStats run(Kind kind, const QString &csvPath, const QString &rejectPath = QString());
+
+private:
+    using Fields = QVarLengthArray<QByteArrayView, 8>;
+
+    struct Row {
+        qint64 record = 0;
+        QByteArray raw;
+        QVector<QVariant> values;
+        bool done = false;
+        QString reason; // set when the row is rejected for its own reason
+    };
+
+    bool isHeader(const Fields &fields) const;
+    bool validate(const Fields &fields, Row &row, QString *reason) const;
+    // False once the import transaction could not be committed or reopened
+    bool flush();
+    void flushUsers();
+    void flushAccounts();
+    void flushBalances();
+    void flushInterac();
+    void flushPayees();
+    // Counts the pending rows marked done and rejects the rest
+    void settle(const QString &reason);
+    void reject(qint64 record, const QString &reason, QByteArrayView raw);
+
+    // Both end the import transaction on every file when one file fails
+    bool beginAll();
+    bool commitAll();
+    static void rollbackFrom(const QList<QSqlDatabase> &all, int first, int end);
+    // Multi-row statement; full-size ones are prepared once and reused
+    QSqlQuery statement(const QSqlDatabase &db, const QString &sql, bool reuse);
+    static QString tuples(int rows, const QString &tuple);
+    QList<QSqlDatabase> files() const;
+
+    int m_rowsPerTransaction;
+    int m_rowsPerStatement;
+    Kind m_kind = Kind::Users;
+    QVector<Row> m_pending;
+    qint64 m_sinceCommit = 0;
+    qint64 m_uncommitted = 0; // rows counted as imported since the last commit
+    bool m_open = false;
+    QHash<QString, QSqlQuery> m_statements;
+    QFile m_rejects;
+    ImportStats m_stats;
+};
+
+#endif // BULKIMPORTER_H
@@ -1,228 +1,881 @@
 #include "dbmanager.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "riskengine.h"
+#include "nativestatement.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 #include <QDebug>
 #include <QDate>
 #include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <atomic>
+#include <utility>
 #include <random>
+#include <vector>
+#include <memory>
+#include <limits>
 
 QSqlDatabase DBManager::m_db;
 int DBManager::m_nextAccountSeed = 9825;
+thread_local int DBManager::m_batchDepth = 0;
+thread_local int DBManager::m_currentShard = 0;
+thread_local QList<qint64> DBManager::m_batchIntents;
+QThread *DBManager::m_ownerThread = nullptr;
+bool DBManager::m_walEnabled = false;
+bool DBManager::m_searchIndexed = false;
+bool DBManager::m_schemaMigrated = false;
+std::atomic<bool> DBManager::m_nativePostings{true};
+int DBManager::m_shardCount = 1;
+int DBManager::scheduledMaxRetries = 3;
+int DBManager::scheduledRetryDelayDays = 1;
+
+namespace {
+
+// Account and card IDs on shard k start at k * kShardIdSpan + 1
+constexpr int kShardIdSpan = 100000000;
+constexpr int kMaxShards = 16;
+// Shard key used for the directory file
+constexpr int kDirectory = -1;
+// Stored in each file's PRAGMA user_version once its tables are in place.
+// Bump whenever createTables() changes so existing files are upgraded.
+constexpr int kSchemaVersion = 7;
+
+
+int schemaVersion(const QSqlDatabase &db) {
+    QSqlQuery q(db);
+    return SlowQueryLog::exec(q, "PRAGMA user_version") && q.next() ? q.value(0).toInt() : -1;
+}
+
+// The calling thread's private connections by shard, created on first use
+QHash<int, QString> &threadConnectionNames(bool readOnly) {
+    static thread_local QHash<int, QString> readWrite;
+    static thread_local QHash<int, QString> readOnlyNames;
+    return readOnly ? readOnlyNames : readWrite;
+}
+
+QString sourceConnectionName(int shard) {
+    return shard == kDirectory ? QString("bluebank_connection")
+                               : QString("bluebank_shard_%1").arg(shard);
+}
+
+void removeConnections(QHash<int, QString> &names) {
+    for (const QString &name : std::as_const(names)) {
+        NativeStatement::releaseConnection(name);
+        {
+            QSqlDatabase db = QSqlDatabase::database(name, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(name);
+    }
+    names.clear();
+}
+
+} // namespace
+
+int DBManager::shardForUser(int userId) {
+    if (m_shardCount <= 1) return 0;
+    // Multiplicative hash: consecutive user IDs spread evenly
+    return static_cast<int>((static_cast<quint32>(userId) * 2654435761u) % quint32(m_shardCount));
+}
+
+int DBManager::shardForAccount(int accountId) {
+    if (m_shardCount <= 1) return 0;
+    return qBound(0, accountId / kShardIdSpan, m_shardCount - 1);
+}
+
+QSqlDatabase DBManager::directoryDatabase() {
+    return connection(kDirectory, false);
+}
+
+QSqlDatabase DBManager::shardDatabase(int shard) {
+    return connection(shard, false);
+}
 
 QSqlDatabase DBManager::database() {
-    return m_db;
+    return connection(m_currentShard, false);
+}
+
+QSqlDatabase DBManager::readDatabase() {
+    return connection(m_currentShard, true);
 }
 
-bool DBManager::init(const QString &dbPath) {
-    if (QSqlDatabase::contains("bluebank_connection")) {
-        m_db = QSqlDatabase::database("bluebank_connection");
+QSqlDatabase DBManager::readDatabase(int shard) {
+    return connection(shard, true);
+}
+
+QSqlDatabase DBManager::connection(int shard, bool readOnly) {
+    // With a single shard the directory and the shard are one file
+    if (m_shardCount <= 1) shard = kDirectory;
+    if (!m_walEnabled) readOnly = false;
+
+    if (!readOnly && QThread::currentThread() == m_ownerThread) {
+        return shard == kDirectory ? m_db : QSqlDatabase::database(sourceConnectionName(shard), false);
+    }
+
+    // QtSql connections may only be used by the thread that opened them,
+    // so every other thread gets its own lazily opened connections.
+    QHash<int, QString> &names = threadConnectionNames(readOnly);
+    const auto it = names.constFind(shard);
+    if (it != names.constEnd()) return QSqlDatabase::database(*it, false);
+
+    static std::atomic<int> counter{0};
+    const QString name = QString(readOnly ? "bluebank_read_%1" : "bluebank_thread_%1").arg(++counter);
+    names.insert(shard, name);
+    if (!readOnly) return openWorkerConnection(name, shard);
+
+    QSqlDatabase db = QSqlDatabase::cloneDatabase(sourceConnectionName(shard), name);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=10000");
+    if (!db.open()) {
+        qWarning() << "Failed to open read connection:" << db.lastError().text();
+    }
+    return db;
+}
+
+void DBManager::releaseThreadConnection() {
+    NativeStatement::releaseThreadCache();
+    removeConnections(threadConnectionNames(true));
+    removeConnections(threadConnectionNames(false));
+}
+
+QString DBManager::shardPath(const QString &dbPath, int shard) {
+    const QFileInfo info(dbPath);
+    const QString suffix = info.suffix().isEmpty() ? QString("db") : info.suffix();
+    return info.dir().filePath(QString("%1.shard%2.%3").arg(info.completeBaseName()).arg(shard).arg(suffix));
+}
+
+QStringList DBManager::databaseFiles() {
+    QStringList files{m_db.databaseName()};
+    for (int shard = 0; m_shardCount > 1 && shard < m_shardCount; ++shard) {
+        files << QSqlDatabase::database(sourceConnectionName(shard), false).databaseName();
+    }
+    return files;
+}
+
+bool DBManager::openFile(const QString &connectionName, const QString &path) {
+    QSqlDatabase db = QSqlDatabase::contains(connectionName)
+                          ? QSqlDatabase::database(connectionName, false)
+                          : QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    if (!db.isOpen()) {
+        db.setDatabaseName(path);
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
+        if (!db.open()) {
+            qWarning() << "Failed to open database" << path << ":" << db.lastError().text();
+            return false;
+        }
+    }
+
+    // Per connection, not stored in the file: runs on every open
+    QSqlQuery pragma(db);
+    SlowQueryLog::exec(pragma, "PRAGMA foreign_keys = ON");
+
+    // WAL lets readers keep a snapshot while the writer commits
+    QSqlQuery wal(db);
+    const bool walOk = SlowQueryLog::exec(wal, "PRAGMA journal_mode = WAL")
+                       && wal.next() && wal.value(0).toString().compare("wal", Qt::CaseInsensitive) == 0;
+    if (!walOk) {
+        qWarning() << "WAL unavailable for" << path << "- reporting reads share the write connection";
+        m_walEnabled = false;
+    }
+    return true;
+}
+
+bool DBManager::init(const QString &dbPath, int shardCount) {
+    m_ownerThread = QThread::currentThread();
+    m_walEnabled = true;
+    if (!openFile("bluebank_connection", dbPath)) return false;
+    m_db = QSqlDatabase::database("bluebank_connection", false);
+    m_schemaMigrated = false;
+
+    // The directory records the layout so every tool opens it the same way
+    QSqlQuery meta(m_db);
+    if (schemaVersion(m_db) != kSchemaVersion) {
+        SlowQueryLog::exec(meta, "CREATE TABLE IF NOT EXISTS bank_meta ("
+                                 "key TEXT PRIMARY KEY,"
+                                 "value TEXT)");
+    }
+    int stored = 0;
+    if (SlowQueryLog::exec(meta, "SELECT value FROM bank_meta WHERE key = 'shard_count'") && meta.next()) {
+        stored = meta.value(0).toInt();
+    }
+    meta.finish();
+    if (stored <= 0) {
+        stored = qBound(1, shardCount > 0 ? shardCount : 1, kMaxShards);
+        // Data from before sharding already lives in this file
+        if (stored > 1 && SlowQueryLog::exec(meta, "SELECT 1 FROM sqlite_master WHERE name = 'accounts'")
+            && meta.next()) {
+            qWarning() << "Existing single-file database; ignoring shard count" << shardCount;
+            stored = 1;
+        }
+        meta.finish();
+        meta.prepare("INSERT INTO bank_meta (key, value) VALUES ('shard_count', :n)");
+        meta.bindValue(":n", stored);
+        SlowQueryLog::exec(meta);
+    } else if (shardCount > 0 && shardCount != stored) {
+        qWarning() << "Database was created with" << stored << "shards; ignoring" << shardCount;
+    }
+    m_shardCount = stored;
+
+    if (m_shardCount == 1) {
+        ShardScope scope(kDirectory);
+        createTablesIfNeeded(true, true);
     } else {
-        m_db = QSqlDatabase::addDatabase("QSQLITE", "bluebank_connection");
-        m_db.setDatabaseName(dbPath);
+        {
+            ShardScope scope(kDirectory);
+            createTablesIfNeeded(true, false);
+        }
+        for (int shard = 0; shard < m_shardCount; ++shard) {
+            if (!openFile(sourceConnectionName(shard), shardPath(dbPath, shard))) return false;
+            ShardScope scope(shard);
+            if (!createTablesIfNeeded(false, true)) continue;
+
+            // Start this shard's account and card IDs in its own range
+            QSqlQuery seq(database());
+            seq.prepare("INSERT INTO sqlite_sequence (name, seq) SELECT ?, ? "
+                        "WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = ?)");
+            for (const QString &table : {QString("accounts"), QString("credit_cards")}) {
+                seq.addBindValue(table);
+                seq.addBindValue(qint64(shard) * kShardIdSpan);
+                seq.addBindValue(table);
+                SlowQueryLog::exec(seq);
+            }
+        }
     }
 
-    if (!m_db.open()) {
-        qWarning() << "Failed to open database:" << m_db.lastError().text();
+    if (m_schemaMigrated) seedReferenceData();
+    recoverShardTransfers();
+    return true;
+}
+
+bool DBManager::beginBatch() {
+    if (m_batchDepth++ > 0) return true;
+    // Every shard joins the batch, locked in shard order
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        QSqlQuery q(shardDatabase(shard));
+        if (!SlowQueryLog::exec(q, "BEGIN IMMEDIATE")) {
+            for (int open = 0; open < shard; ++open) {
+                QSqlQuery undo(shardDatabase(open));
+                SlowQueryLog::exec(undo, "ROLLBACK");
+            }
+            m_batchDepth = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DBManager::commitBatch() {
+    if (m_batchDepth == 0) return false;
+    if (--m_batchDepth > 0) return true;
+
+    // Cross-shard transfers in the batch are decided before any shard commits
+    if (!m_batchIntents.isEmpty() && !setTransferStatus(m_batchIntents, "pending", "committing")) {
+        qWarning() << "Cross-shard transfers in the batch were aborted; rolling it back";
+        m_batchDepth = 1;
+        rollbackBatch();
         return false;
     }
 
-    createTablesIfNeeded();
-    createSampleDataIfEmpty();
-    return true;
+    bool ok = true;
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        QSqlQuery q(shardDatabase(shard));
+        if (SlowQueryLog::exec(q, "COMMIT")) continue;
+        // A failed COMMIT leaves the transaction open
+        SlowQueryLog::exec(q, "ROLLBACK");
+        ok = false;
+    }
+    // On failure the decided transfers stay 'committing' for recovery
+    if (ok && !m_batchIntents.isEmpty()) setTransferStatus(m_batchIntents, "committing", "done");
+    m_batchIntents.clear();
+    return ok;
+}
+
+void DBManager::rollbackBatch() {
+    if (m_batchDepth == 0) return;
+    m_batchDepth = 0;
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        QSqlQuery q(shardDatabase(shard));
+        SlowQueryLog::exec(q, "ROLLBACK");
+    }
+    if (!m_batchIntents.isEmpty()) setTransferStatus(m_batchIntents, "pending", "aborted");
+    m_batchIntents.clear();
 }
 
-void DBManager::createTablesIfNeeded() {
+bool DBManager::beginTransaction(QSqlDatabase db) {
+    // Inside a batch, a posting becomes a savepoint so it can fail on its
+    // own without ending the batch transaction.
+    // IMMEDIATE takes the write lock up front. With several connections a
+    // deferred read-then-write transaction can fail with SQLITE_BUSY
+    // without ever waiting on the busy timeout.
+    const char *sql = m_batchDepth > 0 ? "SAVEPOINT posting" : "BEGIN IMMEDIATE";
+    if (nativePostings()) return NativeStatement(db, sql).exec();
+    QSqlQuery q(db);
+    return SlowQueryLog::exec(q, sql);
+}
+
+bool DBManager::commitTransaction(QSqlDatabase db) {
+    const char *sql = m_batchDepth > 0 ? "RELEASE posting" : "COMMIT";
+    if (nativePostings()) return NativeStatement(db, sql).exec();
+    QSqlQuery q(db);
+    return SlowQueryLog::exec(q, sql);
+}
+
+void DBManager::rollbackTransaction(QSqlDatabase db) {
+    const bool savepoint = m_batchDepth > 0;
+    if (nativePostings()) {
+        if (savepoint) {
+            NativeStatement(db, "ROLLBACK TO posting").exec();
+            NativeStatement(db, "RELEASE posting").exec();
+        } else {
+            NativeStatement(db, "ROLLBACK").exec();
+        }
+        return;
+    }
+    QSqlQuery q(db);
+    if (savepoint) {
+        SlowQueryLog::exec(q, "ROLLBACK TO posting");
+        SlowQueryLog::exec(q, "RELEASE posting");
+        return;
+    }
+    SlowQueryLog::exec(q, "ROLLBACK");
+}
+
+ReadSnapshot::ReadSnapshot()
+    : m_db(DBManager::readDatabase()) {
+    QSqlQuery q(m_db);
+    // Deferred BEGIN: the snapshot is taken by the first read
+    m_open = SlowQueryLog::exec(q, "BEGIN");
+}
+
+ReadSnapshot::ReadSnapshot(int shard)
+    : m_db(DBManager::readDatabase(shard)) {
+    QSqlQuery q(m_db);
+    m_open = SlowQueryLog::exec(q, "BEGIN");
+}
+
+ReadSnapshot::~ReadSnapshot() {
+    if (!m_open) return;
     QSqlQuery q(m_db);
+    SlowQueryLog::exec(q, "COMMIT");
+}
+
+bool DBManager::createTablesIfNeeded(bool directory, bool shard) {
+    // Fast path: one pragma read instead of the full DDL on every launch
+    QSqlQuery q(database());
+    if (schemaVersion(database()) == kSchemaVersion) {
+        if (shard) {
+            m_searchIndexed = SlowQueryLog::exec(q, "SELECT 1 FROM sqlite_master "
+                                                    "WHERE name = 'transactions_fts'") && q.next();
+        }
+        return false;
+    }
 
-    q.exec("PRAGMA foreign_keys = ON");
+    createTables(directory, shard);
+    SlowQueryLog::exec(q, QString("PRAGMA user_version = %1").arg(kSchemaVersion));
+    m_schemaMigrated = true;
+    return true;
+}
 
-    // users
-    q.exec("CREATE TABLE IF NOT EXISTS users ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "email TEXT UNIQUE NOT NULL,"
-           "password TEXT NOT NULL,"
-           "username TEXT NOT NULL,"
-           "dob TEXT,"
-           "profile_pic TEXT,"
-           "created_at TEXT DEFAULT CURRENT_TIMESTAMP"
-           ")");
+void DBManager::createTables(bool directory, bool shard) {
+    QSqlQuery q(database());
+
+    // users (on a shard: a copy of the owner's row without the password,
+    // so per-shard foreign keys hold)
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS users ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "email TEXT UNIQUE NOT NULL,"
+                          "password TEXT NOT NULL,"
+                          "username TEXT NOT NULL,"
+                          "dob TEXT,"
+                          "profile_pic TEXT,"
+                          "created_at TEXT DEFAULT CURRENT_TIMESTAMP"
+                          ")");
+
+    // bill payees (reference data, copied to every shard)
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS bill_payees ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "name TEXT NOT NULL,"
+                          "category TEXT"
+                          ")");
+
+    if (directory) {
+        // One row per payee and category, so a repeated import adds nothing
+        if (!SlowQueryLog::exec(q, "CREATE UNIQUE INDEX IF NOT EXISTS idx_bill_payees_name "
+                                   "ON bill_payees(name, COALESCE(category, ''))")) {
+            qWarning() << "Duplicate bill payees; imports cannot detect repeats:" << q.lastError().text();
+        }
+
+        // interac registrations; account_id can only be checked when the
+        // accounts live in the same file
+        SlowQueryLog::exec(q, QString("CREATE TABLE IF NOT EXISTS interac_registrations ("
+                                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                                      "user_id INTEGER NOT NULL,"
+                                      "account_id INTEGER NOT NULL,"
+                                      "email TEXT UNIQUE NOT NULL,"
+                                      "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE%1"
+                                      ")")
+                                  .arg(shard ? ",FOREIGN KEY(account_id) REFERENCES accounts(id) ON DELETE CASCADE"
+                                             : ""));
+
+        // FAQs
+        SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS faqs ("
+                              "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                              "question TEXT NOT NULL,"
+                              "answer TEXT NOT NULL"
+                              ")");
+
+        // cross-shard transfer intents: pending -> committing -> done, or aborted
+        SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS shard_transfers ("
+                              "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                              "from_account_id INTEGER NOT NULL,"
+                              "to_account_id INTEGER NOT NULL,"
+                              "amount REAL NOT NULL,"
+                              "status TEXT NOT NULL DEFAULT 'pending',"
+                              "created_at TEXT DEFAULT CURRENT_TIMESTAMP,"
+                              "interac_email TEXT"
+                              ")");
+        ensureColumn("shard_transfers", "interac_email", "TEXT");
+        SlowQueryLog::exec(q, "CREATE INDEX IF NOT EXISTS idx_shard_transfers_status "
+                              "ON shard_transfers(status)");
+    }
+
+    if (!shard) return;
 
     // accounts
-    q.exec("CREATE TABLE IF NOT EXISTS accounts ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "user_id INTEGER NOT NULL,"
-           "account_number TEXT UNIQUE NOT NULL,"
-           "type TEXT NOT NULL,"
-           "balance REAL NOT NULL DEFAULT 0,"
-           "interest_rate REAL NOT NULL DEFAULT 0,"
-           "last_interest_applied TEXT,"
-           "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE"
-           ")");
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS accounts ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "user_id INTEGER NOT NULL,"
+                          "account_number TEXT UNIQUE NOT NULL,"
+                          "type TEXT NOT NULL,"
+                          "balance REAL NOT NULL DEFAULT 0,"
+                          "interest_rate REAL NOT NULL DEFAULT 0,"
+                          "last_interest_applied TEXT,"
+                          "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE"
+                          ")");
 
     // credit cards
-    q.exec("CREATE TABLE IF NOT EXISTS credit_cards ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "user_id INTEGER NOT NULL,"
-           "card_number TEXT UNIQUE NOT NULL,"
-           "cvv TEXT NOT NULL,"
-           "expiry_month INTEGER NOT NULL,"
-           "expiry_year INTEGER NOT NULL,"
-           "credit_limit REAL NOT NULL,"
-           "current_balance REAL NOT NULL DEFAULT 0,"
-           "min_payment REAL NOT NULL DEFAULT 0,"
-           "status TEXT NOT NULL DEFAULT 'Active',"
-           "created_at TEXT DEFAULT CURRENT_TIMESTAMP,"
-           "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE"
-           ")");
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS credit_cards ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "user_id INTEGER NOT NULL,"
+                          "card_number TEXT UNIQUE NOT NULL,"
+                          "cvv TEXT NOT NULL,"
+                          "expiry_month INTEGER NOT NULL,"
+                          "expiry_year INTEGER NOT NULL,"
+                          "credit_limit REAL NOT NULL,"
+                          "current_balance REAL NOT NULL DEFAULT 0,"
+                          "min_payment REAL NOT NULL DEFAULT 0,"
+                          "apr REAL NOT NULL DEFAULT 0.1999,"
+                          "statement_balance REAL NOT NULL DEFAULT 0,"
+                          "paid_since_statement REAL NOT NULL DEFAULT 0,"
+                          "last_statement_date TEXT,"
+                          "payment_due_date TEXT,"
+                          "status TEXT NOT NULL DEFAULT 'Active',"
+                          "created_at TEXT DEFAULT CURRENT_TIMESTAMP,"
+                          "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE"
+                          ")");
+
+    // Billing-cycle columns for databases created before they existed
+    ensureColumn("credit_cards", "apr", "REAL NOT NULL DEFAULT 0.1999");
+    ensureColumn("credit_cards", "statement_balance", "REAL NOT NULL DEFAULT 0");
+    ensureColumn("credit_cards", "paid_since_statement", "REAL NOT NULL DEFAULT 0");
+    ensureColumn("credit_cards", "last_statement_date", "TEXT");
+    ensureColumn("credit_cards", "payment_due_date", "TEXT");
 
     // transactions
-    q.exec("CREATE TABLE IF NOT EXISTS transactions ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "account_id INTEGER NOT NULL,"
-           "type TEXT NOT NULL,"
-           "amount REAL NOT NULL,"
-           "timestamp TEXT DEFAULT CURRENT_TIMESTAMP,"
-           "description TEXT,"
-           "related_account_id INTEGER,"
-           "interac_email TEXT,"
-           "FOREIGN KEY(account_id) REFERENCES accounts(id) ON DELETE CASCADE"
-           ")");
-
-    // interac registrations
-    q.exec("CREATE TABLE IF NOT EXISTS interac_registrations ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "user_id INTEGER NOT NULL,"
-           "account_id INTEGER NOT NULL,"
-           "email TEXT UNIQUE NOT NULL,"
-           "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE,"
-           "FOREIGN KEY(account_id) REFERENCES accounts(id) ON DELETE CASCADE"
-           ")");
-
-    // bill payees
-    q.exec("CREATE TABLE IF NOT EXISTS bill_payees ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "name TEXT NOT NULL,"
-           "category TEXT"
-           ")");
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS transactions ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "account_id INTEGER NOT NULL,"
+                          "type TEXT NOT NULL,"
+                          "amount REAL NOT NULL,"
+                          "timestamp TEXT DEFAULT CURRENT_TIMESTAMP,"
+                          "description TEXT,"
+                          "related_account_id INTEGER,"
+                          "interac_email TEXT,"
+                          "transfer_intent INTEGER,"
+                          "payee_id INTEGER,"
+                          "balance_after REAL,"
+                          "FOREIGN KEY(account_id) REFERENCES accounts(id) ON DELETE CASCADE"
+                          ")");
+    // Legs of cross-shard transfers point back at their shard_transfers row
+    ensureColumn("transactions", "transfer_intent", "INTEGER");
+    SlowQueryLog::exec(q, "CREATE INDEX IF NOT EXISTS idx_transactions_intent "
+                          "ON transactions(transfer_intent) WHERE transfer_intent IS NOT NULL");
+    // Bill payments carry their payee so spending can be split by category
+    ensureColumn("transactions", "payee_id", "INTEGER");
+    // Running balance stamped by each posting; rebuildRunningBalances() fills
+    // rows written before the column existed
+    ensureColumn("transactions", "balance_after", "REAL");
+    // Per-account history, and rows added since a known ID
+    SlowQueryLog::exec(q, "CREATE INDEX IF NOT EXISTS idx_transactions_account "
+                          "ON transactions(account_id, id)");
 
     // bill payments
-    q.exec("CREATE TABLE IF NOT EXISTS bill_payments ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "user_id INTEGER NOT NULL,"
-           "from_account_id INTEGER NOT NULL,"
-           "payee_id INTEGER NOT NULL,"
-           "amount REAL NOT NULL,"
-           "timestamp TEXT DEFAULT CURRENT_TIMESTAMP,"
-           "reference TEXT,"
-           "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE,"
-           "FOREIGN KEY(from_account_id) REFERENCES accounts(id) ON DELETE CASCADE,"
-           "FOREIGN KEY(payee_id) REFERENCES bill_payees(id) ON DELETE CASCADE"
-           ")");
-
-    // FAQs
-    q.exec("CREATE TABLE IF NOT EXISTS faqs ("
-           "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-           "question TEXT NOT NULL,"
-           "answer TEXT NOT NULL"
-           ")");
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS bill_payments ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "user_id INTEGER NOT NULL,"
+                          "from_account_id INTEGER NOT NULL,"
+                          "payee_id INTEGER NOT NULL,"
+                          "amount REAL NOT NULL,"
+                          "timestamp TEXT DEFAULT CURRENT_TIMESTAMP,"
+                          "reference TEXT,"
+                          "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE,"
+                          "FOREIGN KEY(from_account_id) REFERENCES accounts(id) ON DELETE CASCADE,"
+                          "FOREIGN KEY(payee_id) REFERENCES bill_payees(id) ON DELETE CASCADE"
+                          ")");
+
+    // Month-end statements: one header per account and closed month, plus
+    // that month's totals per transaction type
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS statement_headers ("
+                          "account_id INTEGER NOT NULL,"
+                          "period TEXT NOT NULL,"
+                          "opening_balance REAL NOT NULL,"
+                          "closing_balance REAL NOT NULL,"
+                          "total_credits REAL NOT NULL DEFAULT 0,"
+                          "total_debits REAL NOT NULL DEFAULT 0,"
+                          "transaction_count INTEGER NOT NULL DEFAULT 0,"
+                          "after_transaction_id INTEGER NOT NULL,"
+                          "last_transaction_id INTEGER NOT NULL,"
+                          "closed_at TEXT DEFAULT CURRENT_TIMESTAMP,"
+                          "PRIMARY KEY(account_id, period),"
+                          "FOREIGN KEY(account_id) REFERENCES accounts(id) ON DELETE CASCADE"
+                          ") WITHOUT ROWID");
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS statement_totals ("
+                          "account_id INTEGER NOT NULL,"
+                          "period TEXT NOT NULL,"
+                          "type TEXT NOT NULL,"
+                          "amount REAL NOT NULL,"
+                          "count INTEGER NOT NULL,"
+                          "PRIMARY KEY(account_id, period, type)"
+                          ") WITHOUT ROWID");
+
+    // scheduled / recurring bill payments
+    SlowQueryLog::exec(q, "CREATE TABLE IF NOT EXISTS scheduled_payments ("
+                          "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "user_id INTEGER NOT NULL,"
+                          "from_account_id INTEGER NOT NULL,"
+                          "payee_id INTEGER NOT NULL,"
+                          "amount REAL NOT NULL,"
+                          "frequency TEXT NOT NULL DEFAULT 'Once',"
+                          "day_of_month INTEGER NOT NULL DEFAULT 1,"
+                          "next_due TEXT NOT NULL,"
+                          "retry_count INTEGER NOT NULL DEFAULT 0,"
+                          "status TEXT NOT NULL DEFAULT 'Active',"
+                          "created_at TEXT DEFAULT CURRENT_TIMESTAMP,"
+                          "cycle_due TEXT," // while retrying: the date the payment was due
+                          "FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE,"
+                          "FOREIGN KEY(from_account_id) REFERENCES accounts(id) ON DELETE CASCADE,"
+                          "FOREIGN KEY(payee_id) REFERENCES bill_payees(id) ON DELETE CASCADE"
+                          ")");
+    ensureColumn("scheduled_payments", "cycle_due", "TEXT");
+    // due-time index: the scheduler only ever reads the Active rows at the front
+    SlowQueryLog::exec(q, "CREATE INDEX IF NOT EXISTS idx_scheduled_due "
+                          "ON scheduled_payments(status, next_due)");
+
+    createSearchIndex();
 }
 
-void DBManager::createSampleDataIfEmpty() {
-    QSqlQuery q(m_db);
-    q.exec("SELECT COUNT(*) FROM users");
-    if (q.next() && q.value(0).toInt() > 0) {
-        return; // already seeded
+void DBManager::createSearchIndex() {
+    QSqlQuery q(database());
+    bool exists = SlowQueryLog::exec(q, "SELECT 1 FROM sqlite_master WHERE name = 'transactions_fts'")
+                  && q.next();
+    q.finish();
+
+    // Contentless: the index stores tokens only, the text stays in
+    // transactions. The account is indexed as a token ("a<id>") so a search
+    // intersects with one account's rows inside the index.
+    if (!exists && !SlowQueryLog::exec(q, "CREATE VIRTUAL TABLE transactions_fts USING fts5("
+                                          "description, interac_email, payee, amount, account,"
+                                          "content='', prefix='2 3')")) {
+        qWarning() << "FTS5 unavailable, statement search falls back to LIKE:" << q.lastError().text();
+        m_searchIndexed = false;
+        return;
+    }
+    m_searchIndexed = true;
+
+    // The payee name each row was indexed with. Payees can be renamed, and
+    // a contentless index only drops a row given the exact text it indexed.
+    // Rows indexed before this table existed get the current names.
+    const bool payeesKept = SlowQueryLog::exec(q, "SELECT 1 FROM sqlite_master "
+                                                  "WHERE name = 'transactions_fts_payee'") && q.next();
+    q.finish();
+    if (!payeesKept) {
+        SlowQueryLog::exec(q, "CREATE TABLE transactions_fts_payee ("
+                              "transaction_id INTEGER PRIMARY KEY, payee TEXT NOT NULL)");
+        SlowQueryLog::exec(q, "INSERT INTO transactions_fts_payee (transaction_id, payee) "
+                              "SELECT t.id, p.name FROM transactions t "
+                              "JOIN bill_payees p ON p.id = t.payee_id");
     }
 
-    // Sample users
-    createUser("alice@example.com", "Password123!", "Alice Blue", QDate(2002, 1, 15));
-    createUser("bob@example.com", "Password123!", "Bob Noir", QDate(2001, 4, 3));
-
-    // Fetch IDs
-    QSqlQuery q2(m_db);
-    int aliceId = -1;
-    int bobId = -1;
-
-    q2.exec("SELECT id, email FROM users");
-    while (q2.next()) {
-        int id = q2.value(0).toInt();
-        QString email = q2.value(1).toString();
-        if (email == "alice@example.com") aliceId = id;
-        if (email == "bob@example.com") bobId = id;
+    const QString values = "%1.id, COALESCE(%1.description, ''), COALESCE(%1.interac_email, ''), "
+                           "COALESCE((SELECT payee FROM transactions_fts_payee "
+                           "WHERE transaction_id = %1.id), ''), "
+                           "printf('%.2f', %1.amount), 'a' || %1.account_id";
+    const QString insert = QString("INSERT INTO transactions_fts_payee (transaction_id, payee) "
+                                   "SELECT new.id, name FROM bill_payees WHERE id = new.payee_id; "
+                                   "INSERT INTO transactions_fts "
+                                   "(rowid, description, interac_email, payee, amount, account) "
+                                   "VALUES (%1);").arg(values.arg("new"));
+    const QString remove = QString("INSERT INTO transactions_fts "
+                                   "(transactions_fts, rowid, description, interac_email, payee, amount, account) "
+                                   "VALUES ('delete', %1); "
+                                   "DELETE FROM transactions_fts_payee WHERE transaction_id = old.id;")
+                               .arg(values.arg("old"));
+    // Replaced on every upgrade: older triggers looked the payee up at delete time
+    SlowQueryLog::exec(q, "DROP TRIGGER IF EXISTS transactions_fts_insert");
+    SlowQueryLog::exec(q, "DROP TRIGGER IF EXISTS transactions_fts_delete");
+    SlowQueryLog::exec(q, "DROP TRIGGER IF EXISTS transactions_fts_update");
+    SlowQueryLog::exec(q, "CREATE TRIGGER transactions_fts_insert "
+                          "AFTER INSERT ON transactions BEGIN " + insert + " END");
+    SlowQueryLog::exec(q, "CREATE TRIGGER transactions_fts_delete "
+                          "AFTER DELETE ON transactions BEGIN " + remove + " END");
+    SlowQueryLog::exec(q, "CREATE TRIGGER transactions_fts_update "
+                          "AFTER UPDATE OF description, interac_email, payee_id, amount, account_id "
+                          "ON transactions BEGIN " + remove + " " + insert + " END");
+
+    if (!exists) {
+        // Index the history recorded before the search index existed
+        SlowQueryLog::exec(q, "INSERT INTO transactions_fts "
+                              "(rowid, description, interac_email, payee, amount, account) "
+                              "SELECT " + values.arg("t") + " FROM transactions t");
     }
+}
 
-    // Sample accounts
-    int aliceChequing = createAccount(aliceId, "Chequing", 3500.0, 0.0);
-    int aliceSavings = createAccount(aliceId, "Savings", 8200.0, 0.012); // 1.2% annually
-    int bobChequing = createAccount(bobId, "Chequing", 900.0, 0.0);
+void DBManager::ensureColumn(const QString &table,
+                             const QString &column,
+                             const QString &definition) {
+    QSqlQuery info(database());
+    if (!SlowQueryLog::exec(info, QString("PRAGMA table_info(%1)").arg(table))) return;
+    while (info.next()) {
+        if (info.value(1).toString() == column) return;
+    }
 
-    // Interac registrations
-    registerInteracEmail(aliceId, aliceChequing, "alice.interac@example.com");
-    registerInteracEmail(bobId, bobChequing, "bob.interac@example.com");
+    QSqlQuery alter(database());
+    if (!SlowQueryLog::exec(alter, QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, definition))) {
+        qWarning() << "Failed to add column" << table << column << ":" << alter.lastError().text();
+    }
+}
 
-    // Credit card for Alice
-    applyForCreditCard(aliceId, 5000.0);
+QSqlDatabase DBManager::openWorkerConnection(const QString &name, int shard) {
+    // Must be called from the thread that will use the connection
+    if (m_shardCount <= 1) shard = kDirectory;
+    QSqlDatabase db = QSqlDatabase::cloneDatabase(sourceConnectionName(shard), name);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
+    if (!db.open()) {
+        qWarning() << "Failed to open worker connection:" << db.lastError().text();
+        return db;
+    }
+    QSqlQuery pragma(db);
+    SlowQueryLog::exec(pragma, "PRAGMA foreign_keys = ON");
+    return db;
+}
 
-    // Bill payees
-    QSqlQuery bp(m_db);
-    bp.prepare("INSERT INTO bill_payees (name, category) VALUES (?, ?)");
+void DBManager::seedReferenceData() {
+    // Bill payees, in the directory and with the same IDs on every shard
     QStringList names = {"Hydro One", "Bell Canada", "Netflix", "City of Sudbury Property Tax"};
     QStringList cats  = {"Utilities", "Telecom", "Streaming", "Municipal"};
-    for (int i = 0; i < names.size(); ++i) {
-        bp.bindValue(0, names[i]);
-        bp.bindValue(1, cats[i]);
-        bp.exec();
+    QList<QSqlDatabase> payeeFiles{directoryDatabase()};
+    for (int shard = 0; m_shardCount > 1 && shard < m_shardCount; ++shard) {
+        payeeFiles << shardDatabase(shard);
+    }
+    for (const QSqlDatabase &db : payeeFiles) {
+        QSqlQuery bp(db);
+        bp.prepare("INSERT OR IGNORE INTO bill_payees (id, name, category) VALUES (?, ?, ?)");
+        for (int i = 0; i < names.size(); ++i) {
+            bp.bindValue(0, i + 1);
+            bp.bindValue(1, names[i]);
+            bp.bindValue(2, cats[i]);
+            SlowQueryLog::exec(bp);
+        }
     }
 
     // FAQs
-    QSqlQuery fq(m_db);
+    QSqlQuery existing(directoryDatabase());
+    if (SlowQueryLog::exec(existing, "SELECT 1 FROM faqs LIMIT 1") && existing.next()) return;
+    existing.finish();
+
+    QSqlQuery fq(directoryDatabase());
     fq.prepare("INSERT INTO faqs (question, answer) VALUES (?, ?)");
     fq.addBindValue("How do I open a new savings account?");
     fq.addBindValue("Go to Accounts → Create Account, choose 'Savings', and confirm your details.");
-    fq.exec();
+    SlowQueryLog::exec(fq);
 
     fq.addBindValue("How is interest calculated on my savings account?");
     fq.addBindValue("Interest is calculated monthly based on your daily closing balance and credited automatically.");
-    fq.exec();
+    SlowQueryLog::exec(fq);
 
     fq.addBindValue("How can I reset my password?");
     fq.addBindValue("For this demo app, passwords are fixed. In a real system, you'd use email-based password reset.");
-    fq.exec();
+    SlowQueryLog::exec(fq);
+}
+
+bool DBManager::seedSampleData() {
+    QSqlQuery meta(directoryDatabase());
+    if (SlowQueryLog::exec(meta, "SELECT 1 FROM bank_meta WHERE key = 'seeded'") && meta.next()) {
+        return false; // already seeded
+    }
+    meta.finish();
+
+    auto markSeeded = [&meta]() {
+        SlowQueryLog::exec(meta, "INSERT OR REPLACE INTO bank_meta (key, value) VALUES ('seeded', '1')");
+    };
+    // A database that already has clients is never given the demo ones
+    if (SlowQueryLog::exec(meta, "SELECT 1 FROM users LIMIT 1") && meta.next()) {
+        meta.finish();
+        markSeeded();
+        return false;
+    }
+    meta.finish();
+
+    // Sample users
+    createUser("alice@example.com", "Password123!", "Alice Blue", QDate(2002, 1, 15));
+    createUser("bob@example.com", "Password123!", "Bob Noir", QDate(2001, 4, 3));
+    const int aliceId = authenticateUser("alice@example.com", "Password123!");
+    const int bobId = authenticateUser("bob@example.com", "Password123!");
+
+    // Sample accounts
+    int aliceChequing = createAccount(aliceId, "Chequing", 3500.0, 0.0);
+    createAccount(aliceId, "Savings", 8200.0, 0.012); // 1.2% annually
+    int bobChequing = createAccount(bobId, "Chequing", 900.0, 0.0);
+
+    // Interac registrations
+    registerInteracEmail(aliceId, aliceChequing, "alice.interac@example.com");
+    registerInteracEmail(bobId, bobChequing, "bob.interac@example.com");
+
+    // Credit card for Alice
+    applyForCreditCard(aliceId, 5000.0);
+
+    markSeeded();
+    return true;
 }
 
 bool DBManager::createUser(const QString &email,
                            const QString &password,
                            const QString &username,
                            const QDate &dob) {
-    QSqlQuery q(m_db);
+    OpTimer timer("DBManager::createUser");
+    QSqlQuery q(directoryDatabase());
     q.prepare("INSERT INTO users (email, password, username, dob) "
               "VALUES (:email, :password, :username, :dob)");
     q.bindValue(":email", email.trimmed());
     q.bindValue(":password", password); // NOTE: plain text for demo only
     q.bindValue(":username", username.trimmed());
     q.bindValue(":dob", dob.isValid() ? dob.toString("yyyy-MM-dd") : QString());
-    if (!q.exec()) {
+    if (!SlowQueryLog::exec(q)) {
         qWarning() << "Failed to create user:" << q.lastError().text();
-        return false;
+        return timer.finish(false);
     }
-    return true;
+
+    if (m_shardCount > 1) {
+        const int userId = q.lastInsertId().toInt();
+        QSqlQuery home(userDatabase(userId));
+        home.prepare("INSERT INTO users (id, email, password, username, dob) "
+                     "VALUES (:id, :email, '', :username, :dob)");
+        home.bindValue(":id", userId);
+        home.bindValue(":email", email.trimmed());
+        home.bindValue(":username", username.trimmed());
+        home.bindValue(":dob", dob.isValid() ? dob.toString("yyyy-MM-dd") : QString());
+        if (!SlowQueryLog::exec(home)) {
+            qWarning() << "Failed to place user on shard:" << home.lastError().text();
+            QSqlQuery undo(directoryDatabase());
+            undo.prepare("DELETE FROM users WHERE id = :id");
+            undo.bindValue(":id", userId);
+            SlowQueryLog::exec(undo);
+            return timer.finish(false);
+        }
+    }
+    return timer.finish(true);
 }
 
 int DBManager::authenticateUser(const QString &email,
                                 const QString &password) {
-    QSqlQuery q(m_db);
+    OpTimer timer("DBManager::authenticateUser");
+    QSqlQuery q(directoryDatabase());
     q.prepare("SELECT id FROM users WHERE email = :email AND password = :password");
     q.bindValue(":email", email.trimmed());
     q.bindValue(":password", password);
-    if (!q.exec()) {
+    if (!SlowQueryLog::exec(q)) {
         qWarning() << "Auth query failed:" << q.lastError().text();
-        return -1;
+        return timer.finish(-1);
     }
     if (q.next()) {
-        return q.value(0).toInt();
+        return timer.finish(q.value(0).toInt());
     }
-    return -1;
+    return timer.finish(-1);
+}
+
+QString DBManager::searchMatchExpression(const QString &text) {
+    // Every word must match the start of a token in the searchable columns.
+    // A one-letter prefix is not in the index (prefix='2 3') and matches a
+    // large share of all tokens, so it is left out.
+    QStringList phrases;
+    for (QString word : text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts)) {
+        if (word.size() < searchMinWordLength) continue;
+        word.replace('"', "\"\"");
+        phrases << QString("\"%1\"*").arg(word);
+    }
+    return phrases.join(' ');
+}
+
+bool DBManager::searchTransactions(QSqlQuery &q, int accountId, const QString &text,
+                                   int limit, int offset) {
+    OpTimer timer("DBManager::searchTransactions");
+    const QString match = searchMatchExpression(text);
+    if (match.isEmpty()) return timer.finish(false);
+
+    if (m_searchIndexed) {
+        // In rowid order FTS5 stops once the page is full; ranking by bm25
+        // would score every match first
+        q.prepare("SELECT t.timestamp AS 'When', t.type AS 'Type', "
+                  "printf('%.2f', t.amount) AS 'Amount', printf('%.2f', t.balance_after) AS 'Balance', "
+                  "t.description AS 'Description' "
+                  "FROM (SELECT rowid FROM transactions_fts WHERE transactions_fts MATCH :match "
+                  "      ORDER BY rowid DESC LIMIT :n OFFSET :off) hit "
+                  "JOIN transactions t ON t.id = hit.rowid "
+                  "ORDER BY t.id DESC");
+        q.bindValue(":match", QString("account : a%1 AND {description interac_email payee amount} : (%2)")
+                                  .arg(accountId).arg(match));
+    } else {
+        q.prepare("SELECT t.timestamp AS 'When', t.type AS 'Type', "
+                  "printf('%.2f', t.amount) AS 'Amount', printf('%.2f', t.balance_after) AS 'Balance', "
+                  "t.description AS 'Description' "
+                  "FROM transactions t LEFT JOIN bill_payees p ON p.id = t.payee_id "
+                  "WHERE t.account_id = :acc AND (t.description LIKE :pattern "
+                  "OR t.interac_email LIKE :pattern OR p.name LIKE :pattern "
+                  "OR printf('%.2f', t.amount) LIKE :pattern) "
+                  "ORDER BY t.id DESC LIMIT :n OFFSET :off");
+        q.bindValue(":acc", accountId);
+        q.bindValue(":pattern", "%" + text.trimmed() + "%");
+    }
+    q.bindValue(":n", limit);
+    q.bindValue(":off", offset);
+    if (!SlowQueryLog::exec(q)) {
+        qWarning() << "Transaction search failed:" << q.lastError().text();
+        return timer.finish(false);
+    }
+    return timer.finish(true);
+}
+
+const QStringList &DBManager::creditTypes() {
+    static const QStringList types{"Deposit", "Transfer In", "Interac In", "Interest"};
+    return types;
+}
+
+bool DBManager::creditsAccount(const QString &type) {
+    return creditTypes().contains(type);
+}
+
+QString DBManager::creditTypeCondition(const QString &column) {
+    return QString("%1 IN ('%2')").arg(column, creditTypes().join("', '"));
 }
 
 QString DBManager::generateAccountNumber() {
@@ -245,9 +898,11 @@ int DBManager::createAccount(int userId,
                              const QString &type,
                              double initialBalance,
                              double interestRate) {
+    OpTimer timer("DBManager::createAccount");
+    ShardScope scope(shardForUser(userId));
     QString accNum = generateAccountNumber();
 
-    QSqlQuery q(m_db);
+    QSqlQuery q(database());
     q.prepare("INSERT INTO accounts "
               "(user_id, account_number, type, balance, interest_rate, last_interest_applied) "
               "VALUES (:user_id, :acc, :type, :bal, :rate, :last)");
@@ -258,158 +913,395 @@ int DBManager::createAccount(int userId,
     q.bindValue(":rate", interestRate);
     q.bindValue(":last", QDate::currentDate().toString("yyyy-MM-dd"));
 
-    if (!q.exec()) {
+    if (!SlowQueryLog::exec(q)) {
         qWarning() << "Failed to create account:" << q.lastError().text();
-        return -1;
+        return timer.finish(-1);
     }
-    return q.lastInsertId().toInt();
+    return timer.finish(q.lastInsertId().toInt());
 }
 
-bool DBManager::deposit(int accountId, double amount) {
-    if (amount <= 0) return false;
-    QSqlQuery q(m_db);
-    q.prepare("UPDATE accounts SET balance = balance + :amt WHERE id = :id");
-    q.bindValue(":amt", amount);
-    q.bindValue(":id", accountId);
-    if (!q.exec()) return false;
+DBManager::PostingResult DBManager::post(const Posting &posting, bool checkFunds) {
+    if (!nativePostings()) return postThroughQtSql(posting, checkFunds);
+
+    // Balance check and update in one statement: a debit the balance
+    // cannot cover matches no row
+    const QSqlDatabase db = database();
+    const bool debit = posting.delta < 0;
+    const double amount = qAbs(posting.delta);
+    double balance = 0.0;
+    {
+        NativeStatement upd(db, debit && checkFunds
+                                    ? "UPDATE accounts SET balance = balance - ?1 "
+                                      "WHERE id = ?2 AND balance >= ?1 RETURNING balance"
+                                    : (debit ? "UPDATE accounts SET balance = balance - ?1 WHERE id = ?2 RETURNING balance"
+                                             : "UPDATE accounts SET balance = balance + ?1 WHERE id = ?2 RETURNING balance"));
+        upd.bind(1, amount);
+        upd.bind(2, posting.accountId);
+        const bool applied = upd.next();
+        if (!upd.ok()) return PostingResult::Failed;
+        if (!applied) {
+            // Only on the failure path: tell a missing account from a short one
+            NativeStatement exists(db, "SELECT 1 FROM accounts WHERE id = ?1");
+            exists.bind(1, posting.accountId);
+            const bool found = exists.next();
+            return found && debit ? PostingResult::InsufficientFunds : PostingResult::Failed;
+        }
+        balance = upd.real(0);
+    }
 
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
-              "VALUES (:acc, 'Deposit', :amt, 'Cash deposit')");
-    t.bindValue(":acc", accountId);
-    t.bindValue(":amt", amount);
-    t.exec();
-    return true;
+    // Unbound parameters are NULL
+    NativeStatement t(db, "INSERT INTO transactions (account_id, type, amount, description, related_account_id, "
+                          "payee_id, interac_email, transfer_intent, balance_after) "
+                          "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)");
+    t.bind(1, posting.accountId);
+    t.bindStatic(2, posting.type);
+    t.bind(3, amount);
+    t.bindStatic(4, posting.description);
+    if (posting.relatedAccountId) t.bind(5, posting.relatedAccountId);
+    if (posting.payeeId) t.bind(6, posting.payeeId);
+    if (!posting.interacEmail.isEmpty()) t.bind(7, posting.interacEmail);
+    if (posting.transferIntent) t.bind(8, posting.transferIntent);
+    t.bind(9, balance);
+    if (!t.exec()) {
+        qWarning() << "Failed to journal posting:" << t.errorString();
+        return PostingResult::Failed;
+    }
+    return PostingResult::Ok;
 }
 
-bool DBManager::withdraw(int accountId, double amount) {
-    if (amount <= 0) return false;
+DBManager::PostingResult DBManager::postThroughQtSql(const Posting &posting, bool checkFunds) {
+    const bool debit = posting.delta < 0;
+    QSqlQuery upd(database());
+    upd.prepare(debit && checkFunds
+                    ? "UPDATE accounts SET balance = balance - :amt "
+                      "WHERE id = :id AND balance >= :amt RETURNING balance"
+                    : (debit ? "UPDATE accounts SET balance = balance - :amt WHERE id = :id RETURNING balance"
+                             : "UPDATE accounts SET balance = balance + :amt WHERE id = :id RETURNING balance"));
+    upd.bindValue(":amt", qAbs(posting.delta));
+    upd.bindValue(":id", posting.accountId);
+    if (!SlowQueryLog::exec(upd)) return PostingResult::Failed;
+    const bool applied = upd.next();
+    const double balance = applied ? upd.value(0).toDouble() : 0.0;
+    upd.finish();
+    if (!applied) {
+        // Only on the failure path: tell a missing account from a short one
+        QSqlQuery exists(database());
+        exists.prepare("SELECT 1 FROM accounts WHERE id = :id");
+        exists.bindValue(":id", posting.accountId);
+        const bool found = SlowQueryLog::exec(exists) && exists.next();
+        return found && debit ? PostingResult::InsufficientFunds : PostingResult::Failed;
+    }
 
-    QSqlQuery balQ(m_db);
-    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
-    balQ.bindValue(":id", accountId);
-    if (!balQ.exec() || !balQ.next()) return false;
-    double balance = balQ.value(0).toDouble();
-    if (balance < amount) return false;
+    QSqlQuery t(database());
+    t.prepare("INSERT INTO transactions (account_id, type, amount, description, related_account_id, "
+              "payee_id, interac_email, transfer_intent, balance_after) "
+              "VALUES (:acc, :type, :amt, :desc, :rel, :payee, :email, :intent, :balance)");
+    t.bindValue(":acc", posting.accountId);
+    t.bindValue(":type", QString::fromLatin1(posting.type));
+    t.bindValue(":amt", qAbs(posting.delta));
+    t.bindValue(":desc", QString::fromLatin1(posting.description));
+    t.bindValue(":rel", posting.relatedAccountId ? QVariant(posting.relatedAccountId) : QVariant());
+    t.bindValue(":payee", posting.payeeId ? QVariant(posting.payeeId) : QVariant());
+    t.bindValue(":email", posting.interacEmail.isEmpty() ? QVariant() : QVariant(posting.interacEmail));
+    t.bindValue(":intent", posting.transferIntent ? QVariant(posting.transferIntent) : QVariant());
+    t.bindValue(":balance", balance);
+    if (!SlowQueryLog::exec(t)) {
+        qWarning() << "Failed to journal posting:" << t.lastError().text();
+        return PostingResult::Failed;
+    }
+    return PostingResult::Ok;
+}
 
-    QSqlQuery q(m_db);
-    q.prepare("UPDATE accounts SET balance = balance - :amt WHERE id = :id");
-    q.bindValue(":amt", amount);
-    q.bindValue(":id", accountId);
-    if (!q.exec()) return false;
+bool DBManager::postAll(std::initializer_list<Posting> postings) {
+    if (!beginTransaction()) return false;
+    for (const Posting &posting : postings) {
+        if (post(posting) != PostingResult::Ok) {
+            rollbackTransaction();
+            return false;
+        }
+    }
+    if (!commitTransaction()) {
+        rollbackTransaction();
+        return false;
+    }
+    return true;
+}
 
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
-              "VALUES (:acc, 'Withdrawal', :amt, 'Cash withdrawal')");
-    t.bindValue(":acc", accountId);
-    t.bindValue(":amt", amount);
-    t.exec();
+DBManager::Posting DBManager::transferPosting(int accountId, int relatedAccountId, double delta,
+                                              const QString &interacEmail, qint64 intentId) {
+    Posting posting{accountId, delta};
+    if (interacEmail.isEmpty()) {
+        posting.type = delta < 0 ? "Transfer Out" : "Transfer In";
+        posting.description = delta < 0 ? "Transfer to another account" : "Transfer from another account";
+    } else {
+        posting.type = delta < 0 ? "Interac Out" : "Interac In";
+        posting.description = delta < 0 ? "Interac e-Transfer sent" : "Interac e-Transfer received";
+        posting.interacEmail = interacEmail;
+    }
+    posting.relatedAccountId = relatedAccountId;
+    posting.transferIntent = intentId;
+    return posting;
+}
 
-    return true;
+bool DBManager::deposit(int accountId, double amount) {
+    OpTimer timer("DBManager::deposit");
+    if (amount <= 0) return timer.finish(false);
+    ShardScope scope(shardForAccount(accountId));
+    return timer.finish(postAll({{accountId, amount, "Deposit", "Cash deposit"}}));
+}
+
+bool DBManager::withdraw(int accountId, double amount) {
+    OpTimer timer("DBManager::withdraw");
+    if (amount <= 0) return timer.finish(false);
+    ShardScope scope(shardForAccount(accountId));
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Account, accountId, amount, [&]() {
+        return postAll({{accountId, -amount, "Withdrawal", "Cash withdrawal"}});
+    }));
 }
 
 bool DBManager::transferAccountToAccount(int fromAccountId, int toAccountId, double amount) {
+    OpTimer timer("DBManager::transferAccountToAccount");
+    return timer.finish(transferBetween(fromAccountId, toAccountId, amount, QString()));
+}
+
+bool DBManager::transferBetween(int fromAccountId, int toAccountId, double amount,
+                                const QString &interacEmail) {
     if (amount <= 0 || fromAccountId == toAccountId) return false;
 
-    m_db.transaction();
+    const int shard = shardForAccount(fromAccountId);
+    if (shard != shardForAccount(toAccountId)) {
+        return crossShardTransfer(fromAccountId, toAccountId, amount, interacEmail);
+    }
+    ShardScope scope(shard);
+    return postAll({transferPosting(fromAccountId, toAccountId, -amount, interacEmail, 0),
+                    transferPosting(toAccountId, fromAccountId, amount, interacEmail, 0)});
+}
 
-    QSqlQuery balQ(m_db);
-    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
-    balQ.bindValue(":id", fromAccountId);
-    if (!balQ.exec() || !balQ.next()) {
-        m_db.rollback();
-        return false;
+bool DBManager::crossShardTransfer(int fromAccountId, int toAccountId, double amount,
+                                   const QString &interacEmail) {
+    // Phase 1: lock both shards, lower shard first so opposite transfers
+    // cannot deadlock. The intent is recorded under both locks, so a crash
+    // at any later point can be resolved (see recoverShardTransfers()).
+    const int fromShard = shardForAccount(fromAccountId);
+    const int toShard = shardForAccount(toAccountId);
+    QSqlDatabase first = shardDatabase(qMin(fromShard, toShard));
+    QSqlDatabase second = shardDatabase(qMax(fromShard, toShard));
+    const bool firstOpen = beginTransaction(first);
+    const bool secondOpen = firstOpen && beginTransaction(second);
+
+    qint64 intentId = 0;
+    if (secondOpen) {
+        QSqlQuery intent(directoryDatabase());
+        intent.prepare("INSERT INTO shard_transfers (from_account_id, to_account_id, amount, interac_email) "
+                       "VALUES (:from, :to, :amt, :email)");
+        intent.bindValue(":from", fromAccountId);
+        intent.bindValue(":to", toAccountId);
+        intent.bindValue(":amt", amount);
+        intent.bindValue(":email", interacEmail.isEmpty() ? QVariant() : QVariant(interacEmail));
+        if (SlowQueryLog::exec(intent)) {
+            intentId = intent.lastInsertId().toLongLong();
+        } else {
+            qWarning() << "Failed to record transfer intent:" << intent.lastError().text();
+        }
     }
-    double balance = balQ.value(0).toDouble();
-    if (balance < amount) {
-        m_db.rollback();
+    const QList<qint64> ids{intentId};
+    bool ok = intentId > 0
+              && postTransferLeg(fromAccountId, toAccountId, -amount, intentId, true, interacEmail)
+              && postTransferLeg(toAccountId, fromAccountId, amount, intentId, false, interacEmail);
+
+    // Phase 2: the decision is recorded before either shard commits. In a
+    // batch, commitBatch() decides all of the batch's transfers at once.
+    if (ok && m_batchDepth == 0) ok = setTransferStatus(ids, "pending", "committing");
+    if (!ok) {
+        if (secondOpen) rollbackTransaction(second);
+        if (firstOpen) rollbackTransaction(first);
+        if (intentId > 0) setTransferStatus(ids, "pending", "aborted");
         return false;
     }
 
-    QSqlQuery debit(m_db);
-    debit.prepare("UPDATE accounts SET balance = balance - :amt WHERE id = :id");
-    debit.bindValue(":amt", amount);
-    debit.bindValue(":id", fromAccountId);
-    if (!debit.exec()) { m_db.rollback(); return false; }
-
-    QSqlQuery credit(m_db);
-    credit.prepare("UPDATE accounts SET balance = balance + :amt WHERE id = :id");
-    credit.bindValue(":amt", amount);
-    credit.bindValue(":id", toAccountId);
-    if (!credit.exec()) { m_db.rollback(); return false; }
-
-    QSqlQuery t1(m_db);
-    t1.prepare("INSERT INTO transactions (account_id, type, amount, description, related_account_id) "
-               "VALUES (:acc, 'Transfer Out', :amt, 'Transfer to another account', :rel)");
-    t1.bindValue(":acc", fromAccountId);
-    t1.bindValue(":amt", amount);
-    t1.bindValue(":rel", toAccountId);
-    t1.exec();
-
-    QSqlQuery t2(m_db);
-    t2.prepare("INSERT INTO transactions (account_id, type, amount, description, related_account_id) "
-               "VALUES (:acc, 'Transfer In', :amt, 'Transfer from another account', :rel)");
-    t2.bindValue(":acc", toAccountId);
-    t2.bindValue(":amt", amount);
-    t2.bindValue(":rel", fromAccountId);
-    t2.exec();
-
-    m_db.commit();
+    const bool firstCommitted = commitTransaction(first);
+    const bool secondCommitted = commitTransaction(second);
+    if (m_batchDepth > 0) {
+        m_batchIntents.append(intentId);
+        return true;
+    }
+    if (!firstCommitted || !secondCommitted) {
+        // Decided, so the missing leg is rolled forward: now if possible,
+        // otherwise by the next recoverShardTransfers()
+        if (!firstCommitted) rollbackTransaction(first);
+        if (!secondCommitted) rollbackTransaction(second);
+        if (completeTransfer({intentId, fromAccountId, toAccountId, amount, interacEmail})) return true;
+        qWarning() << "Cross-shard transfer" << intentId << "left for recovery";
+        return false;
+    }
+    setTransferStatus(ids, "committing", "done");
     return true;
 }
 
+bool DBManager::postTransferLeg(int accountId, int relatedAccountId, double delta,
+                                qint64 intentId, bool checkFunds, const QString &interacEmail) {
+    ShardScope scope(shardForAccount(accountId));
+    return post(transferPosting(accountId, relatedAccountId, delta, interacEmail, intentId),
+                checkFunds) == PostingResult::Ok;
+}
+
+bool DBManager::setTransferStatus(const QList<qint64> &intentIds, const QString &from,
+                                  const QString &to) {
+    QStringList idList;
+    idList.reserve(intentIds.size());
+    for (qint64 id : intentIds) idList << QString::number(id);
+
+    // Conditional on the old status, so a transfer another process has
+    // already aborted can never be decided here as well.
+    QSqlQuery q(directoryDatabase());
+    q.prepare(QString("UPDATE shard_transfers SET status = :to "
+                      "WHERE status = :from AND id IN (%1)").arg(idList.join(',')));
+    q.bindValue(":to", to);
+    q.bindValue(":from", from);
+    if (!SlowQueryLog::exec(q)) {
+        qWarning() << "Failed to update transfer intents:" << q.lastError().text();
+        return false;
+    }
+    return q.numRowsAffected() == intentIds.size();
+}
+
+int DBManager::recoverShardTransfers() {
+    OpTimer timer("DBManager::recoverShardTransfers");
+    // A batch on this thread holds every shard's lock
+    if (m_shardCount <= 1 || m_batchDepth > 0) return timer.finish(0);
+
+    // Undecided: the owner holds both shards' write locks from before the
+    // intent is written until it is decided, so an intent still pending
+    // while either shard is free has lost its owner and no leg committed.
+    struct Undecided { qint64 id; int fromShard; int toShard; };
+    std::vector<Undecided> undecided;
+    QSqlQuery pending(directoryDatabase());
+    pending.setForwardOnly(true);
+    if (SlowQueryLog::exec(pending, "SELECT id, from_account_id, to_account_id "
+                                    "FROM shard_transfers WHERE status = 'pending'")) {
+        while (pending.next()) {
+            undecided.push_back({pending.value(0).toLongLong(), shardForAccount(pending.value(1).toInt()),
+                                 shardForAccount(pending.value(2).toInt())});
+        }
+    }
+    pending.finish();
+    int resolved = 0;
+    for (const Undecided &u : undecided) {
+        const bool abandoned = !shardWriteLocked(u.fromShard) || !shardWriteLocked(u.toShard);
+        if (abandoned && setTransferStatus({u.id}, "pending", "aborted")) ++resolved;
+    }
+
+    std::vector<TransferIntent> decided;
+    QSqlQuery q(directoryDatabase());
+    q.setForwardOnly(true);
+    if (!SlowQueryLog::exec(q, "SELECT id, from_account_id, to_account_id, amount, "
+                               "COALESCE(interac_email, '') "
+                               "FROM shard_transfers WHERE status = 'committing'")) {
+        return timer.finish(resolved);
+    }
+    while (q.next()) {
+        decided.push_back({q.value(0).toLongLong(), q.value(1).toInt(),
+                           q.value(2).toInt(), q.value(3).toDouble(), q.value(4).toString()});
+    }
+    q.finish();
+
+    for (const TransferIntent &d : decided) {
+        if (completeTransfer(d)) ++resolved;
+    }
+    return timer.finish(resolved);
+}
+
+bool DBManager::completeTransfer(const TransferIntent &d) {
+    struct Leg { int account; int related; double delta; };
+    const Leg legs[] = {{d.from, d.to, -d.amount}, {d.to, d.from, d.amount}};
+    bool ok = true;
+    for (const Leg &leg : legs) {
+        // Checked under the shard's write lock: a transfer still being
+        // committed by another process holds it until both legs land.
+        QSqlDatabase db = shardDatabase(shardForAccount(leg.account));
+        if (!beginTransaction(db)) {
+            ok = false;
+            continue;
+        }
+        QSqlQuery seen(db);
+        seen.prepare("SELECT 1 FROM transactions WHERE transfer_intent = :id AND account_id = :acc");
+        seen.bindValue(":id", d.id);
+        seen.bindValue(":acc", leg.account);
+        if (!SlowQueryLog::exec(seen)) {
+            rollbackTransaction(db);
+            ok = false;
+            continue;
+        }
+        const bool applied = seen.next();
+        seen.finish();
+        if (!applied && !postTransferLeg(leg.account, leg.related, leg.delta, d.id, false, d.email)) {
+            rollbackTransaction(db);
+            ok = false;
+            continue;
+        }
+        if (!commitTransaction(db)) {
+            rollbackTransaction(db);
+            ok = false;
+        }
+    }
+    return ok && setTransferStatus({d.id}, "committing", "done");
+}
+
+bool DBManager::shardWriteLocked(int shard) {
+    // Probes without waiting out the connection's busy timeout
+    QSqlDatabase db = shardDatabase(shard);
+    QSqlQuery timeout(db);
+    SlowQueryLog::exec(timeout, "PRAGMA busy_timeout = 0");
+    const bool locked = !beginTransaction(db);
+    if (!locked) rollbackTransaction(db);
+    SlowQueryLog::exec(timeout, "PRAGMA busy_timeout = 10000");
+    return locked;
+}
+
+void DBManager::scheduleTransferRecovery(QObject *parent, int intervalMs) {
+    if (m_shardCount <= 1) return;
+    auto *timer = new QTimer(parent);
+    QObject::connect(timer, &QTimer::timeout, [] { recoverShardTransfers(); });
+    timer->start(intervalMs);
+}
+
 bool DBManager::registerInteracEmail(int userId, int accountId, const QString &email) {
-    QSqlQuery q(m_db);
+    OpTimer timer("DBManager::registerInteracEmail");
+    QSqlQuery q(directoryDatabase());
     q.prepare("INSERT OR REPLACE INTO interac_registrations (user_id, account_id, email) "
               "VALUES (:user, :acc, :email)");
     q.bindValue(":user", userId);
     q.bindValue(":acc", accountId);
     q.bindValue(":email", email.trimmed().toLower());
-    if (!q.exec()) {
+    if (!SlowQueryLog::exec(q)) {
         qWarning() << "Failed to register Interac:" << q.lastError().text();
-        return false;
+        return timer.finish(false);
     }
-    return true;
+    return timer.finish(true);
 }
 
 bool DBManager::interacTransfer(int fromAccountId, const QString &toEmail, double amount) {
-    if (amount <= 0) return false;
+    OpTimer timer("DBManager::interacTransfer");
+    if (amount <= 0) return timer.finish(false);
 
-    QSqlQuery find(m_db);
+    QSqlQuery find(directoryDatabase());
     find.prepare("SELECT account_id FROM interac_registrations WHERE email = :email");
     find.bindValue(":email", toEmail.trimmed().toLower());
-    if (!find.exec() || !find.next()) {
-        return false; // recipient not registered
+    if (!SlowQueryLog::exec(find) || !find.next()) {
+        return timer.finish(false); // recipient not registered
     }
-    int destAccountId = find.value(0).toInt();
-
-    if (!transferAccountToAccount(fromAccountId, destAccountId, amount)) {
-        return false;
-    }
-
-    // Override descriptions for clarity
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description, related_account_id, interac_email) "
-              "VALUES (:acc, 'Interac Out', :amt, 'Interac e-Transfer sent', :rel, :email)");
-    t.bindValue(":acc", fromAccountId);
-    t.bindValue(":amt", amount);
-    t.bindValue(":rel", destAccountId);
-    t.bindValue(":email", toEmail.trimmed().toLower());
-    t.exec();
-
-    QSqlQuery t2(m_db);
-    t2.prepare("INSERT INTO transactions (account_id, type, amount, description, related_account_id, interac_email) "
-               "VALUES (:acc, 'Interac In', :amt, 'Interac e-Transfer received', :rel, :email)");
-    t2.bindValue(":acc", destAccountId);
-    t2.bindValue(":amt", amount);
-    t2.bindValue(":rel", fromAccountId);
-    t2.bindValue(":email", toEmail.trimmed().toLower());
-    t2.exec();
+    const int destAccountId = find.value(0).toInt();
+    find.finish();
 
-    return true;
+    // The legs themselves are the Interac rows; no separate transfer rows
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Account, fromAccountId, amount, [&]() {
+        return transferBetween(fromAccountId, destAccountId, amount, toEmail.trimmed().toLower());
+    }));
 }
 
 int DBManager::applyForCreditCard(int userId, double creditLimit) {
+    OpTimer timer("DBManager::applyForCreditCard");
+    ShardScope scope(shardForUser(userId));
     if (creditLimit < 2000.0) creditLimit = 2000.0; // minimum limit
 
     QString cardNumber = generateCardNumber();
@@ -423,7 +1315,7 @@ int DBManager::applyForCreditCard(int userId, double creditLimit) {
     int expiryMonth = today.month();
     int expiryYear = today.year() + 3;
 
-    QSqlQuery q(m_db);
+    QSqlQuery q(database());
     q.prepare("INSERT INTO credit_cards "
               "(user_id, card_number, cvv, expiry_month, expiry_year, credit_limit, current_balance, min_payment) "
               "VALUES (:user, :card, :cvv, :mm, :yy, :limit, 0, 0)");
@@ -434,186 +1326,365 @@ int DBManager::applyForCreditCard(int userId, double creditLimit) {
     q.bindValue(":yy", expiryYear);
     q.bindValue(":limit", creditLimit);
 
-    if (!q.exec()) {
+    if (!SlowQueryLog::exec(q)) {
         qWarning() << "Failed to create credit card:" << q.lastError().text();
-        return -1;
+        return timer.finish(-1);
     }
-    return q.lastInsertId().toInt();
+    return timer.finish(q.lastInsertId().toInt());
 }
 
-bool DBManager::payBill(int userId, int fromAccountId, int payeeId, double amount) {
-    if (amount <= 0) return false;
-
-    m_db.transaction();
+DBManager::PostingResult DBManager::postBillPayment(int userId, int fromAccountId,
+                                                    int payeeId, double amount,
+                                                    const QString &reference) {
+    Posting posting{fromAccountId, -amount, "Bill Payment", "Bill payment to registered payee"};
+    posting.payeeId = payeeId;
+    const PostingResult result = post(posting);
+    if (result != PostingResult::Ok) return result;
 
-    QSqlQuery balQ(m_db);
-    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
-    balQ.bindValue(":id", fromAccountId);
-    if (!balQ.exec() || !balQ.next()) {
-        m_db.rollback();
-        return false;
-    }
-    double balance = balQ.value(0).toDouble();
-    if (balance < amount) {
-        m_db.rollback();
-        return false;
-    }
-
-    QSqlQuery upd(m_db);
-    upd.prepare("UPDATE accounts SET balance = balance - :amt WHERE id = :id");
-    upd.bindValue(":amt", amount);
-    upd.bindValue(":id", fromAccountId);
-    if (!upd.exec()) { m_db.rollback(); return false; }
-
-    QSqlQuery bp(m_db);
+    QSqlQuery bp(database());
     bp.prepare("INSERT INTO bill_payments (user_id, from_account_id, payee_id, amount, reference) "
                "VALUES (:user, :acc, :payee, :amt, :ref)");
     bp.bindValue(":user", userId);
     bp.bindValue(":acc", fromAccountId);
     bp.bindValue(":payee", payeeId);
     bp.bindValue(":amt", amount);
-    bp.bindValue(":ref", QString("Online bill payment"));
-    if (!bp.exec()) { m_db.rollback(); return false; }
+    bp.bindValue(":ref", reference);
+    if (!SlowQueryLog::exec(bp)) return PostingResult::Failed;
+    return PostingResult::Ok;
+}
+
+bool DBManager::payBill(int userId, int fromAccountId, int payeeId, double amount) {
+    OpTimer timer("DBManager::payBill");
+    if (amount <= 0) return timer.finish(false);
+    ShardScope scope(shardForUser(userId));
+
+    if (!beginTransaction()) return timer.finish(false);
+    if (postBillPayment(userId, fromAccountId, payeeId, amount,
+                        QString("Online bill payment")) != PostingResult::Ok) {
+        rollbackTransaction();
+        return timer.finish(false);
+    }
+    return timer.finish(commitTransaction());
+}
 
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
-              "VALUES (:acc, 'Bill Payment', :amt, 'Bill payment to registered payee')");
-    t.bindValue(":acc", fromAccountId);
-    t.bindValue(":amt", amount);
-    t.exec();
+int DBManager::scheduleBillPayment(int userId, int fromAccountId, int payeeId,
+                                   double amount, const QString &frequency,
+                                   const QDate &firstDue) {
+    OpTimer timer("DBManager::scheduleBillPayment");
+    if (amount <= 0 || !firstDue.isValid()) return timer.finish(-1);
+    if (frequency != "Once" && frequency != "Weekly" && frequency != "Monthly") return timer.finish(-1);
+    ShardScope scope(shardForUser(userId));
+
+    // The schedule debits unattended, so the account must be the user's
+    QSqlQuery owner(database());
+    owner.prepare("SELECT 1 FROM accounts WHERE id = :acc AND user_id = :user");
+    owner.bindValue(":acc", fromAccountId);
+    owner.bindValue(":user", userId);
+    if (!SlowQueryLog::exec(owner) || !owner.next()) return timer.finish(-1);
+    owner.finish();
+
+    QSqlQuery q(database());
+    q.prepare("INSERT INTO scheduled_payments "
+              "(user_id, from_account_id, payee_id, amount, frequency, day_of_month, next_due) "
+              "VALUES (:user, :acc, :payee, :amt, :freq, :dom, :due)");
+    q.bindValue(":user", userId);
+    q.bindValue(":acc", fromAccountId);
+    q.bindValue(":payee", payeeId);
+    q.bindValue(":amt", amount);
+    q.bindValue(":freq", frequency);
+    q.bindValue(":dom", firstDue.day());
+    q.bindValue(":due", firstDue.toString("yyyy-MM-dd"));
+    if (!SlowQueryLog::exec(q)) {
+        qWarning() << "Failed to schedule bill payment:" << q.lastError().text();
+        return timer.finish(-1);
+    }
+    return timer.finish(q.lastInsertId().toInt());
+}
 
-    m_db.commit();
-    return true;
+bool DBManager::cancelScheduledPayment(int userId, int scheduleId) {
+    OpTimer timer("DBManager::cancelScheduledPayment");
+    ShardScope scope(shardForUser(userId));
+    QSqlQuery q(database());
+    q.prepare("UPDATE scheduled_payments SET status = 'Cancelled' "
+              "WHERE id = :id AND user_id = :user AND status = 'Active'");
+    q.bindValue(":id", scheduleId);
+    q.bindValue(":user", userId);
+    return timer.finish(SlowQueryLog::exec(q) && q.numRowsAffected() > 0);
 }
 
-bool DBManager::spendOnCard(int cardId, double amount) {
-    if (amount <= 0) return false;
+QDate DBManager::nextScheduledDate(const QString &frequency, const QDate &from,
+                                   int dayOfMonth, const QDate &after) {
+    // Rolls forward past 'after' so a long outage does not trigger a burst
+    // of back payments.
+    QDate next = from;
+    while (next <= after) {
+        if (frequency == "Weekly") {
+            next = next.addDays(7);
+        } else {
+            QDate firstOfNext = QDate(next.year(), next.month(), 1).addMonths(1);
+            int day = qMin(dayOfMonth, firstOfNext.daysInMonth());
+            next = QDate(firstOfNext.year(), firstOfNext.month(), day);
+        }
+    }
+    return next;
+}
 
-    // Check limit
-    QSqlQuery q(m_db);
-    q.prepare("SELECT credit_limit, current_balance FROM credit_cards WHERE id = :id");
-    q.bindValue(":id", cardId);
-    if (!q.exec() || !q.next()) return false;
+ScheduledRunStats DBManager::runDueScheduledPayments(const QDate &asOf, int userId) {
+    OpTimer opTimer("DBManager::runDueScheduledPayments");
+    ScheduledRunStats stats;
+    QElapsedTimer timer;
+    timer.start();
 
-    double limit = q.value(0).toDouble();
-    double bal   = q.value(1).toDouble();
+    if (userId > 0) {
+        runDueScheduledPaymentsOnShard(shardForUser(userId), asOf, userId, stats);
+    } else {
+        for (int shard = 0; shard < m_shardCount; ++shard) {
+            runDueScheduledPaymentsOnShard(shard, asOf, userId, stats);
+        }
+    }
 
-    if (bal + amount > limit) {
-        return false; // would exceed limit
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+void DBManager::runDueScheduledPaymentsOnShard(int shard, const QDate &asOf, int userId,
+                                               ScheduledRunStats &stats) {
+    ShardScope scope(shard);
+    const QString asOfText = asOf.toString("yyyy-MM-dd");
+    const QString retryDate = asOf.addDays(qMax(1, scheduledRetryDelayDays)).toString("yyyy-MM-dd");
+    const int chunkSize = 1000;
+
+    QSqlQuery due(database());
+    due.setForwardOnly(true);
+    due.prepare(QString("SELECT id, user_id, from_account_id, payee_id, amount, frequency, "
+                        "day_of_month, COALESCE(cycle_due, next_due), retry_count FROM scheduled_payments "
+                        "WHERE status = 'Active' AND next_due <= :asof %1"
+                        "ORDER BY next_due LIMIT :n")
+                    .arg(userId > 0 ? "AND user_id = :user " : ""));
+
+    QSqlQuery advance(database());
+    advance.prepare("UPDATE scheduled_payments SET next_due = :due, retry_count = :retries, "
+                    "status = :status, cycle_due = :cycle WHERE id = :id");
+
+    QSqlQuery savepoint(database());
+
+    // Every processed row leaves the due set (paid, retried later or
+    // closed), so the loop always drains.
+    while (true) {
+        struct DueItem {
+            int id, userId, accountId, payeeId, dayOfMonth, retries;
+            double amount;
+            QString frequency;
+            QDate nextDue;
+        };
+        std::vector<DueItem> batch;
+        batch.reserve(chunkSize);
+
+        due.bindValue(":asof", asOfText);
+        due.bindValue(":n", chunkSize);
+        if (userId > 0) due.bindValue(":user", userId);
+        if (!SlowQueryLog::exec(due)) {
+            qWarning() << "Scheduled payment scan failed:" << due.lastError().text();
+            break;
+        }
+        while (due.next()) {
+            batch.push_back({due.value(0).toInt(), due.value(1).toInt(), due.value(2).toInt(),
+                             due.value(3).toInt(), due.value(6).toInt(), due.value(8).toInt(),
+                             due.value(4).toDouble(), due.value(5).toString(),
+                             QDate::fromString(due.value(7).toString(), "yyyy-MM-dd")});
+        }
+        due.finish();
+        if (batch.empty()) break;
+        stats.due += static_cast<int>(batch.size());
+
+        // One commit per chunk; each payment gets its own savepoint so a
+        // failure only undoes that payment.
+        if (!beginTransaction()) {
+            qWarning() << "Cannot start scheduled payment transaction";
+            return;
+        }
+        for (const DueItem &item : batch) {
+            SlowQueryLog::exec(savepoint, "SAVEPOINT scheduled_payment");
+            PostingResult r = postBillPayment(item.userId, item.accountId, item.payeeId,
+                                              item.amount, QString("Scheduled bill payment"));
+            if (r == PostingResult::Ok) {
+                SlowQueryLog::exec(savepoint, "RELEASE scheduled_payment");
+            } else {
+                SlowQueryLog::exec(savepoint, "ROLLBACK TO scheduled_payment");
+                SlowQueryLog::exec(savepoint, "RELEASE scheduled_payment");
+            }
+
+            // Only a shortfall is worth retrying; a missing account or a
+            // database error would fail the same way every time
+            QString nextDue;
+            QString status = "Active";
+            QVariant cycleDue;
+            int retries = 0;
+            if (r == PostingResult::Ok) {
+                ++stats.paid;
+            } else if (r == PostingResult::InsufficientFunds && item.retries < scheduledMaxRetries) {
+                ++stats.retried;
+                retries = item.retries + 1;
+                nextDue = retryDate;
+                cycleDue = item.nextDue.toString("yyyy-MM-dd");
+            } else {
+                ++stats.failed;
+                if (r == PostingResult::Failed) {
+                    status = "Failed";
+                    nextDue = item.nextDue.toString("yyyy-MM-dd");
+                }
+            }
+
+            // Later cycles follow the original due date, not the retry date
+            if (nextDue.isEmpty()) {
+                if (item.frequency == "Once") {
+                    status = (r == PostingResult::Ok) ? "Completed" : "Failed";
+                    nextDue = item.nextDue.toString("yyyy-MM-dd");
+                } else {
+                    nextDue = nextScheduledDate(item.frequency, item.nextDue,
+                                                item.dayOfMonth, asOf).toString("yyyy-MM-dd");
+                }
+            }
+
+            advance.bindValue(":due", nextDue);
+            advance.bindValue(":retries", retries);
+            advance.bindValue(":status", status);
+            advance.bindValue(":cycle", cycleDue);
+            advance.bindValue(":id", item.id);
+            if (!SlowQueryLog::exec(advance)) {
+                // The row would stay due forever; undo the chunk and stop.
+                qWarning() << "Failed to advance schedule" << item.id << ":"
+                           << advance.lastError().text();
+                rollbackTransaction();
+                return;
+            }
+        }
+        if (!commitTransaction()) {
+            // Uncommitted rows are still due and would be picked up again
+            qWarning() << "Scheduled payment commit failed";
+            rollbackTransaction();
+            return;
+        }
     }
+}
 
-    QSqlQuery upd(m_db);
-    upd.prepare("UPDATE credit_cards SET current_balance = current_balance + :amt WHERE id = :id");
-    upd.bindValue(":amt", amount);
-    upd.bindValue(":id", cardId);
-    return upd.exec();
+bool DBManager::spendOnCard(int cardId, double amount) {
+    OpTimer timer("DBManager::spendOnCard");
+    if (amount <= 0) return timer.finish(false);
+    ShardScope scope(shardForAccount(cardId));
+
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Card, cardId, amount, [&]() {
+        // Limit check and update in one statement
+        QSqlQuery upd(database());
+        upd.prepare("UPDATE credit_cards SET current_balance = current_balance + :amt "
+                    "WHERE id = :id AND current_balance + :amt <= credit_limit");
+        upd.bindValue(":amt", amount);
+        upd.bindValue(":id", cardId);
+        return SlowQueryLog::exec(upd) && upd.numRowsAffected() == 1;
+    }));
 }
 
 bool DBManager::payCreditCard(int userId, int fromAccountId, int cardId, double amount) {
-    if (amount <= 0) return false;
-
-    m_db.transaction();
+    OpTimer timer("DBManager::payCreditCard");
+    if (amount <= 0) return timer.finish(false);
+    ShardScope scope(shardForUser(userId));
 
-    // Check account balance
-    QSqlQuery balQ(m_db);
-    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
-    balQ.bindValue(":id", fromAccountId);
-    if (!balQ.exec() || !balQ.next()) {
-        m_db.rollback();
-        return false;
-    }
-    double balance = balQ.value(0).toDouble();
-    if (balance < amount) {
-        m_db.rollback();
-        return false;
-    }
+    if (!beginTransaction()) return timer.finish(false);
 
-    // Check card balance
-    QSqlQuery cardQ(m_db);
-    cardQ.prepare("SELECT current_balance FROM credit_cards WHERE id = :id AND user_id = :user");
+    // Capped to what is owed on the card; nothing owed, nothing to pay
+    QSqlQuery cardQ(database());
+    cardQ.prepare("SELECT MIN(:amt, current_balance) FROM credit_cards "
+                  "WHERE id = :id AND user_id = :user AND current_balance > 0");
+    cardQ.bindValue(":amt", amount);
     cardQ.bindValue(":id", cardId);
     cardQ.bindValue(":user", userId);
-    if (!cardQ.exec() || !cardQ.next()) {
-        m_db.rollback();
-        return false;
+    if (!SlowQueryLog::exec(cardQ) || !cardQ.next()) {
+        rollbackTransaction();
+        return timer.finish(false);
+    }
+    amount = cardQ.value(0).toDouble();
+    cardQ.finish();
+    if (amount <= 0) {
+        rollbackTransaction();
+        return timer.finish(false);
     }
-    double cardBal = cardQ.value(0).toDouble();
-    if (amount > cardBal) amount = cardBal; // cap to outstanding
 
-    // Debit account
-    QSqlQuery updAcc(m_db);
-    updAcc.prepare("UPDATE accounts SET balance = balance - :amt WHERE id = :id");
-    updAcc.bindValue(":amt", amount);
-    updAcc.bindValue(":id", fromAccountId);
-    if (!updAcc.exec()) {
-        m_db.rollback();
-        return false;
+    // Debit the account, recorded as a transaction on it
+    if (post({fromAccountId, -amount, "Credit Card Payment", "Payment to credit card"}) != PostingResult::Ok) {
+        rollbackTransaction();
+        return timer.finish(false);
     }
 
     // Credit card
-    QSqlQuery updCard(m_db);
-    updCard.prepare("UPDATE credit_cards SET current_balance = current_balance - :amt WHERE id = :id");
+    QSqlQuery updCard(database());
+    updCard.prepare("UPDATE credit_cards SET current_balance = current_balance - :amt, "
+                    "paid_since_statement = paid_since_statement + :amt WHERE id = :id");
     updCard.bindValue(":amt", amount);
     updCard.bindValue(":id", cardId);
-    if (!updCard.exec()) {
-        m_db.rollback();
-        return false;
+    if (!SlowQueryLog::exec(updCard)) {
+        rollbackTransaction();
+        return timer.finish(false);
     }
 
-    // Record as a transaction on the bank account
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
-              "VALUES (:acc, 'Credit Card Payment', :amt, 'Payment to credit card')");
-    t.bindValue(":acc", fromAccountId);
-    t.bindValue(":amt", amount);
-    t.exec();
-
-    m_db.commit();
-    return true;
+    if (!commitTransaction()) {
+        rollbackTransaction();
+        return timer.finish(false);
+    }
+    return timer.finish(true);
 }
 
-void DBManager::applyMonthlyInterestInternal(int accountId,
+bool DBManager::applyMonthlyInterestInternal(int accountId,
                                              double interestRate,
                                              const QDate &lastApplied,
                                              const QDate &today) {
-    if (interestRate <= 0.0) return;
-    if (!lastApplied.isValid()) return;
+    if (interestRate <= 0.0) return false;
+    if (!lastApplied.isValid()) return false;
 
     int monthsDiff = (lastApplied.daysTo(today)) / 30;
-    if (monthsDiff <= 0) return;
-
-    QSqlQuery balQ(m_db);
-    balQ.prepare("SELECT balance FROM accounts WHERE id = :id");
-    balQ.bindValue(":id", accountId);
-    if (!balQ.exec() || !balQ.next()) return;
-    double balance = balQ.value(0).toDouble();
+    if (monthsDiff <= 0) return false;
 
-    double monthlyRate = interestRate / 12.0;
+    double factor = 1.0;
+    const double monthlyRate = interestRate / 12.0;
     for (int i = 0; i < monthsDiff; ++i) {
-        balance += balance * monthlyRate;
+        factor *= 1.0 + monthlyRate;
     }
 
-    QSqlQuery upd(m_db);
-    upd.prepare("UPDATE accounts SET balance = :bal, last_interest_applied = :last WHERE id = :id");
-    upd.bindValue(":bal", balance);
+    if (!beginTransaction()) return false;
+    QSqlQuery upd(database());
+    upd.prepare("UPDATE accounts SET balance = balance * :factor, last_interest_applied = :last "
+                "WHERE id = :id RETURNING balance");
+    upd.bindValue(":factor", factor);
     upd.bindValue(":last", today.toString("yyyy-MM-dd"));
     upd.bindValue(":id", accountId);
-    upd.exec();
+    if (!SlowQueryLog::exec(upd) || !upd.next()) {
+        rollbackTransaction();
+        return false;
+    }
+    const double balance = upd.value(0).toDouble();
+    upd.finish();
 
-    // Record transaction
-    QSqlQuery t(m_db);
-    t.prepare("INSERT INTO transactions (account_id, type, amount, description) "
-              "VALUES (:acc, 'Interest', 0, 'Monthly interest credited')");
+    // Record transaction with the amount credited
+    QSqlQuery t(database());
+    t.prepare("INSERT INTO transactions (account_id, type, amount, description, balance_after) "
+              "VALUES (:acc, 'Interest', :amt, 'Monthly interest credited', :balance)");
     t.bindValue(":acc", accountId);
-    t.exec();
+    t.bindValue(":amt", balance - balance / factor);
+    t.bindValue(":balance", balance);
+    if (!SlowQueryLog::exec(t) || !commitTransaction()) {
+        rollbackTransaction();
+        return false;
+    }
+    return true;
 }
 
 void DBManager::applyMonthlyInterestForUser(int userId) {
-    QSqlQuery q(m_db);
+    OpTimer timer("DBManager::applyMonthlyInterestForUser");
+    ShardScope scope(shardForUser(userId));
+    QSqlQuery q(database());
     q.prepare("SELECT id, interest_rate, last_interest_applied FROM accounts "
               "WHERE user_id = :user AND interest_rate > 0");
     q.bindValue(":user", userId);
-    if (!q.exec()) return;
+    if (!SlowQueryLog::exec(q)) return;
 
     QDate today = QDate::currentDate();
     while (q.next()) {
@@ -623,3 +1694,623 @@ void DBManager::applyMonthlyInterestForUser(int userId) {
         applyMonthlyInterestInternal(accId, rate, last, today);
     }
 }
+
+int DBManager::applyMonthlyInterestForAllUsers() {
+    OpTimer timer("DBManager::applyMonthlyInterestForAllUsers");
+    struct Due { int id; double rate; QDate last; };
+    const QDate today = QDate::currentDate();
+    const int commitEvery = 1000;
+    int credited = 0;
+
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        ShardScope scope(shard);
+        std::vector<Due> due;
+
+        QSqlQuery q(database());
+        q.setForwardOnly(true);
+        q.prepare("SELECT id, interest_rate, last_interest_applied FROM accounts "
+                  "WHERE interest_rate > 0 AND last_interest_applied <= :cutoff");
+        q.bindValue(":cutoff", today.addDays(-30).toString("yyyy-MM-dd"));
+        if (!SlowQueryLog::exec(q)) continue;
+        while (q.next()) {
+            due.push_back({q.value(0).toInt(), q.value(1).toDouble(),
+                           QDate::fromString(q.value(2).toString(), "yyyy-MM-dd")});
+        }
+        q.finish();
+
+        // Counted once committed; a failed commit stops this shard
+        int posted = 0;
+        bool open = beginBatch();
+        for (size_t i = 0; open && i < due.size(); ++i) {
+            if (applyMonthlyInterestInternal(due[i].id, due[i].rate, due[i].last, today)) ++posted;
+            if ((i + 1) % commitEvery == 0 && i + 1 < due.size()) {
+                open = commitBatch();
+                if (open) credited += posted;
+                posted = 0;
+                if (open) open = beginBatch();
+            }
+        }
+        if (open && commitBatch()) {
+            credited += posted;
+        } else {
+            qWarning() << "Monthly interest stopped on shard" << shard << ": a batch failed to start or commit";
+        }
+    }
+    return timer.finish(credited);
+}
+
+StatementCloseStats DBManager::closeMonthlyStatements(const QDate &asOf, int userId) {
+    OpTimer opTimer("DBManager::closeMonthlyStatements");
+    StatementCloseStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // Every month before asOf's is complete
+    const QString throughPeriod = asOf.addMonths(-1).toString("yyyy-MM");
+    const int commitEvery = 500;
+    struct Open { int id; QString period; double closing; qint64 lastId; };
+
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        if (userId >= 0 && shard != shardForUser(userId)) continue;
+        ShardScope scope(shard);
+
+        // Each account with its latest statement, if any
+        std::vector<Open> accounts;
+        QSqlQuery q(database());
+        q.setForwardOnly(true);
+        q.prepare("SELECT a.id, COALESCE(h.period, ''), COALESCE(h.closing_balance, 0), "
+                  "COALESCE(h.last_transaction_id, 0) "
+                  "FROM accounts a "
+                  "LEFT JOIN statement_headers h ON h.account_id = a.id AND h.period = "
+                  "(SELECT MAX(period) FROM statement_headers WHERE account_id = a.id) "
+                  "WHERE (:user < 0 OR a.user_id = :user) "
+                  "AND COALESCE(h.period, '') < :through");
+        q.bindValue(":user", userId);
+        q.bindValue(":through", throughPeriod);
+        if (!SlowQueryLog::exec(q)) {
+            qWarning() << "Statement close failed:" << q.lastError().text();
+            continue;
+        }
+        while (q.next()) {
+            accounts.push_back({q.value(0).toInt(), q.value(1).toString(),
+                                q.value(2).toDouble(), q.value(3).toLongLong()});
+        }
+        q.finish();
+
+        // Counted once their chunk commits; a failed commit or begin
+        // rolls the chunk back and stops this shard
+        if (accounts.empty() || !beginTransaction()) continue;
+        StatementCloseStats chunk;
+        for (size_t i = 0; i < accounts.size(); ++i) {
+            const Open &a = accounts[i];
+            const int written = closeAccountStatements(a.id, a.period, a.closing, a.lastId, throughPeriod);
+            if (written > 0) {
+                ++chunk.accounts;
+                chunk.statements += written;
+            }
+            const bool last = i + 1 == accounts.size();
+            if (!last && (i + 1) % commitEvery != 0) continue;
+            if (!commitTransaction()) {
+                qWarning() << "Statement close commit failed on shard" << shard;
+                rollbackTransaction();
+                break;
+            }
+            stats.accounts += chunk.accounts;
+            stats.statements += chunk.statements;
+            chunk = StatementCloseStats();
+            if (!last && !beginTransaction()) break;
+        }
+    }
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+int DBManager::closeAccountStatements(int accountId, const QString &lastPeriod, double lastClosing,
+                                      qint64 lastTransactionId, const QString &throughPeriod) {
+    struct Month {
+        double credits = 0.0;
+        double debits = 0.0;
+        int count = 0;
+        qint64 lastId = 0;
+        QList<QPair<QString, QPair<double, int>>> byType;
+    };
+    QMap<QString, Month> months;
+
+    // Everything since the last statement, including the open month
+    QSqlQuery agg(database());
+    agg.setForwardOnly(true);
+    agg.prepare("SELECT substr(timestamp, 1, 7), type, SUM(amount), COUNT(*), MAX(id) "
+                "FROM transactions WHERE account_id = :acc AND id > :after "
+                "GROUP BY 1, 2");
+    agg.bindValue(":acc", accountId);
+    agg.bindValue(":after", lastTransactionId);
+    if (!SlowQueryLog::exec(agg)) return 0;
+    while (agg.next()) {
+        Month &m = months[agg.value(0).toString()];
+        const QString type = agg.value(1).toString();
+        const double amount = agg.value(2).toDouble();
+        (creditsAccount(type) ? m.credits : m.debits) += amount;
+        m.count += agg.value(3).toInt();
+        m.lastId = qMax(m.lastId, agg.value(4).toLongLong());
+        m.byType.append({type, {amount, agg.value(3).toInt()}});
+    }
+    agg.finish();
+
+    QString period = lastPeriod;
+    double running = lastClosing;
+    if (period.isEmpty()) {
+        // First statement: the opening balance is today's balance less
+        // everything journalled since the account's first transaction
+        if (months.isEmpty()) return 0;
+        QSqlQuery bal(database());
+        bal.prepare("SELECT balance FROM accounts WHERE id = :id");
+        bal.bindValue(":id", accountId);
+        if (!SlowQueryLog::exec(bal) || !bal.next()) return 0;
+        running = bal.value(0).toDouble();
+        for (const Month &m : months) running -= m.credits - m.debits;
+        period = QDate::fromString(months.firstKey() + "-01", "yyyy-MM-dd").addMonths(-1).toString("yyyy-MM");
+    }
+
+    QSqlQuery header(database());
+    header.prepare("INSERT OR REPLACE INTO statement_headers "
+                   "(account_id, period, opening_balance, closing_balance, total_credits, total_debits, "
+                   "transaction_count, after_transaction_id, last_transaction_id) "
+                   "VALUES (:acc, :period, :open, :close, :cr, :dr, :n, :after, :last)");
+    QSqlQuery totals(database());
+    totals.prepare("INSERT OR REPLACE INTO statement_totals (account_id, period, type, amount, count) "
+                   "VALUES (:acc, :period, :type, :amt, :n)");
+
+    QSqlQuery savepoint(database());
+
+    // One statement per month up to throughPeriod, quiet months included.
+    // A month's header and totals are written together or not at all.
+    int written = 0;
+    qint64 afterId = lastTransactionId;
+    QDate month = QDate::fromString(period + "-01", "yyyy-MM-dd").addMonths(1);
+    for (; month.toString("yyyy-MM") <= throughPeriod; month = month.addMonths(1)) {
+        const QString key = month.toString("yyyy-MM");
+        const Month m = months.value(key);
+        const double opening = running;
+        running += m.credits - m.debits;
+        const qint64 lastId = m.count > 0 ? m.lastId : afterId;
+
+        header.bindValue(":acc", accountId);
+        header.bindValue(":period", key);
+        header.bindValue(":open", opening);
+        header.bindValue(":close", running);
+        header.bindValue(":cr", m.credits);
+        header.bindValue(":dr", m.debits);
+        header.bindValue(":n", m.count);
+        header.bindValue(":after", afterId);
+        header.bindValue(":last", lastId);
+        SlowQueryLog::exec(savepoint, "SAVEPOINT statement_month");
+        if (!SlowQueryLog::exec(header)) {
+            qWarning() << "Failed to write statement header:" << header.lastError().text();
+            SlowQueryLog::exec(savepoint, "ROLLBACK TO statement_month");
+            SlowQueryLog::exec(savepoint, "RELEASE statement_month");
+            return written;
+        }
+        for (const auto &type : m.byType) {
+            totals.bindValue(":acc", accountId);
+            totals.bindValue(":period", key);
+            totals.bindValue(":type", type.first);
+            totals.bindValue(":amt", type.second.first);
+            totals.bindValue(":n", type.second.second);
+            if (!SlowQueryLog::exec(totals)) {
+                qWarning() << "Failed to write statement totals:" << totals.lastError().text();
+                SlowQueryLog::exec(savepoint, "ROLLBACK TO statement_month");
+                SlowQueryLog::exec(savepoint, "RELEASE statement_month");
+                return written;
+            }
+        }
+        SlowQueryLog::exec(savepoint, "RELEASE statement_month");
+        afterId = lastId;
+        ++written;
+    }
+    return written;
+}
+
+QStringList DBManager::statementPeriods(int accountId) {
+    QStringList periods;
+    QSqlQuery q(readDatabase(shardForAccount(accountId)));
+    q.prepare("SELECT period FROM statement_headers WHERE account_id = :acc ORDER BY period DESC");
+    q.bindValue(":acc", accountId);
+    if (SlowQueryLog::exec(q)) {
+        while (q.next()) periods << q.value(0).toString();
+    }
+    return periods;
+}
+
+StatementHeader DBManager::statementHeader(int accountId, const QString &period) {
+    OpTimer timer("DBManager::statementHeader");
+    StatementHeader header;
+    const QSqlDatabase db = readDatabase(shardForAccount(accountId));
+    QSqlQuery q(db);
+    q.prepare("SELECT opening_balance, closing_balance, total_credits, total_debits, "
+              "transaction_count, after_transaction_id, last_transaction_id "
+              "FROM statement_headers WHERE account_id = :acc AND period = :period");
+    q.bindValue(":acc", accountId);
+    q.bindValue(":period", period);
+    if (!SlowQueryLog::exec(q) || !q.next()) return header;
+
+    header.accountId = accountId;
+    header.period = period;
+    header.openingBalance = q.value(0).toDouble();
+    header.closingBalance = q.value(1).toDouble();
+    header.totalCredits = q.value(2).toDouble();
+    header.totalDebits = q.value(3).toDouble();
+    header.transactionCount = q.value(4).toInt();
+    header.afterTransactionId = q.value(5).toLongLong();
+    header.lastTransactionId = q.value(6).toLongLong();
+    q.finish();
+
+    QSqlQuery t(db);
+    t.prepare("SELECT type, amount FROM statement_totals "
+              "WHERE account_id = :acc AND period = :period ORDER BY amount DESC");
+    t.bindValue(":acc", accountId);
+    t.bindValue(":period", period);
+    if (SlowQueryLog::exec(t)) {
+        while (t.next()) header.totalsByType.append({t.value(0).toString(), t.value(1).toDouble()});
+    }
+    return header;
+}
+
+bool DBManager::accountBalances(int userId, RowSet<AccountBalanceRow> *rows) {
+    OpTimer timer("DBManager::accountBalances");
+    return timer.finish(TypedQuery::select(readDatabase(shardForUser(userId)),
+                                           "SELECT id, account_number, type, balance, interest_rate "
+                                           "FROM accounts WHERE user_id = ?1 ORDER BY id",
+                                           rows, userId));
+}
+
+bool DBManager::statementPage(int accountId, qint64 beforeId, int size, RowSet<StatementRow> *rows) {
+    OpTimer timer("DBManager::statementPage");
+    const qint64 before = beforeId > 0 ? beforeId : std::numeric_limits<qint64>::max();
+    return timer.finish(TypedQuery::select(readDatabase(shardForAccount(accountId)),
+                                           "SELECT id, timestamp, type, amount, description, balance_after "
+                                           "FROM transactions WHERE account_id = ?1 AND id < ?2 "
+                                           "ORDER BY id DESC LIMIT ?3",
+                                           rows, accountId, before, size));
+}
+
+RunningBalanceStats DBManager::rebuildRunningBalances(int threadCount, bool missingOnly) {
+    OpTimer opTimer("DBManager::rebuildRunningBalances");
+    RunningBalanceStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    if (threadCount <= 0) threadCount = QThread::idealThreadCount();
+
+    // Each shard's account-ID range is split into threadCount slices
+    struct Slice { int shard; qint64 lo; qint64 hi; };
+    std::vector<Slice> slices;
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        QSqlQuery range(shardDatabase(shard));
+        if (!SlowQueryLog::exec(range, "SELECT MIN(id), MAX(id) FROM accounts") || !range.next()
+            || range.value(0).isNull()) {
+            continue;
+        }
+        const qint64 minId = range.value(0).toLongLong();
+        const qint64 maxId = range.value(1).toLongLong();
+        range.finish();
+
+        const qint64 span = maxId - minId + 1;
+        const qint64 pieces = qMin<qint64>(threadCount, span);
+        const qint64 perWorker = (span + pieces - 1) / pieces;
+        for (qint64 w = 0; w < pieces; ++w) {
+            const qint64 lo = minId + w * perWorker;
+            const qint64 hi = qMin(maxId, lo + perWorker - 1);
+            if (lo > hi) break;
+            slices.push_back({shard, lo, hi});
+        }
+    }
+    if (slices.empty()) return stats;
+
+    const int accountsPerChunk = 200;
+
+    // Workers read and compute in parallel and take turns writing to each
+    // shard. A row's balance is the account balance at the read snapshot
+    // less every later posting, so rows posted meanwhile (which stamp their
+    // own balance) do not invalidate it.
+    std::unique_ptr<QMutex[]> writeLocks(new QMutex[m_shardCount]);
+    std::atomic<int> accountsDone{0};
+    std::atomic<qint64> rowsDone{0};
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount * m_shardCount);
+
+    for (size_t w = 0; w < slices.size(); ++w) {
+        const qint64 lo = slices[w].lo;
+        const qint64 hi = slices[w].hi;
+        QMutex &writeLock = writeLocks[slices[w].shard];
+        const int shard = slices[w].shard;
+
+        pool.start([=, &writeLock, &accountsDone, &rowsDone]() {
+            const QString connName = QString("bluebank_balances_%1").arg(w);
+            {
+                QSqlDatabase db = openWorkerConnection(connName, shard);
+                QVariantList ids;
+                QVariantList balances;
+
+                for (qint64 first = lo; first <= hi; first += accountsPerChunk) {
+                    const qint64 last = qMin(hi, first + accountsPerChunk - 1);
+                    ids.clear();
+                    balances.clear();
+                    int accounts = 0;
+
+                    if (!db.transaction()) { // read snapshot
+                        qWarning() << "Cannot start running balance read:" << db.lastError().text();
+                        break;
+                    }
+                    QSqlQuery acc(db);
+                    acc.setForwardOnly(true);
+                    acc.prepare("SELECT id, balance FROM accounts WHERE id BETWEEN :lo AND :hi");
+                    acc.bindValue(":lo", first);
+                    acc.bindValue(":hi", last);
+                    QHash<qint64, double> running;
+                    if (SlowQueryLog::exec(acc)) {
+                        while (acc.next()) running.insert(acc.value(0).toLongLong(), acc.value(1).toDouble());
+                    }
+                    acc.finish();
+
+                    // Newest first, walking each balance back through its history
+                    QSqlQuery rows(db);
+                    rows.setForwardOnly(true);
+                    rows.prepare(QString("SELECT id, account_id, type, amount FROM transactions "
+                                         "WHERE account_id BETWEEN :lo AND :hi %1"
+                                         "ORDER BY account_id DESC, id DESC")
+                                     .arg(missingOnly ? "AND account_id IN (SELECT account_id FROM transactions "
+                                                        "WHERE account_id BETWEEN :lo AND :hi "
+                                                        "AND balance_after IS NULL) " : ""));
+                    rows.bindValue(":lo", first);
+                    rows.bindValue(":hi", last);
+                    if (!SlowQueryLog::exec(rows)) {
+                        qWarning() << "Running balance read failed:" << rows.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    qint64 currentAccount = -1;
+                    double balance = 0.0;
+                    while (rows.next()) {
+                        const qint64 accountId = rows.value(1).toLongLong();
+                        if (accountId != currentAccount) {
+                            currentAccount = accountId;
+                            balance = running.value(accountId);
+                            ++accounts;
+                        }
+                        ids << rows.value(0);
+                        balances << balance;
+                        const double amount = rows.value(3).toDouble();
+                        balance -= creditsAccount(rows.value(2).toString()) ? amount : -amount;
+                    }
+                    rows.finish();
+                    if (!db.commit()) {
+                        qWarning() << "Running balance read failed to end:" << db.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    if (ids.isEmpty()) continue;
+
+                    QMutexLocker locker(&writeLock);
+                    if (!db.transaction()) {
+                        qWarning() << "Cannot start running balance update:" << db.lastError().text();
+                        break;
+                    }
+                    QSqlQuery upd(db);
+                    upd.prepare("UPDATE transactions SET balance_after = ? WHERE id = ?");
+                    upd.addBindValue(balances);
+                    upd.addBindValue(ids);
+                    if (!SlowQueryLog::execBatch(upd)) {
+                        qWarning() << "Running balance update failed:" << upd.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    if (!db.commit()) {
+                        qWarning() << "Running balance commit failed:" << db.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    locker.unlock();
+
+                    accountsDone += accounts;
+                    rowsDone += ids.size();
+                }
+                db.close();
+            }
+            QSqlDatabase::removeDatabase(connName);
+        });
+    }
+    pool.waitForDone();
+
+    stats.accounts = accountsDone.load();
+    stats.rows = rowsDone.load();
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+CardStatementTerms DBManager::statementTerms(double balance, double previousStatement,
+                                             double paidSinceStatement, double apr) {
+    CardStatementTerms terms;
+    const double carried = qMax(0.0, previousStatement - paidSinceStatement);
+    terms.interest = qMin(carried, qMax(0.0, balance)) * apr / 12.0;
+    terms.statementBalance = qMax(0.0, balance + terms.interest);
+
+    terms.minPayment = terms.statementBalance;
+    if (terms.statementBalance > 10.0) {
+        terms.minPayment = qMin(terms.statementBalance,
+                                qMax(10.0, terms.interest + terms.statementBalance * 0.01));
+    }
+    return terms;
+}
+
+CardCycleStats DBManager::closeCardBillingCycle(const QDate &statementDate, int threadCount) {
+    OpTimer opTimer("DBManager::closeCardBillingCycle");
+    CardCycleStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    if (threadCount <= 0) threadCount = QThread::idealThreadCount();
+
+    // Each shard's card-ID range is split into threadCount slices
+    struct Slice { int shard; qint64 lo; qint64 hi; };
+    std::vector<Slice> slices;
+    for (int shard = 0; shard < m_shardCount; ++shard) {
+        QSqlQuery range(shardDatabase(shard));
+        if (!SlowQueryLog::exec(range, "SELECT MIN(id), MAX(id) FROM credit_cards") || !range.next()
+            || range.value(0).isNull()) {
+            continue;
+        }
+        const qint64 minId = range.value(0).toLongLong();
+        const qint64 maxId = range.value(1).toLongLong();
+        range.finish();
+
+        const qint64 span = maxId - minId + 1;
+        const qint64 pieces = qMin<qint64>(threadCount, span);
+        const qint64 perWorker = (span + pieces - 1) / pieces;
+        for (qint64 w = 0; w < pieces; ++w) {
+            const qint64 lo = minId + w * perWorker;
+            const qint64 hi = qMin(maxId, lo + perWorker - 1);
+            if (lo > hi) break;
+            slices.push_back({shard, lo, hi});
+        }
+    }
+    if (slices.empty()) return stats;
+
+    const QString stmtDate = statementDate.toString("yyyy-MM-dd");
+    const QString dueDate = statementDate.addDays(21).toString("yyyy-MM-dd");
+    const int chunkSize = 5000;
+
+    // Each SQLite file has a single writer, so workers take turns on the
+    // same shard. A chunk is read, computed and written in one IMMEDIATE
+    // transaction: a purchase or payment committed meanwhile cannot be
+    // overwritten, and cards already closed for this date are skipped, so
+    // a re-run charges no interest twice.
+    std::unique_ptr<QMutex[]> writeLocks(new QMutex[m_shardCount]);
+    std::atomic<int> cardsClosed{0};
+    std::atomic<qint64> interestCents{0};
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount * m_shardCount);
+
+    for (size_t w = 0; w < slices.size(); ++w) {
+        const qint64 lo = slices[w].lo;
+        const qint64 hi = slices[w].hi;
+        QMutex &writeLock = writeLocks[slices[w].shard];
+        const int shard = slices[w].shard;
+
+        pool.start([=, &writeLock, &cardsClosed, &interestCents]() {
+            const QString connName = QString("bluebank_cycle_%1").arg(w);
+            {
+                QSqlDatabase db = openWorkerConnection(connName, shard);
+
+                struct CardStatement {
+                    qint64 id;
+                    double interest;
+                    double statementBalance;
+                    double minPayment;
+                };
+                std::vector<CardStatement> chunk;
+                chunk.reserve(chunkSize);
+
+                QSqlQuery read(db);
+                read.setForwardOnly(true);
+                read.prepare("SELECT id, current_balance, statement_balance, "
+                             "paid_since_statement, apr FROM credit_cards "
+                             "WHERE id > :lo AND id <= :hi AND status = 'Active' "
+                             "AND (last_statement_date IS NULL OR last_statement_date < :stmt) "
+                             "ORDER BY id LIMIT :n");
+                QSqlQuery upd(db);
+                upd.prepare("UPDATE credit_cards SET "
+                            "current_balance = current_balance + ?, "
+                            "statement_balance = ?, min_payment = ?, "
+                            "paid_since_statement = 0, "
+                            "last_statement_date = ?, payment_due_date = ? "
+                            "WHERE id = ? AND (last_statement_date IS NULL OR last_statement_date < ?)");
+                QSqlQuery txn(db);
+
+                qint64 lastId = lo - 1;
+                while (lastId < hi) {
+                    chunk.clear();
+
+                    QMutexLocker locker(&writeLock);
+                    if (!SlowQueryLog::exec(txn, "BEGIN IMMEDIATE")) {
+                        qWarning() << "Cannot start billing cycle transaction:" << txn.lastError().text();
+                        break;
+                    }
+                    read.bindValue(":lo", lastId);
+                    read.bindValue(":hi", hi);
+                    read.bindValue(":stmt", stmtDate);
+                    read.bindValue(":n", chunkSize);
+                    if (!SlowQueryLog::exec(read)) {
+                        qWarning() << "Billing cycle read failed:" << read.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    while (read.next()) {
+                        const qint64 id = read.value(0).toLongLong();
+                        const double balance = read.value(1).toDouble();
+                        const double prevStatement = read.value(2).toDouble();
+                        const double paid = read.value(3).toDouble();
+                        const double apr = read.value(4).toDouble();
+                        lastId = id;
+
+                        const CardStatementTerms terms = statementTerms(balance, prevStatement, paid, apr);
+                        chunk.push_back({id, terms.interest, terms.statementBalance, terms.minPayment});
+                    }
+                    read.finish();
+                    if (chunk.empty()) {
+                        db.rollback();
+                        break;
+                    }
+
+                    QVariantList ids, interests, statements, minimums;
+                    for (const CardStatement &c : chunk) {
+                        ids << c.id;
+                        interests << c.interest;
+                        statements << c.statementBalance;
+                        minimums << c.minPayment;
+                    }
+                    QVariantList dates, dues;
+                    for (size_t i = 0; i < chunk.size(); ++i) {
+                        dates << stmtDate;
+                        dues << dueDate;
+                    }
+
+                    upd.bindValue(0, interests);
+                    upd.bindValue(1, statements);
+                    upd.bindValue(2, minimums);
+                    upd.bindValue(3, dates);
+                    upd.bindValue(4, dues);
+                    upd.bindValue(5, ids);
+                    upd.bindValue(6, dates);
+                    if (!SlowQueryLog::execBatch(upd)) {
+                        qWarning() << "Billing cycle update failed:" << upd.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    if (!db.commit()) {
+                        qWarning() << "Billing cycle commit failed:" << db.lastError().text();
+                        db.rollback();
+                        break;
+                    }
+                    locker.unlock();
+
+                    qint64 cents = 0;
+                    for (const CardStatement &c : chunk) cents += qRound64(c.interest * 100.0);
+                    interestCents += cents;
+                    cardsClosed += static_cast<int>(chunk.size());
+                }
+                read.finish();
+                upd.finish();
+                db.close();
+            }
+            QSqlDatabase::removeDatabase(connName);
+        });
+    }
+    pool.waitForDone();
+
+    stats.cardsClosed = cardsClosed.load();
+    stats.totalInterest = interestCents.load() / 100.0;
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
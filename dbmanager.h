@@ -2,13 +2,133 @@
 #define DBMANAGER_H
 
 #include <QString>
+#include <QStringList>
 #include <QSqlDatabase>
 #include <QDateTime>
+#include <QList>
+#include <QPair>
+#include <initializer_list>
+#include <atomic>
+#include "typedquery.h"
+
+class QObject;
+class QThread;
+class QSqlQuery;
+
+// Result of one credit card billing-cycle run
+struct CardCycleStats {
+    int cardsClosed = 0;
+    double totalInterest = 0.0;
+    qint64 elapsedMs = 0;
+};
+
+// One card's statement as computed at the close of a billing cycle
+struct CardStatementTerms {
+    double interest = 0.0;
+    double statementBalance = 0.0;
+    double minPayment = 0.0;
+};
+
+// Result of one pass over the scheduled bill payments that are due
+struct ScheduledRunStats {
+    int due = 0;
+    int paid = 0;
+    int retried = 0;
+    int failed = 0;
+    qint64 elapsedMs = 0;
+};
+
+struct RunningBalanceStats {
+    int accounts = 0;
+    qint64 rows = 0;
+    qint64 elapsedMs = 0;
+};
+
+struct StatementCloseStats {
+    int accounts = 0;   // accounts that got at least one new statement
+    int statements = 0;
+    qint64 elapsedMs = 0;
+};
+
+// One closed monthly statement of an account. Its rows are the account's
+// transactions with afterTransactionId < id <= lastTransactionId.
+struct StatementHeader {
+    int accountId = 0;
+    QString period; // yyyy-MM
+    double openingBalance = 0.0;
+    double closingBalance = 0.0;
+    double totalCredits = 0.0;
+    double totalDebits = 0.0;
+    int transactionCount = 0;
+    qint64 afterTransactionId = 0;
+    qint64 lastTransactionId = 0;
+    QList<QPair<QString, double>> totalsByType;
+
+    bool isValid() const { return !period.isEmpty(); }
+};
+
+// One account of a client, as read by DBManager::accountBalances
+struct AccountBalanceRow {
+    qint64 id = 0;
+    TextRef number;
+    TextRef type;
+    double balance = 0.0;
+    double interestRate = 0.0;
+
+    using Columns = RowColumns<&AccountBalanceRow::id, &AccountBalanceRow::number, &AccountBalanceRow::type,
+                               &AccountBalanceRow::balance, &AccountBalanceRow::interestRate>;
+};
+
+// One transaction of a statement page (DBManager::statementPage)
+struct StatementRow {
+    qint64 id = 0;
+    TextRef timestamp;
+    TextRef type;
+    double amount = 0.0;
+    TextRef description;
+    std::optional<double> balanceAfter; // empty for rows not yet stamped
+
+    using Columns = RowColumns<&StatementRow::id, &StatementRow::timestamp, &StatementRow::type,
+                               &StatementRow::amount, &StatementRow::description, &StatementRow::balanceAfter>;
+};
 
 class DBManager {
 public:
-    static bool init(const QString &dbPath = "bank.db");
+    // shardCount 0 keeps the layout the database was created with (1 for a
+    // new database). The count cannot change once the database exists.
+    static bool init(const QString &dbPath = "bank.db", int shardCount = 0);
+    // True when the last init() created or upgraded tables; false when every
+    // file was already at the current schema version and no DDL ran
+    static bool schemaMigrated() { return m_schemaMigrated; }
+    // Developer option: adds the demo clients (Alice and Bob) once to a
+    // database without clients. Returns true if it seeded.
+    static bool seedSampleData();
+
+    // Sharding. With one shard everything lives in dbPath. With N shards,
+    // dbPath is the directory (logins, Interac registry, payees, FAQs) and
+    // each user's accounts, cards, transactions and schedules live in
+    // <name>.shard<k>.<ext>, k = shardForUser(userId). Account and card IDs
+    // are allocated in per-shard ranges so the ID alone locates the shard.
+    static int shardCount() { return m_shardCount; }
+    static int shardForUser(int userId);
+    static int shardForAccount(int accountId); // also works for card IDs
+    static QSqlDatabase directoryDatabase();
+    static QSqlDatabase shardDatabase(int shard);
+    static QSqlDatabase userDatabase(int userId) { return shardDatabase(shardForUser(userId)); }
+    // File of each shard, and every file in the layout (directory first)
+    static QString shardPath(const QString &dbPath, int shard);
+    static QStringList databaseFiles();
+
+    // Connection for the calling thread to the shard it is working on
+    // (shard 0 outside of DBManager operations)
     static QSqlDatabase database();
+    // Read-only connection for reporting queries on the calling thread. In
+    // WAL mode it reads a committed snapshot and never waits on postings.
+    // Falls back to the read-write connection when WAL is unavailable.
+    static QSqlDatabase readDatabase();
+    static QSqlDatabase readDatabase(int shard);
+    // Closes the calling worker thread's connections before the thread exits
+    static void releaseThreadConnection();
 
     // User management
     static bool createUser(const QString &email,
@@ -20,6 +140,8 @@ public:
 
     // Interest
     static void applyMonthlyInterestForUser(int userId);
+    // End-of-day run over every account; returns accounts credited
+    static int applyMonthlyInterestForAllUsers();
 
     // Accounts
     static int createAccount(int userId,
@@ -41,24 +163,209 @@ public:
     // Bill payment
     static bool payBill(int userId, int fromAccountId, int payeeId, double amount);
 
+    // Scheduled / recurring bill payments.
+    // frequency is "Once", "Weekly" or "Monthly". Returns schedule id or -1.
+    static int scheduleBillPayment(int userId, int fromAccountId, int payeeId,
+                                   double amount, const QString &frequency,
+                                   const QDate &firstDue);
+    static bool cancelScheduledPayment(int userId, int scheduleId);
+    // Executes every schedule due on or before asOf (userId -1 = all users).
+    static ScheduledRunStats runDueScheduledPayments(const QDate &asOf = QDate::currentDate(),
+                                                     int userId = -1);
+
+    // Month-end close: for every complete month before asOf's that an
+    // account has activity in (or a statement before), writes its header and
+    // per-type totals. Months already closed are skipped, so reruns are
+    // cheap. userId -1 closes every account.
+    static StatementCloseStats closeMonthlyStatements(const QDate &asOf = QDate::currentDate(),
+                                                      int userId = -1);
+    // Repair job: recomputes transactions.balance_after for every account
+    // from its current balance, accounts split across threadCount workers
+    // per shard (0 = one per core). missingOnly limits it to accounts with
+    // unstamped rows. Safe while postings continue.
+    static RunningBalanceStats rebuildRunningBalances(int threadCount = 0, bool missingOnly = false);
+
+    // Closed periods of an account, newest first, and one period's header
+    static QStringList statementPeriods(int accountId);
+    static StatementHeader statementHeader(int accountId, const QString &period);
+
+    // Hot reads, decoded straight into typed rows on the read connection.
+    // A user's accounts by ID, and up to 'size' transactions of an account
+    // older than beforeId (0 = the newest), newest first.
+    static bool accountBalances(int userId, RowSet<AccountBalanceRow> *rows);
+    static bool statementPage(int accountId, qint64 beforeId, int size, RowSet<StatementRow> *rows);
+
+    // Insufficient-funds retry policy for scheduled payments
+    static int scheduledMaxRetries;
+    static int scheduledRetryDelayDays;
+    // Next due date of a recurring schedule strictly after 'after'
+    static QDate nextScheduledDate(const QString &frequency, const QDate &from,
+                                   int dayOfMonth, const QDate &after);
+
     // Credit card operations
     static bool spendOnCard(int cardId, double amount);
     static bool payCreditCard(int userId, int fromAccountId, int cardId, double amount);
 
+    // Credit card billing cycle: closes the statement for every card.
+    // Work is split by card-ID range across threadCount workers
+    // (0 = one per core).
+    static CardCycleStats closeCardBillingCycle(const QDate &statementDate = QDate::currentDate(),
+                                                int threadCount = 0);
+    // Interest is charged only on the part of the previous statement left unpaid
+    static CardStatementTerms statementTerms(double balance, double previousStatement,
+                                             double paidSinceStatement, double apr);
+
+    // Statement search: runs on q (opened on the caller's connection) a page
+    // of the account's transactions matching every word of text by prefix,
+    // in descriptions, Interac emails, payee names and amounts. Newest
+    // first, through the FTS5 index or with LIKE when the SQLite build has
+    // no FTS5. Words shorter than searchMinWordLength are ignored; with
+    // none left there is no search and it returns false.
+    static constexpr int searchMinWordLength = 2;
+    static bool searchTransactions(QSqlQuery &q, int accountId, const QString &text,
+                                   int limit, int offset);
+    static bool searchIndexed() { return m_searchIndexed; }
+
+    // Batching: groups many operations into one transaction. Postings
+    // inside a batch run as savepoints. Batches nest.
+    static bool beginBatch();
+    static bool commitBatch();
+    static void rollbackBatch();
+    static bool inBatch() { return m_batchDepth > 0; }
+
+    // Finishes interrupted cross-shard transfers: decided ones are rolled
+    // forward, undecided ones whose owner no longer holds the shard locks
+    // are aborted. Runs from init() and, in long-running processes, on the
+    // timer started by scheduleTransferRecovery(); returns the number of
+    // transfers resolved.
+    static int recoverShardTransfers();
+    static void scheduleTransferRecovery(QObject *parent, int intervalMs = 60000);
+
+    // Postings (and their BEGIN/COMMIT) run as NativeStatements unless
+    // this is turned off, which sends them back through QSqlQuery
+    static bool nativePostings() { return m_nativePostings.load(std::memory_order_relaxed); }
+    static void setNativePostings(bool on) { m_nativePostings.store(on, std::memory_order_relaxed); }
+
+    // Transaction types that add to the balance; every other type debits it
+    static const QStringList &creditTypes();
+    static bool creditsAccount(const QString &type);
+    // "<column> IN ('Deposit', ...)" over creditTypes(), for SQL
+    static QString creditTypeCondition(const QString &column);
+
     // Helpers
     static QString generateAccountNumber();
     static QString generateCardNumber();
 
 private:
-    static void createTablesIfNeeded();
-    static void createSampleDataIfEmpty();
-    static void applyMonthlyInterestInternal(int accountId,
+    enum class PostingResult { Ok, InsufficientFunds, Failed };
+
+    // One journalled balance change. delta < 0 debits the account.
+    struct Posting {
+        int accountId = 0;
+        double delta = 0.0;
+        const char *type = "";
+        const char *description = "";
+        int relatedAccountId = 0;
+        int payeeId = 0;
+        QString interacEmail;
+        qint64 transferIntent = 0;
+    };
+
+    // Routes database() on this thread to one shard for the scope's lifetime
+    struct ShardScope {
+        explicit ShardScope(int shard) : m_previous(m_currentShard) { m_currentShard = shard; }
+        ~ShardScope() { m_currentShard = m_previous; }
+        int m_previous;
+    };
+
+    static bool openFile(const QString &connectionName, const QString &path);
+    static QSqlDatabase connection(int shard, bool readOnly);
+    // Returns true if the file was below the current schema version
+    static bool createTablesIfNeeded(bool directory, bool shard);
+    static void createTables(bool directory, bool shard);
+    static void createSearchIndex();
+    static QString searchMatchExpression(const QString &text);
+    static bool beginTransaction(QSqlDatabase db = database());
+    static bool commitTransaction(QSqlDatabase db = database());
+    static void rollbackTransaction(QSqlDatabase db = database());
+    // Updates the balance and journals the posting on the current shard,
+    // inside the caller's transaction: one conditional UPDATE ... RETURNING
+    // and one INSERT. With checkFunds, a debit the balance cannot cover
+    // changes nothing and returns InsufficientFunds.
+    static PostingResult post(const Posting &posting, bool checkFunds = true);
+    static PostingResult postThroughQtSql(const Posting &posting, bool checkFunds);
+    // The postings as one transaction on the current shard
+    static bool postAll(std::initializer_list<Posting> postings);
+    static Posting transferPosting(int accountId, int relatedAccountId, double delta,
+                                   const QString &interacEmail, qint64 intentId);
+    // Plain transfer, or an Interac transfer when interacEmail is set
+    static bool transferBetween(int fromAccountId, int toAccountId, double amount,
+                                const QString &interacEmail);
+    static bool crossShardTransfer(int fromAccountId, int toAccountId, double amount,
+                                   const QString &interacEmail);
+    static bool postTransferLeg(int accountId, int relatedAccountId, double delta,
+                                qint64 intentId, bool checkFunds, const QString &interacEmail);
+    static bool setTransferStatus(const QList<qint64> &intentIds, const QString &from,
+                                  const QString &to);
+    struct TransferIntent {
+        qint64 id;
+        int from;
+        int to;
+        double amount;
+        QString email;
+    };
+    // Applies whichever legs of a decided transfer are missing and marks it done
+    static bool completeTransfer(const TransferIntent &intent);
+    // True while another connection holds the shard's write lock
+    static bool shardWriteLocked(int shard);
+    static void seedReferenceData();
+    static void ensureColumn(const QString &table,
+                             const QString &column,
+                             const QString &definition);
+    static QSqlDatabase openWorkerConnection(const QString &name, int shard = 0);
+    // Bill posting without transaction control; callers own the transaction
+    static PostingResult postBillPayment(int userId, int fromAccountId, int payeeId,
+                                         double amount, const QString &reference);
+    static void runDueScheduledPaymentsOnShard(int shard, const QDate &asOf, int userId,
+                                               ScheduledRunStats &stats);
+    static int closeAccountStatements(int accountId, const QString &lastPeriod,
+                                      double lastClosing, qint64 lastTransactionId,
+                                      const QString &throughPeriod);
+    // True if interest was credited (into the open batch, if any)
+    static bool applyMonthlyInterestInternal(int accountId,
                                              double interestRate,
                                              const QDate &lastApplied,
                                              const QDate &today);
 
     static QSqlDatabase m_db;
     static int m_nextAccountSeed;
+    static QThread *m_ownerThread;
+    static bool m_walEnabled;
+    static bool m_searchIndexed;
+    static bool m_schemaMigrated;
+    static std::atomic<bool> m_nativePostings;
+    static int m_shardCount;
+    static thread_local int m_batchDepth;
+    static thread_local int m_currentShard;
+    // Cross-shard transfers waiting for the enclosing batch to commit
+    static thread_local QList<qint64> m_batchIntents;
+};
+
+// Holds one read transaction on the calling thread's read connection, so
+// every query on the snapshot's database() sees the same committed state. Finish queries before the snapshot goes out of scope.
+class ReadSnapshot {
+public:
+    ReadSnapshot();
+    explicit ReadSnapshot(int shard);
+    ~ReadSnapshot();
+    ReadSnapshot(const ReadSnapshot &) = delete;
+    ReadSnapshot &operator=(const ReadSnapshot &) = delete;
+
+    QSqlDatabase database() const { return m_db; }
+
+private:
+    QSqlDatabase m_db;
+    bool m_open = false;
 };
 
 #endif // DBMANAGER_H
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "httpserver.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QPointer>
+#include <QSemaphore>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QDebug>
+
+namespace {
+
+constexpr int kMaxHeaderBytes = 16 * 1024;
+constexpr int kMaxBodyBytes = 1024 * 1024;
+constexpr int kMaxPipelined = 64;
+constexpr int kIdleTimeoutMs = 30000;
+
+QByteArray reasonPhrase(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
+    }
+}
+
+} // namespace
+
+HttpServer::HttpServer(HttpHandler handler, int workers, int maxQueued, QObject *parent)
+    : QObject(parent),
+      m_handler(std::move(handler)),
+      m_idleSweep(new QTimer(this)),
+      m_maxQueued(qMax(1, maxQueued)) {
+    m_pool.setMaxThreadCount(qMax(1, workers));
+    // Worker threads hold a database connection; keep them for the
+    // lifetime of the server instead of letting them expire. The
+    // connections are released by the worker cleanup when it stops.
+    m_pool.setExpiryTimeout(-1);
+
+    connect(&m_server, &QTcpServer::newConnection, this, &HttpServer::onNewConnection);
+    connect(m_idleSweep, &QTimer::timeout, this, &HttpServer::sweepIdleConnections);
+    m_idleSweep->start(1000);
+}
+
+HttpServer::~HttpServer() {
+    m_server.close();
+    m_pool.waitForDone();
+    cleanUpWorkers();
+    qDeleteAll(m_connections);
+}
+
+void HttpServer::cleanUpWorkers() {
+    if (!m_workerCleanup) return;
+    // One task per worker, each held until all have started, so every
+    // thread the pool has (or could have) runs exactly one of them
+    const int workers = m_pool.maxThreadCount();
+    QSemaphore started;
+    QSemaphore release;
+    for (int i = 0; i < workers; ++i) {
+        m_pool.start([this, &started, &release]() {
+            started.release();
+            release.acquire();
+            m_workerCleanup();
+        });
+    }
+    started.acquire(workers);
+    release.release(workers);
+    m_pool.waitForDone();
+}
+
+bool HttpServer::listen(const QHostAddress &address, quint16 port) {
+    if (!m_server.listen(address, port)) {
+        qWarning() << "HTTP server cannot listen:" << m_server.errorString();
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::onNewConnection() {
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        auto *conn = new Connection;
+        conn->socket = socket;
+        conn->lastActivity.start();
+        m_connections.insert(socket, conn);
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        // Queued so a connection is never freed while a handler is using it
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { dropConnection(socket); },
+                Qt::QueuedConnection);
+    }
+}
+
+void HttpServer::dropConnection(QTcpSocket *socket) {
+    Connection *conn = m_connections.take(socket);
+    if (!conn) return;
+    delete conn;
+    socket->deleteLater();
+}
+
+void HttpServer::sweepIdleConnections() {
+    const QList<Connection *> connections = m_connections.values();
+    for (Connection *conn : connections) {
+        if (!conn->busy && conn->pending.isEmpty()
+            && conn->lastActivity.elapsed() > kIdleTimeoutMs) {
+            conn->socket->disconnectFromHost();
+        }
+    }
+}
+
+int HttpServer::parseRequest(QByteArray &buffer, HttpRequest *request) {
+    const int headerEnd = buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0) return buffer.size() > kMaxHeaderBytes ? -1 : 0;
+
+    const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+    const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    if (requestLine.size() != 3 || !requestLine[2].startsWith("HTTP/1.")) return -1;
+
+    HttpRequest req;
+    req.method = requestLine[0];
+    const QUrl url = QUrl::fromEncoded(requestLine[1]);
+    req.path = url.path().toUtf8();
+    const QUrlQuery query(url);
+    for (const auto &item : query.queryItems(QUrl::FullyDecoded)) {
+        req.query.insert(item.first.toUtf8(), item.second.toUtf8());
+    }
+    for (int i = 1; i < lines.size(); ++i) {
+        const int colon = lines[i].indexOf(':');
+        if (colon <= 0) continue;
+        req.headers.insert(lines[i].left(colon).trimmed().toLower(),
+                           lines[i].mid(colon + 1).trimmed());
+    }
+
+    bool ok = true;
+    const int length = req.headers.value("content-length", "0").toInt(&ok);
+    if (!ok || length < 0 || length > kMaxBodyBytes) return -1;
+    if (buffer.size() < headerEnd + 4 + length) return 0;
+
+    req.body = buffer.mid(headerEnd + 4, length);
+    const QByteArray connection = req.headers.value("connection").toLower();
+    req.keepAlive = requestLine[2] == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+    buffer.remove(0, headerEnd + 4 + length);
+    *request = req;
+    return 1;
+}
+
+void HttpServer::onReadyRead(QTcpSocket *socket) {
+    Connection *conn = m_connections.value(socket);
+    if (!conn || conn->closing) return;
+
+    conn->buffer += socket->readAll();
+    conn->lastActivity.restart();
+
+    while (true) {
+        HttpRequest request;
+        const int parsed = parseRequest(conn->buffer, &request);
+        if (parsed == 0) break;
+        if (parsed < 0 || conn->pending.size() >= kMaxPipelined) {
+            HttpResponse error;
+            error.status = parsed < 0 ? 400 : 503;
+            error.body = R"({"error":"bad or excessive request"})";
+            conn->pending.clear();
+            conn->buffer.clear();
+            writeResponse(conn, error, false);
+            return;
+        }
+        conn->pending.enqueue(request);
+    }
+    dispatchNext(conn);
+}
+
+void HttpServer::dispatchNext(Connection *conn) {
+    if (conn->busy || conn->closing || conn->pending.isEmpty()) return;
+
+    HttpRequest request = conn->pending.dequeue();
+    if (m_queued.load() >= m_maxQueued) {
+        HttpResponse busy;
+        busy.status = 503;
+        busy.body = R"({"error":"server busy"})";
+        writeResponse(conn, busy, request.keepAlive);
+        dispatchNext(conn);
+        return;
+    }
+
+    conn->busy = true;
+    ++m_queued;
+    QPointer<QTcpSocket> socket(conn->socket);
+    m_pool.start([this, socket, request]() {
+        HttpResponse response = m_handler(request);
+        --m_queued;
+        QMetaObject::invokeMethod(this, [this, socket, response, keepAlive = request.keepAlive]() {
+            if (!socket) return;
+            Connection *conn = m_connections.value(socket.data());
+            if (!conn) return;
+            conn->busy = false;
+            writeResponse(conn, response, keepAlive);
+            dispatchNext(conn);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void HttpServer::writeResponse(Connection *conn, const HttpResponse &response, bool keepAlive) {
+    QByteArray out;
+    out.reserve(response.body.size() + 160);
+    out += "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasonPhrase(response.status) + "\r\n";
+    out += "Content-Type: " + response.contentType + "\r\n";
+    out += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+    out += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    out += response.body;
+
+    conn->socket->write(out);
+    conn->lastActivity.restart();
+    if (!keepAlive) {
+        conn->closing = true;
+        conn->pending.clear();
+        conn->socket->disconnectFromHost();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QTcpServer>
+#include <atomic>
+#include <functional>
+
+class QTcpSocket;
+class QTimer;
+
+struct HttpRequest {
+    QByteArray method;
+    QByteArray path;
+    QHash<QByteArray, QByteArray> query;
+    QHash<QByteArray, QByteArray> headers; // lower-case names
+    QByteArray body;
+    bool keepAlive = true;
+};
+
+struct HttpResponse {
+    int status = 200;
+    QByteArray contentType = "application/json";
+    QByteArray body;
+};
+
+// Handlers run on a worker thread
+using HttpHandler = std::function<HttpResponse(const HttpRequest &)>;
+
+// Minimal HTTP/1.1 server for local tools.
+//
+// Socket I/O stays on the thread that owns the server. Parsed requests are
+// executed on a bounded worker pool. Keep-alive and pipelining are
+// supported: each connection runs one request at a time and answers in
+// arrival order. When more than maxQueued requests are waiting, new ones
+// get 503 immediately instead of piling up.
+class HttpServer : public QObject {
+    Q_OBJECT
+public:
+    HttpServer(HttpHandler handler, int workers, int maxQueued, QObject *parent = nullptr);
+    ~HttpServer() override;
+
+    bool listen(const QHostAddress &address, quint16 port);
+    quint16 serverPort() const { return m_server.serverPort(); }
+
+    // Runs once on every worker thread when the server stops, for state
+    // the handler keeps per thread (database connections)
+    void setWorkerCleanup(std::function<void()> cleanup) { m_workerCleanup = std::move(cleanup); }
+
+private slots:
+    void onNewConnection();
+    void sweepIdleConnections();
+
+private:
+    struct Connection {
+        QTcpSocket *socket = nullptr;
+        QByteArray buffer;
+        QQueue<HttpRequest> pending;
+        bool busy = false;
+        bool closing = false;
+        QElapsedTimer lastActivity;
+    };
+
+    void onReadyRead(QTcpSocket *socket);
+    void dispatchNext(Connection *conn);
+    void writeResponse(Connection *conn, const HttpResponse &response, bool keepAlive);
+    void dropConnection(QTcpSocket *socket);
+
+    // Returns 1 when a request was parsed, 0 when more data is needed and
+    // -1 when the request is malformed or too large
+    static int parseRequest(QByteArray &buffer, HttpRequest *request);
+
+    void cleanUpWorkers();
+
+    HttpHandler m_handler;
+    std::function<void()> m_workerCleanup;
+    QTcpServer m_server;
+    QThreadPool m_pool;
+    QTimer *m_idleSweep;
+    QHash<QTcpSocket *, Connection *> m_connections;
+    std::atomic<int> m_queued{0};
+    int m_maxQueued;
+};
+
+#endif // HTTPSERVER_H
@@ -0,0 +1,155 @@
+#include "loadgen.h"
+#include "opmetrics.h"
+#include <QTcpSocket>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QQueue>
+#include <QDebug>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int kIoTimeoutMs = 10000;
+
+struct ClientResult {
+    LatencyHistogram histogram;
+    qint64 requests = 0;
+    qint64 errors = 0;
+};
+
+QByteArray buildRequest(const QByteArray &method, const QByteArray &path,
+                        const QByteArray &token, const QByteArray &body = QByteArray()) {
+    QByteArray out = method + ' ' + path + " HTTP/1.1\r\nHost: localhost\r\n";
+    if (!token.isEmpty()) out += "Authorization: Bearer " + token + "\r\n";
+    if (!body.isEmpty()) {
+        out += "Content-Type: application/json\r\nContent-Length: "
+               + QByteArray::number(body.size()) + "\r\n";
+    }
+    out += "\r\n" + body;
+    return out;
+}
+
+// Reads exactly one response from the socket, keeping any bytes of the
+// next pipelined response in 'buffer'.
+bool readResponse(QTcpSocket &socket, QByteArray &buffer, int *status, QByteArray *body) {
+    int headerEnd = -1;
+    while ((headerEnd = buffer.indexOf("\r\n\r\n")) < 0) {
+        if (!socket.waitForReadyRead(kIoTimeoutMs)) return false;
+        buffer += socket.readAll();
+    }
+
+    const QByteArray head = buffer.left(headerEnd);
+    *status = head.mid(9, 3).toInt();
+    int length = 0;
+    for (const QByteArray &line : head.split('\n')) {
+        if (line.toLower().startsWith("content-length:")) length = line.mid(15).trimmed().toInt();
+    }
+
+    while (buffer.size() < headerEnd + 4 + length) {
+        if (!socket.waitForReadyRead(kIoTimeoutMs)) return false;
+        buffer += socket.readAll();
+    }
+    *body = buffer.mid(headerEnd + 4, length);
+    buffer.remove(0, headerEnd + 4 + length);
+    return true;
+}
+
+void runClient(const LoadGenOptions &options, ClientResult *result) {
+    QTcpSocket socket;
+    socket.connectToHost(options.host, options.port);
+    if (!socket.waitForConnected(kIoTimeoutMs)) {
+        result->errors += options.requestsPerConnection;
+        return;
+    }
+
+    QByteArray buffer;
+    int status = 0;
+    QByteArray body;
+
+    // Log in and find an account to post to
+    const QByteArray credentials = QJsonDocument(QJsonObject{
+        {"email", options.email}, {"password", options.password}}).toJson(QJsonDocument::Compact);
+    socket.write(buildRequest("POST", "/login", QByteArray(), credentials));
+    if (!readResponse(socket, buffer, &status, &body) || status != 200) {
+        result->errors += options.requestsPerConnection;
+        return;
+    }
+    const QByteArray token = QJsonDocument::fromJson(body).object()["token"].toString().toLatin1();
+
+    socket.write(buildRequest("GET", "/accounts", token));
+    if (!readResponse(socket, buffer, &status, &body) || status != 200) {
+        result->errors += options.requestsPerConnection;
+        return;
+    }
+    const QJsonArray accounts = QJsonDocument::fromJson(body).array();
+    if (accounts.isEmpty()) {
+        qWarning() << "loadgen:" << options.email << "has no accounts";
+        result->errors += options.requestsPerConnection;
+        return;
+    }
+    const int accountId = accounts.first().toObject()["id"].toInt();
+    const QByteArray deposit = buildRequest("POST", "/deposit", token,
+        QJsonDocument(QJsonObject{{"accountId", accountId}, {"amount", 1.0}}).toJson(QJsonDocument::Compact));
+    const QByteArray listAccounts = buildRequest("GET", "/accounts", token);
+
+    QElapsedTimer clock;
+    clock.start();
+    QQueue<qint64> inFlight;
+    int sent = 0;
+
+    auto sendNext = [&]() {
+        socket.write(sent % 4 == 3 ? deposit : listAccounts);
+        inFlight.enqueue(clock.nsecsElapsed());
+        ++sent;
+    };
+
+    while (sent < options.requestsPerConnection && inFlight.size() < options.pipeline) sendNext();
+    while (!inFlight.isEmpty()) {
+        socket.flush();
+        if (!readResponse(socket, buffer, &status, &body)) {
+            result->errors += inFlight.size() + (options.requestsPerConnection - sent);
+            return;
+        }
+        result->histogram.record(quint64(clock.nsecsElapsed() - inFlight.dequeue()));
+        ++result->requests;
+        if (status != 200) ++result->errors;
+        if (sent < options.requestsPerConnection) sendNext();
+    }
+    socket.disconnectFromHost();
+}
+
+} // namespace
+
+LoadGenReport runLoadGenerator(const LoadGenOptions &options) {
+    std::vector<std::unique_ptr<ClientResult>> results;
+    std::vector<std::unique_ptr<QThread>> threads;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < options.connections; ++i) {
+        results.push_back(std::make_unique<ClientResult>());
+        ClientResult *result = results.back().get();
+        threads.emplace_back(QThread::create([options, result]() { runClient(options, result); }));
+        threads.back()->start();
+    }
+    for (auto &thread : threads) thread->wait();
+
+    LoadGenReport report;
+    report.elapsedMs = timer.elapsed();
+
+    LatencyHistogram merged;
+    for (const auto &result : results) {
+        merged.merge(result->histogram);
+        report.requests += result->requests;
+        report.errors += result->errors;
+    }
+    report.p50Ms = merged.percentile(50) / 1e6;
+    report.p99Ms = merged.percentile(99) / 1e6;
+    report.p999Ms = merged.percentile(99.9) / 1e6;
+    report.maxMs = merged.maxNanos() / 1e6;
+    return report;
+}
@@ -0,0 +1,35 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <QString>
+
+// Local HTTP load generator for the BankApi service. Each connection logs
+// in, then keeps a pipeline of requests in flight over one keep-alive
+// socket: mostly GET /accounts with every fourth request a small deposit.
+struct LoadGenOptions {
+    QString host = "127.0.0.1";
+    quint16 port = 8080;
+    int connections = 8;
+    int requestsPerConnection = 10000;
+    int pipeline = 4;
+    QString email = "alice@example.com";
+    QString password = "Password123!";
+};
+
+struct LoadGenReport {
+    qint64 requests = 0;
+    qint64 errors = 0;
+    qint64 elapsedMs = 0;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double p999Ms = 0.0;
+    double maxMs = 0.0;
+
+    double requestsPerSecond() const {
+        return elapsedMs > 0 ? requests * 1000.0 / elapsedMs : 0.0;
+    }
+};
+
+LoadGenReport runLoadGenerator(const LoadGenOptions &options);
+
+#endif // LOADGEN_H
@@ -2,8 +2,13 @@
 #include <QFile>
 #include <QDebug>
 #include "dbmanager.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "uiprofiler.h"
+#include "riskengine.h"
 #include "loginwindow.h"
 #include "mainwindow.h"
+#include "tellerwindow.h"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
@@ -113,9 +118,61 @@ int main(int argc, char *argv[]) {
     )";
     app.setStyleSheet(style);
 
+    // BLUEBANK_METRICS=<file.json> records per-operation latencies and
+    // writes them to that file on exit.
+    const QString metricsFile = qEnvironmentVariable("BLUEBANK_METRICS");
+    if (!metricsFile.isEmpty()) {
+        OpMetrics::setEnabled(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [metricsFile]() {
+            OpMetrics::dumpJson(metricsFile);
+        });
+    }
+
+    // BLUEBANK_UI_PROFILE=<file.json> traces refresh slots and event-loop
+    // stalls and saves the trace to that file on exit.
+    const QString uiTraceFile = qEnvironmentVariable("BLUEBANK_UI_PROFILE");
+    if (!uiTraceFile.isEmpty()) {
+        UiProfiler::instance().setEnabled(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [uiTraceFile]() {
+            UiProfiler::instance().save(uiTraceFile);
+        });
+    }
+
+    // BLUEBANK_SLOW_QUERY_MS=<ms> logs statements slower than the threshold
+    // to BLUEBANK_SLOW_QUERY_LOG (default slow_queries.log).
+    bool thresholdOk = false;
+    const int slowQueryMs = qEnvironmentVariableIntValue("BLUEBANK_SLOW_QUERY_MS", &thresholdOk);
+    if (thresholdOk) {
+        QString logPath = qEnvironmentVariable("BLUEBANK_SLOW_QUERY_LOG", "slow_queries.log");
+        SlowQueryLog::enable(logPath, slowQueryMs);
+    }
+
+    // Velocity limits on withdrawals, Interac transfers and card spends.
+    // BLUEBANK_RISK_RULES=<rules> replaces the defaults; "off" disables them.
+    QVector<RiskEngine::Rule> riskRules = RiskEngine::defaultRules();
+    const QString riskText = qEnvironmentVariable("BLUEBANK_RISK_RULES");
+    if (riskText == "off") {
+        riskRules.clear();
+    } else if (!riskText.isEmpty() && !RiskEngine::parseRules(riskText, &riskRules)) {
+        qWarning() << "Ignoring invalid BLUEBANK_RISK_RULES:" << riskText;
+    }
+    RiskEngine::instance().setRules(riskRules);
+
     if (!DBManager::init("bank.db")) {
         qWarning() << "Could not initialize database.";
     }
+    DBManager::scheduleTransferRecovery(&app);
+    // BLUEBANK_SAMPLE_DATA=1 adds the demo clients (developer option)
+    if (qEnvironmentVariableIsSet("BLUEBANK_SAMPLE_DATA")) {
+        DBManager::seedSampleData();
+    }
+
+    // --teller opens the teller console: many customer sessions at once
+    if (app.arguments().contains("--teller")) {
+        TellerWindow teller;
+        teller.show();
+        return app.exec();
+    }
 
     LoginWindow login;
     MainWindow *mainWin = nullptr;
@@ -1,5 +1,10 @@
 #include "mainwindow.h"
 #include "dbmanager.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "uiprofiler.h"
+#include "sessioncache.h"
+#include "riskengine.h"
 
 #include <QTabWidget>
 #include <QWidget>
@@ -9,14 +14,17 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QTableView>
+#include <QTableWidget>
 #include <QSqlQueryModel>
 #include <QSqlQuery>
+#include <QSqlRecord>
 #include <QComboBox>
 #include <QLineEdit>
 #include <QHeaderView>
 #include <QListWidget>
 #include <QSplitter>
 #include <QDate>
+#include <QDateEdit>
 #include <QMessageBox>
 #include <QtPrintSupport/QPrinter>
 #include <QtPrintSupport/QPrintDialog>
@@ -24,13 +32,63 @@
 #include <QFileDialog>
 #include <QEvent>
 #include <QMouseEvent>
+#include <QShortcut>
+#include <QKeySequence>
+#include <QPlainTextEdit>
+#include <QCheckBox>
+#include <QFontDatabase>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QFile>
+#include <QPointer>
+#include <QSignalBlocker>
+#include <QThreadPool>
+#include <QApplication>
+#include <QTimer>
+#include <QDebug>
+#include <limits>
+
+namespace {
+constexpr int kStatementPageSize = 100;
+
+// Opening/closing balances and totals of a closed monthly statement
+QString statementSummary(const StatementHeader &header) {
+    auto money = [](double value) { return "$" + QString::number(value, 'f', 2); };
+    QStringList byType;
+    for (const auto &total : header.totalsByType) byType << total.first + " " + money(total.second);
+    QString text = QString("Opening %1 · Closing %2 · Credits %3 · Debits %4 · %5 transactions")
+                       .arg(money(header.openingBalance), money(header.closingBalance),
+                            money(header.totalCredits), money(header.totalDebits))
+                       .arg(header.transactionCount);
+    if (!byType.isEmpty()) text += "\n" + byType.join(" · ");
+    return text;
+}
+
+// Re-runs a table's long-lived model in place. The view is attached to it
+// once, so refreshes allocate neither a model nor a selection model.
+void requery(QTableView *table, QSqlQueryModel *model, QSqlQuery &q) {
+    model->setQuery(q);
+    if (table->model() != model) table->setModel(model);
+}
+
+// A debit refused by a velocity limit says so; other failures keep the
+// usual message
+QString debitFailure(const QString &message) {
+    const QString rule = RiskEngine::takeLastDenial();
+    return rule.isEmpty() ? message : QString("Blocked by the %1. Try again later.").arg(rule);
+}
+}
 
 
 MainWindow::MainWindow(int userId, QWidget *parent)
     : QMainWindow(parent),
       m_userId(userId),
+      m_embedded(false),
+      avatar(nullptr),
       m_tabs(new QTabWidget(this)),
+      m_firstFrameMs(-1),
       m_accountsTable(nullptr),
+      m_accountsModel(new QSqlQueryModel(this)),
       m_accountTypeCombo(nullptr),
       m_initialDepositEdit(nullptr),
       m_savingsRateEdit(nullptr),
@@ -45,6 +103,7 @@ MainWindow::MainWindow(int userId, QWidget *parent)
       m_interacEmailEdit(nullptr),
       m_interacAmountEdit(nullptr),
       m_cardsTable(nullptr),
+      m_cardsModel(new QSqlQueryModel(this)),
       m_cardLimitEdit(nullptr),
       m_cardSpendCardCombo(nullptr),
       m_cardSpendAmountEdit(nullptr),
@@ -54,34 +113,51 @@ MainWindow::MainWindow(int userId, QWidget *parent)
       m_billFromCombo(nullptr),
       m_billPayeeCombo(nullptr),
       m_billAmountEdit(nullptr),
+      m_billWhenCombo(nullptr),
+      m_billDateEdit(nullptr),
+      m_scheduledTable(nullptr),
+      m_scheduledModel(new QSqlQueryModel(this)),
       m_overviewBalanceLabel(nullptr),
       m_overviewSavingsLabel(nullptr),
+      m_overviewMonthLabel(nullptr),
+      m_overviewBreakdownTable(nullptr),
+      m_overviewTrendTable(nullptr),
       m_statementsTable(nullptr),
+      m_statementsModel(new QSqlQueryModel(this)),
       m_statementsAccountCombo(nullptr),
-      m_faqList(nullptr)
+      m_statementsPeriodCombo(nullptr),
+      m_statementsSummaryLabel(nullptr),
+      m_statementsSearchEdit(nullptr),
+      m_statementsSearchTimer(nullptr),
+      m_statementsPrevButton(nullptr),
+      m_statementsNextButton(nullptr),
+      m_statementsPageLabel(nullptr),
+      m_statementsPage(0),
+      m_exportButton(nullptr),
+      m_faqList(nullptr),
+      m_diagnosticsPage(nullptr),
+      m_diagnosticsText(nullptr)
 {
+    m_startupClock.start();
     setWindowTitle("Sudbury Student Bank – Dashboard");
     resize(1180, 720);
 
-    m_tabs->addTab(buildOverviewTab(),   "Overview");
-    m_tabs->addTab(buildAccountsTab(),   "Accounts");
-    m_tabs->addTab(buildTransfersTab(),  "Transfers");
-    m_tabs->addTab(buildCardsTab(),      "Credit Cards");
-    m_tabs->addTab(buildBillsTab(),      "Bill Payments");
-    m_tabs->addTab(buildStatementsTab(), "Statements");
-    m_tabs->addTab(buildProfileTab(),    "Profile");
-    m_tabs->addTab(buildFaqTab(),        "FAQs");
+    // Only the Overview is built up front; the other tabs get an empty
+    // holder that ensureTabBuilt() fills on first use.
+    m_tabs->addTab(buildOverviewTab(), "Overview");
+    m_lazyPages << nullptr;
+    for (const char *name : {"Accounts", "Transfers", "Credit Cards", "Bill Payments",
+                             "Statements", "Profile", "FAQs"}) {
+        auto *holder = new QWidget(m_tabs);
+        auto *holderLayout = new QVBoxLayout(holder);
+        holderLayout->setContentsMargins(0, 0, 0, 0);
+        m_tabs->addTab(holder, name);
+        m_lazyPages << holder;
+    }
+    connect(m_tabs, &QTabWidget::currentChanged, this, &MainWindow::ensureTabBuilt);
 
     setCentralWidget(m_tabs);
 
-    DBManager::applyMonthlyInterestForUser(m_userId);
-    refreshOverview();
-    refreshAccountsTables();
-    refreshCreditCards();
-    refreshStatements();
-    refreshFaqs();
-    refreshBillPayees();
-
     // ----------------------------------------
     // Logout Button (top-right corner)
     // ----------------------------------------
@@ -98,9 +174,107 @@ MainWindow::MainWindow(int userId, QWidget *parent)
 
     connect(logoutButton, &QPushButton::clicked, this, &MainWindow::handleLogout);
 
+    // Hidden diagnostics tab
+    auto *diagShortcut = new QShortcut(QKeySequence("Ctrl+Shift+D"), this);
+    connect(diagShortcut, &QShortcut::activated, this, &MainWindow::toggleDiagnosticsTab);
+
 }  // <-- keep this closing brace
 
 
+void MainWindow::setEmbedded(bool embedded) {
+    m_embedded = embedded;
+    setWindowFlags(embedded ? Qt::Widget : Qt::Window);
+    logoutButton->setVisible(!embedded);
+}
+
+void MainWindow::paintEvent(QPaintEvent *event) {
+    QMainWindow::paintEvent(event);
+    if (m_firstFrameMs >= 0) return;
+
+    m_firstFrameMs = m_startupClock.elapsed();
+    OpMetrics::record("MainWindow::firstFrame", quint64(m_startupClock.nsecsElapsed()), true);
+    qInfo() << "Time to first frame:" << m_firstFrameMs << "ms";
+    // Runs once this frame is on screen
+    QTimer::singleShot(0, this, &MainWindow::loadAfterFirstFrame);
+}
+
+void MainWindow::loadAfterFirstFrame() {
+    UiSpan span("loadAfterFirstFrame");
+    refreshOverview();
+    ensureTabBuilt(m_tabs->currentIndex());
+    // Embedded sessions skip the prefetch to keep each one small
+    if (!m_embedded) QTimer::singleShot(0, this, &MainWindow::prefetchNextTab);
+
+    // Interest, due payments and statements post on a pool thread; the
+    // tables showing their results refresh when it is done
+    QPointer<MainWindow> self(this);
+    const int userId = m_userId;
+    QThreadPool::globalInstance()->start([self, userId]() {
+        DBManager::applyMonthlyInterestForUser(userId);
+        DBManager::runDueScheduledPayments(QDate::currentDate(), userId);
+        DBManager::closeMonthlyStatements(QDate::currentDate(), userId);
+        DBManager::releaseThreadConnection();
+
+        QMetaObject::invokeMethod(qApp, [self]() {
+            if (!self) return;
+            self->refreshOverview();
+            self->refreshAccountsTables();
+            self->refreshScheduledPayments();
+            self->refreshStatementPeriods();
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::prefetchNextTab() {
+    // One tab per event-loop turn so input stays responsive
+    for (int i = 0; i < m_lazyPages.size(); ++i) {
+        if (!m_lazyPages[i]) continue;
+        ensureTabBuilt(i);
+        QTimer::singleShot(0, this, &MainWindow::prefetchNextTab);
+        return;
+    }
+}
+
+void MainWindow::ensureTabBuilt(int index) {
+    QWidget *holder = m_tabs->widget(index);
+    const int slot = holder ? m_lazyPages.indexOf(holder) : -1;
+    if (slot < 0) return;
+    m_lazyPages[slot] = nullptr;
+    UiSpan span("ensureTabBuilt");
+
+    switch (slot) {
+    case 1:
+        holder->layout()->addWidget(buildAccountsTab());
+        refreshAccountsTables();
+        break;
+    case 2:
+        holder->layout()->addWidget(buildTransfersTab());
+        refreshAccountsTables();
+        break;
+    case 3:
+        holder->layout()->addWidget(buildCardsTab());
+        refreshCreditCards();
+        break;
+    case 4:
+        holder->layout()->addWidget(buildBillsTab());
+        refreshAccountsTables();
+        refreshBillPayees();
+        refreshScheduledPayments();
+        break;
+    case 5:
+        holder->layout()->addWidget(buildStatementsTab());
+        refreshAccountsTables(); // fills the account picker, which loads the statement
+        break;
+    case 6:
+        holder->layout()->addWidget(buildProfileTab());
+        break;
+    case 7:
+        holder->layout()->addWidget(buildFaqTab());
+        refreshFaqs();
+        break;
+    }
+}
+
 QWidget* MainWindow::buildOverviewTab() {
     auto *page = new QWidget(this);
     auto *layout = new QVBoxLayout(page);
@@ -113,11 +287,35 @@ QWidget* MainWindow::buildOverviewTab() {
 
     m_overviewSavingsLabel = new QLabel("Savings balance: $0.00", page);
     m_overviewSavingsLabel->setObjectName("overviewMetricSecondary");
+
+    // Spending insights: this month's money by type and bill category, and
+    // income vs spending over the last 12 months
+    m_overviewMonthLabel = new QLabel(page);
+    m_overviewMonthLabel->setObjectName("overviewMetricSecondary");
+
+    m_overviewBreakdownTable = new QTableWidget(0, 3, page);
+    m_overviewBreakdownTable->setHorizontalHeaderLabels({"This month", "", "Amount"});
+    m_overviewBreakdownTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    m_overviewBreakdownTable->verticalHeader()->setVisible(false);
+    m_overviewBreakdownTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    m_overviewTrendTable = new QTableWidget(0, 4, page);
+    m_overviewTrendTable->setHorizontalHeaderLabels({"Month", "Income", "Spending", "Net"});
+    m_overviewTrendTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    m_overviewTrendTable->verticalHeader()->setVisible(false);
+    m_overviewTrendTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    auto *insights = new QHBoxLayout();
+    insights->addWidget(m_overviewBreakdownTable, 1);
+    insights->addWidget(m_overviewTrendTable, 1);
+
     layout->addWidget(header);
     layout->addSpacing(8);
     layout->addWidget(m_overviewBalanceLabel);
     layout->addWidget(m_overviewSavingsLabel);
-    layout->addStretch();
+    layout->addSpacing(12);
+    layout->addWidget(m_overviewMonthLabel);
+    layout->addLayout(insights, 1);
 
     return page;
 }
@@ -329,18 +527,44 @@ QWidget* MainWindow::buildBillsTab() {
     m_billAmountEdit = new QLineEdit(formBox);
     m_billAmountEdit->setPlaceholderText("Enter amount");
 
+    m_billWhenCombo = new QComboBox(formBox);
+    m_billWhenCombo->addItem("Pay now", "Now");
+    m_billWhenCombo->addItem("Once, on date", "Once");
+    m_billWhenCombo->addItem("Weekly, starting on date", "Weekly");
+    m_billWhenCombo->addItem("Monthly, starting on date", "Monthly");
+
+    m_billDateEdit = new QDateEdit(QDate::currentDate().addDays(1), formBox);
+    m_billDateEdit->setCalendarPopup(true);
+    m_billDateEdit->setMinimumDate(QDate::currentDate());
+    m_billDateEdit->setEnabled(false);
+
     auto *payBtn = new QPushButton("Pay Bill", formBox);
 
     formLayout->addRow("From account:", m_billFromCombo);
     formLayout->addRow("Payee:", m_billPayeeCombo);
     formLayout->addRow("Amount:", m_billAmountEdit);
+    formLayout->addRow("When:", m_billWhenCombo);
+    formLayout->addRow("Date:", m_billDateEdit);
     formLayout->addRow("", payBtn);
 
+    auto *scheduledTitle = new QLabel("Scheduled payments", page);
+    m_scheduledTable = new QTableView(page);
+    m_scheduledTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    m_scheduledTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_scheduledTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    auto *cancelBtn = new QPushButton("Cancel selected schedule", page);
+
     layout->addWidget(title);
     layout->addWidget(formBox);
-    layout->addStretch();
+    layout->addWidget(scheduledTitle);
+    layout->addWidget(m_scheduledTable);
+    layout->addWidget(cancelBtn);
 
     connect(payBtn, &QPushButton::clicked, this, &MainWindow::handleBillPayment);
+    connect(cancelBtn, &QPushButton::clicked, this, &MainWindow::handleCancelScheduledPayment);
+    connect(m_billWhenCombo, &QComboBox::currentIndexChanged, this, [this]() {
+        m_billDateEdit->setEnabled(m_billWhenCombo->currentData().toString() != "Now");
+    });
 
     return page;
 }
@@ -353,11 +577,11 @@ QWidget* MainWindow::buildProfileTab() {
     title->setObjectName("pageTitle");
 
     // Pull data from DB
-    QSqlQuery q(DBManager::database());
+    QSqlQuery q(DBManager::directoryDatabase());
     q.prepare("SELECT username, email, dob, created_at FROM users WHERE id = :id");
     q.bindValue(":id", m_userId);
     QString name, email, dob, created;
-    if (q.exec() && q.next()) {
+    if (SlowQueryLog::exec(q) && q.next()) {
         name    = q.value(0).toString();
         email   = q.value(1).toString();
         dob     = q.value(2).toString();
@@ -429,48 +653,268 @@ QWidget* MainWindow::buildStatementsTab() {
     title->setObjectName("pageTitle");
 
     m_statementsAccountCombo = new QComboBox(page);
+
+    // "Recent activity" pages through the whole history; a closed month
+    // shows its statement header and only that month's rows
+    m_statementsPeriodCombo = new QComboBox(page);
+    m_statementsSummaryLabel = new QLabel(page);
+    m_statementsSummaryLabel->setWordWrap(true);
+    m_statementsSummaryLabel->hide();
+    auto *periodRow = new QHBoxLayout();
+    periodRow->addWidget(m_statementsAccountCombo, 2);
+    periodRow->addWidget(m_statementsPeriodCombo, 1);
+
+    // Type-ahead search; waits for a pause in typing before querying
+    m_statementsSearchEdit = new QLineEdit(page);
+    m_statementsSearchEdit->setPlaceholderText("Search descriptions, Interac emails, payees, amounts…");
+    m_statementsSearchEdit->setClearButtonEnabled(true);
+    m_statementsSearchTimer = new QTimer(this);
+    m_statementsSearchTimer->setSingleShot(true);
+    m_statementsSearchTimer->setInterval(150);
+    connect(m_statementsSearchEdit, &QLineEdit::textChanged,
+            m_statementsSearchTimer, qOverload<>(&QTimer::start));
+    connect(m_statementsSearchTimer, &QTimer::timeout, this, [this]() {
+        m_statementsPage = 0;
+        refreshStatements();
+    });
+
+    m_statementsPrevButton = new QPushButton("Previous", page);
+    m_statementsNextButton = new QPushButton("Next", page);
+    m_statementsPageLabel = new QLabel(page);
+    connect(m_statementsPrevButton, &QPushButton::clicked, this, [this]() {
+        if (m_statementsPage == 0) return;
+        --m_statementsPage;
+        refreshStatements();
+    });
+    connect(m_statementsNextButton, &QPushButton::clicked, this, [this]() {
+        ++m_statementsPage;
+        refreshStatements();
+    });
+    auto *pager = new QHBoxLayout();
+    pager->addWidget(m_statementsPrevButton);
+    pager->addWidget(m_statementsPageLabel);
+    pager->addStretch();
+    pager->addWidget(m_statementsNextButton);
+
     m_statementsTable = new QTableView(page);
     m_statementsTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
 
     // --- Export PDF button ---
-    auto *exportBtn = new QPushButton("Export as PDF", page);
-    connect(exportBtn, &QPushButton::clicked, this, [this]() {
+    m_exportButton = new QPushButton("Export as PDF", page);
+    connect(m_exportButton, &QPushButton::clicked, this, [this]() {
         exportStatementsAsPdf();
     });
 
     layout->addWidget(title);
-    layout->addWidget(m_statementsAccountCombo);
-    layout->addWidget(exportBtn);          // <-- correct position
+    layout->addLayout(periodRow);
+    layout->addWidget(m_statementsSummaryLabel);
+    layout->addWidget(m_statementsSearchEdit);
+    layout->addWidget(m_exportButton);     // <-- correct position
     layout->addWidget(m_statementsTable);
+    layout->addLayout(pager);
 
-    connect(m_statementsAccountCombo, &QComboBox::currentIndexChanged,
-            this, &MainWindow::refreshStatements);
+    connect(m_statementsAccountCombo, &QComboBox::currentIndexChanged, this, [this]() {
+        m_statementsPage = 0;
+        refreshStatementPeriods();
+    });
+    connect(m_statementsPeriodCombo, &QComboBox::currentIndexChanged, this, [this]() {
+        m_statementsPage = 0;
+        refreshStatements();
+    });
+
+    return page;
+}
+
+QWidget* MainWindow::buildDiagnosticsTab() {
+    auto *page = new QWidget(this);
+    auto *layout = new QVBoxLayout(page);
+
+    auto *title = new QLabel("Diagnostics – operation latency", page);
+    title->setObjectName("pageTitle");
+
+    auto *recording = new QCheckBox("Record latencies", page);
+    recording->setChecked(OpMetrics::enabled());
+
+    auto *profiling = new QCheckBox("Profile UI", page);
+    profiling->setChecked(UiProfiler::instance().enabled());
+
+    m_diagnosticsText = new QPlainTextEdit(page);
+    m_diagnosticsText->setReadOnly(true);
+    m_diagnosticsText->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+    auto *buttons = new QHBoxLayout();
+    auto *refreshBtn = new QPushButton("Refresh", page);
+    auto *resetBtn = new QPushButton("Reset", page);
+    auto *saveBtn = new QPushButton("Save JSON…", page);
+    auto *saveTraceBtn = new QPushButton("Save UI trace…", page);
+    auto *compareBtn = new QPushButton("Compare UI trace…", page);
+    buttons->addWidget(recording);
+    buttons->addWidget(profiling);
+    buttons->addStretch();
+    buttons->addWidget(refreshBtn);
+    buttons->addWidget(resetBtn);
+    buttons->addWidget(saveBtn);
+    buttons->addWidget(saveTraceBtn);
+    buttons->addWidget(compareBtn);
+
+    layout->addWidget(title);
+    layout->addLayout(buttons);
+    layout->addWidget(m_diagnosticsText);
+
+    connect(recording, &QCheckBox::toggled, this, [](bool on) {
+        OpMetrics::setEnabled(on);
+    });
+    connect(profiling, &QCheckBox::toggled, this, [](bool on) {
+        UiProfiler::instance().setEnabled(on);
+    });
+    connect(refreshBtn, &QPushButton::clicked, this, &MainWindow::refreshDiagnostics);
+    connect(resetBtn, &QPushButton::clicked, this, [this]() {
+        OpMetrics::reset();
+        UiProfiler::instance().clear();
+        refreshDiagnostics();
+    });
+    connect(saveTraceBtn, &QPushButton::clicked, this, [this]() {
+        QString filePath = QFileDialog::getSaveFileName(this, "Save UI trace",
+                                                        "ui-trace.json", "JSON Files (*.json)");
+        if (!filePath.isEmpty() && !UiProfiler::instance().save(filePath)) {
+            QMessageBox::warning(this, "Save failed", "Could not write the UI trace file.");
+        }
+    });
+    connect(compareBtn, &QPushButton::clicked, this, [this]() {
+        QString filePath = QFileDialog::getOpenFileName(this, "Baseline UI trace",
+                                                        "", "JSON Files (*.json)");
+        if (filePath.isEmpty()) return;
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            QMessageBox::warning(this, "Compare failed", "Could not read the UI trace file.");
+            return;
+        }
+        QJsonObject baseline = QJsonDocument::fromJson(file.readAll()).object();
+        m_diagnosticsText->setPlainText(
+            UiProfiler::compare(baseline, UiProfiler::instance().toJson()));
+    });
+    connect(saveBtn, &QPushButton::clicked, this, [this]() {
+        QString filePath = QFileDialog::getSaveFileName(this, "Save metrics as JSON",
+                                                        "metrics.json", "JSON Files (*.json)");
+        if (!filePath.isEmpty() && !OpMetrics::dumpJson(filePath)) {
+            QMessageBox::warning(this, "Save failed", "Could not write the metrics file.");
+        }
+    });
 
     return page;
 }
 
+void MainWindow::toggleDiagnosticsTab() {
+    if (!m_diagnosticsPage) {
+        m_diagnosticsPage = buildDiagnosticsTab();
+    }
+
+    int index = m_tabs->indexOf(m_diagnosticsPage);
+    if (index >= 0) {
+        m_tabs->removeTab(index);
+        return;
+    }
+    m_tabs->setCurrentIndex(m_tabs->addTab(m_diagnosticsPage, "Diagnostics"));
+    refreshDiagnostics();
+}
+
+void MainWindow::refreshDiagnostics() {
+    if (!m_diagnosticsText) return;
+    QString text = OpMetrics::toText();
+    if (m_firstFrameMs >= 0) {
+        text.prepend(QString("Time to first frame after login: %1 ms\n\n").arg(m_firstFrameMs));
+    }
+    if (!OpMetrics::enabled()) {
+        text.prepend("Recording is off – tick \"Record latencies\" to collect samples.\n\n");
+    }
+
+    const QJsonObject trace = UiProfiler::instance().toJson();
+    const QJsonArray stalls = trace["stalls"].toArray();
+    text += QString("\nUI trace: %1 interactions, %2 stalls over %3 ms\n")
+                .arg(trace["interactions"].toArray().size())
+                .arg(stalls.size())
+                .arg(trace["stall_threshold_ms"].toInt());
+    for (const QJsonValue &value : stalls) {
+        const QJsonObject stall = value.toObject();
+        text += QString("  %1  %2  lag %3 ms\n").arg(stall["at"].toString(), stall["name"].toString())
+                    .arg(stall["lag_ms"].toDouble(), 0, 'f', 0);
+        for (const QJsonValue &spanValue : stall["spans"].toArray()) {
+            const QJsonObject span = spanValue.toObject();
+            text += QString("      %1%2 %3 ms\n")
+                        .arg(QString(span["depth"].toInt() * 2, ' '), span["name"].toString())
+                        .arg(span["ms"].toDouble(), 0, 'f', 2);
+        }
+    }
+    m_diagnosticsText->setPlainText(text);
+}
 
 void MainWindow::refreshOverview() {
-    DBManager::applyMonthlyInterestForUser(m_userId);
+    OpTimer timer("MainWindow::refreshOverview");
+    UiSpan span("refreshOverview");
 
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT type, balance FROM accounts WHERE user_id = :user");
-    q.bindValue(":user", m_userId);
     double total = 0.0;
     double savings = 0.0;
-    if (q.exec()) {
-        while (q.next()) {
-            QString type = q.value(0).toString();
-            double bal = q.value(1).toDouble();
-            total += bal;
-            if (type.toLower().contains("sav")) savings += bal;
+    if (DBManager::accountBalances(m_userId, &m_balanceRows)) {
+        for (const AccountBalanceRow &account : m_balanceRows) {
+            const QByteArrayView type = m_balanceRows.text(account.type);
+            total += account.balance;
+            if (QLatin1String(type.data(), type.size()).contains(QLatin1String("sav"), Qt::CaseInsensitive)) {
+                savings += account.balance;
+            }
         }
     }
     m_overviewBalanceLabel->setText(QString("Total balance across all accounts: $%1").arg(total, 0, 'f', 2));
     m_overviewSavingsLabel->setText(QString("Total savings balance: $%1").arg(savings, 0, 'f', 2));
+
+    refreshSpendingInsights();
+}
+
+void MainWindow::refreshSpendingInsights() {
+    UiSpan span("refreshSpendingInsights");
+    // Only transactions newer than the last refresh are read
+    m_spending.refresh(DBManager::readDatabase(DBManager::shardForUser(m_userId)), m_userId);
+
+    const QDate today = QDate::currentDate();
+    const int thisMonth = SpendingSnapshot::monthIndex(today);
+    auto money = [](qint64 cents) { return QString("$%1").arg(cents / 100.0, 0, 'f', 2); };
+
+    const QVector<SpendingSnapshot::MonthFlow> flows = m_spending.trend(thisMonth, 12);
+    const SpendingSnapshot::MonthFlow &current = flows.last();
+    m_overviewMonthLabel->setText(QString("%1: %2 in, %3 out")
+                                      .arg(today.toString("MMMM yyyy"),
+                                           money(current.incomeCents), money(current.spendingCents)));
+
+    const QVector<SpendingSnapshot::Totals> byType = m_spending.totalsByType(thisMonth);
+    const QVector<SpendingSnapshot::Totals> byCategory = m_spending.totalsByCategory(thisMonth);
+    m_overviewBreakdownTable->setRowCount(byType.size() + byCategory.size());
+    int row = 0;
+    for (const SpendingSnapshot::Totals &t : byType) {
+        m_overviewBreakdownTable->setItem(row, 0, new QTableWidgetItem("Type"));
+        m_overviewBreakdownTable->setItem(row, 1, new QTableWidgetItem(t.label));
+        m_overviewBreakdownTable->setItem(row, 2, new QTableWidgetItem(money(t.cents)));
+        ++row;
+    }
+    for (const SpendingSnapshot::Totals &t : byCategory) {
+        m_overviewBreakdownTable->setItem(row, 0, new QTableWidgetItem("Bill category"));
+        m_overviewBreakdownTable->setItem(row, 1, new QTableWidgetItem(t.label));
+        m_overviewBreakdownTable->setItem(row, 2, new QTableWidgetItem(money(t.cents)));
+        ++row;
+    }
+
+    // Newest month first
+    m_overviewTrendTable->setRowCount(flows.size());
+    for (int i = 0; i < flows.size(); ++i) {
+        const SpendingSnapshot::MonthFlow &f = flows[flows.size() - 1 - i];
+        const QDate month(f.monthIndex / 12, f.monthIndex % 12 + 1, 1);
+        m_overviewTrendTable->setItem(i, 0, new QTableWidgetItem(month.toString("MMM yyyy")));
+        m_overviewTrendTable->setItem(i, 1, new QTableWidgetItem(money(f.incomeCents)));
+        m_overviewTrendTable->setItem(i, 2, new QTableWidgetItem(money(f.spendingCents)));
+        m_overviewTrendTable->setItem(i, 3, new QTableWidgetItem(money(f.incomeCents - f.spendingCents)));
+    }
 }
 
 void MainWindow::createNewAccount() {
+    UiProfiler::instance().markInteraction("Create account");
     QString type = m_accountTypeCombo->currentText();
     double initial = m_initialDepositEdit->text().toDouble();
 
@@ -482,6 +926,7 @@ void MainWindow::createNewAccount() {
 
     int id = DBManager::createAccount(m_userId, type, initial, rate);
     if (id > 0) {
+        SessionCache::invalidateAccounts(m_userId);
         refreshAccountsTables();
         refreshOverview();
         QMessageBox::information(this, "Account created",
@@ -493,6 +938,7 @@ void MainWindow::createNewAccount() {
 }
 
 void MainWindow::handleDeposit() {
+    UiProfiler::instance().markInteraction("Deposit");
     int accountId = m_depositAccountCombo->currentData().toInt();
     double amount = m_depositAmountEdit->text().toDouble();
     if (DBManager::deposit(accountId, amount)) {
@@ -507,6 +953,7 @@ void MainWindow::handleDeposit() {
 }
 
 void MainWindow::handleWithdraw() {
+    UiProfiler::instance().markInteraction("Withdraw");
     int accountId = m_withdrawAccountCombo->currentData().toInt();
     double amount = m_withdrawAmountEdit->text().toDouble();
     if (DBManager::withdraw(accountId, amount)) {
@@ -516,11 +963,12 @@ void MainWindow::handleWithdraw() {
                                  "Cash withdrawal completed successfully.");
     } else {
         QMessageBox::warning(this, "Withdrawal failed",
-                             "Withdrawal could not be completed. Check your balance and try again.");
+                             debitFailure("Withdrawal could not be completed. Check your balance and try again."));
     }
 }
 
 void MainWindow::handleInternalTransfer() {
+    UiProfiler::instance().markInteraction("Internal transfer");
     int fromId = m_transferFromCombo->currentData().toInt();
     int toId   = m_transferToCombo->currentData().toInt();
     double amount = m_transferAmountEdit->text().toDouble();
@@ -536,6 +984,7 @@ void MainWindow::handleInternalTransfer() {
 }
 
 void MainWindow::handleInteracTransfer() {
+    UiProfiler::instance().markInteraction("Interac transfer");
     int fromId = m_interacFromCombo->currentData().toInt();
     QString email = m_interacEmailEdit->text();
     double amount = m_interacAmountEdit->text().toDouble();
@@ -547,12 +996,13 @@ void MainWindow::handleInteracTransfer() {
                                  "Amount was sent successfully.");
     } else {
         QMessageBox::warning(this, "Interac failed",
-                             "We couldn't complete this Interac transfer. "
-                             "Check the recipient email and balance.");
+                             debitFailure("We couldn't complete this Interac transfer. "
+                                          "Check the recipient email and balance."));
     }
 }
 
 void MainWindow::handleApplyCreditCard() {
+    UiProfiler::instance().markInteraction("Apply for card");
     double limit = m_cardLimitEdit->text().toDouble();
     int id = DBManager::applyForCreditCard(m_userId, limit);
     if (id > 0) {
@@ -566,9 +1016,25 @@ void MainWindow::handleApplyCreditCard() {
 }
 
 void MainWindow::handleBillPayment() {
+    UiProfiler::instance().markInteraction("Bill payment");
     int fromId = m_billFromCombo->currentData().toInt();
     int payeeId = m_billPayeeCombo->currentData().toInt();
     double amount = m_billAmountEdit->text().toDouble();
+    QString when = m_billWhenCombo->currentData().toString();
+
+    if (when != "Now") {
+        int id = DBManager::scheduleBillPayment(m_userId, fromId, payeeId, amount,
+                                                when, m_billDateEdit->date());
+        if (id > 0) {
+            refreshScheduledPayments();
+            QMessageBox::information(this, "Payment scheduled",
+                                     "Your bill payment has been scheduled.");
+        } else {
+            QMessageBox::warning(this, "Scheduling failed",
+                                 "We couldn't schedule this bill payment. Check the amount and date.");
+        }
+        return;
+    }
 
     if (DBManager::payBill(m_userId, fromId, payeeId, amount)) {
         refreshAccountsTables();
@@ -582,6 +1048,7 @@ void MainWindow::handleBillPayment() {
 }
 
 void MainWindow::handleCardSpend() {
+    UiProfiler::instance().markInteraction("Card purchase");
     int cardId = m_cardSpendCardCombo->currentData().toInt();
     double amount = m_cardSpendAmountEdit->text().toDouble();
     if (DBManager::spendOnCard(cardId, amount)) {
@@ -590,11 +1057,12 @@ void MainWindow::handleCardSpend() {
                                  "The amount was added to your card balance.");
     } else {
         QMessageBox::warning(this, "Purchase failed",
-                             "Card purchase could not be simulated. Check limit and amount.");
+                             debitFailure("Card purchase could not be simulated. Check limit and amount."));
     }
 }
 
 void MainWindow::handleCardPayment() {
+    UiProfiler::instance().markInteraction("Card payment");
     int fromAccountId = m_cardPayFromAccountCombo->currentData().toInt();
     int cardId = m_cardPayCardCombo->currentData().toInt();
     double amount = m_cardPayAmountEdit->text().toDouble();
@@ -611,30 +1079,30 @@ void MainWindow::handleCardPayment() {
 }
 
 void MainWindow::refreshAccountsTables() {
+    OpTimer timer("MainWindow::refreshAccountsTables");
+    UiSpan span("refreshAccountsTables");
     // Table model
-    auto *model = new QSqlQueryModel(this);
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT account_number AS 'Account', type AS 'Type', "
-              "printf('%.2f', balance) AS 'Balance', "
-              "printf('%.3f', interest_rate) AS 'Rate' "
-              "FROM accounts WHERE user_id = :user");
-    q.bindValue(":user", m_userId);
-    q.exec();
-    model->setQuery(q);
-    m_accountsTable->setModel(model);
+    if (m_accountsTable) {
+        UiSpan reset("accounts model reset");
+        QSqlQuery q(DBManager::userDatabase(m_userId));
+        q.prepare("SELECT account_number AS 'Account', type AS 'Type', "
+                  "printf('%.2f', balance) AS 'Balance', "
+                  "printf('%.3f', interest_rate) AS 'Rate' "
+                  "FROM accounts WHERE user_id = :user");
+        q.bindValue(":user", m_userId);
+        SlowQueryLog::exec(q);
+        requery(m_accountsTable, m_accountsModel, q);
+    }
 
-    // Fill combo boxes with account id + display text
+    // Fill combo boxes with account id + display text. The list is shared
+    // with every other session open for this user.
+    m_accountList = SessionCache::accounts(m_userId);
     auto fillCombo = [this](QComboBox *combo) {
+        if (!combo) return; // tab not built yet
+        UiSpan fill("account combo repopulate");
         combo->clear();
-        QSqlQuery query(DBManager::database());
-        query.prepare("SELECT id, account_number, type FROM accounts WHERE user_id = :user");
-        query.bindValue(":user", m_userId);
-        if (query.exec()) {
-            while (query.next()) {
-                int id = query.value(0).toInt();
-                QString label = QString("%1 (%2)").arg(query.value(1).toString(), query.value(2).toString());
-                combo->addItem(label, id);
-            }
+        for (const SessionCache::Item &account : *m_accountList) {
+            combo->addItem(account.label, account.id);
         }
     };
 
@@ -644,43 +1112,39 @@ void MainWindow::refreshAccountsTables() {
     fillCombo(m_transferToCombo);
     fillCombo(m_interacFromCombo);
     fillCombo(m_billFromCombo);
-
-    // Statements account combo
-    m_statementsAccountCombo->clear();
-    QSqlQuery q2(DBManager::database());
-    q2.prepare("SELECT id, account_number, type FROM accounts WHERE user_id = :user");
-    q2.bindValue(":user", m_userId);
-    if (q2.exec()) {
-        while (q2.next()) {
-            int id = q2.value(0).toInt();
-            QString label = QString("%1 (%2)").arg(q2.value(1).toString(), q2.value(2).toString());
-            m_statementsAccountCombo->addItem(label, id);
-        }
-    }
+    fillCombo(m_statementsAccountCombo);
 }
 
 void MainWindow::refreshCreditCards() {
-    auto *model = new QSqlQueryModel(this);
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT id, card_number AS 'Card', "
-              "printf('%.2f', credit_limit) AS 'Limit', "
-              "printf('%.2f', current_balance) AS 'Balance', "
-              "status AS 'Status' "
-              "FROM credit_cards WHERE user_id = :user");
-    q.bindValue(":user", m_userId);
-    q.exec();
-    model->setQuery(q);
-    m_cardsTable->setModel(model);
-    m_cardsTable->hideColumn(0); // internal id
+    OpTimer timer("MainWindow::refreshCreditCards");
+    UiSpan span("refreshCreditCards");
+    if (!m_cardsTable) return;
+    {
+        UiSpan reset("cards model reset");
+        QSqlQuery q(DBManager::userDatabase(m_userId));
+        q.prepare("SELECT id, card_number AS 'Card', "
+                  "printf('%.2f', credit_limit) AS 'Limit', "
+                  "printf('%.2f', current_balance) AS 'Balance', "
+                  "printf('%.2f', statement_balance) AS 'Statement', "
+                  "printf('%.2f', min_payment) AS 'Min Payment', "
+                  "payment_due_date AS 'Due', "
+                  "status AS 'Status' "
+                  "FROM credit_cards WHERE user_id = :user");
+        q.bindValue(":user", m_userId);
+        SlowQueryLog::exec(q);
+        requery(m_cardsTable, m_cardsModel, q);
+        m_cardsTable->hideColumn(0); // internal id
+    }
 
     // Fill combos for card actions
+    UiSpan fill("card combos repopulate");
     m_cardSpendCardCombo->clear();
     m_cardPayCardCombo->clear();
 
-    QSqlQuery q2(DBManager::database());
+    QSqlQuery q2(DBManager::userDatabase(m_userId));
     q2.prepare("SELECT id, card_number FROM credit_cards WHERE user_id = :user");
     q2.bindValue(":user", m_userId);
-    if (q2.exec()) {
+    if (SlowQueryLog::exec(q2)) {
         while (q2.next()) {
             int id = q2.value(0).toInt();
             QString label = q2.value(1).toString();
@@ -691,61 +1155,154 @@ void MainWindow::refreshCreditCards() {
 
     // Pay from account combo uses accounts of this user
     m_cardPayFromAccountCombo->clear();
-    QSqlQuery q3(DBManager::database());
-    q3.prepare("SELECT id, account_number, type FROM accounts WHERE user_id = :user");
-    q3.bindValue(":user", m_userId);
-    if (q3.exec()) {
-        while (q3.next()) {
-            int id = q3.value(0).toInt();
-            QString label = QString("%1 (%2)").arg(q3.value(1).toString(), q3.value(2).toString());
-            m_cardPayFromAccountCombo->addItem(label, id);
-        }
+    m_accountList = SessionCache::accounts(m_userId);
+    for (const SessionCache::Item &account : *m_accountList) {
+        m_cardPayFromAccountCombo->addItem(account.label, account.id);
     }
 }
 
 void MainWindow::refreshStatements() {
+    OpTimer timer("MainWindow::refreshStatements");
+    UiSpan span("refreshStatements");
+    if (!m_statementsAccountCombo) return;
     int accountId = m_statementsAccountCombo->currentData().toInt();
     if (accountId <= 0) return;
 
-    auto *model = new QSqlQueryModel(this);
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT timestamp AS 'When', type AS 'Type', "
-              "printf('%.2f', amount) AS 'Amount', description AS 'Description' "
-              "FROM transactions WHERE account_id = :acc "
-              "ORDER BY datetime(timestamp) DESC LIMIT 100");
-    q.bindValue(":acc", accountId);
-    q.exec();
-    model->setQuery(q);
-    m_statementsTable->setModel(model);
+    // A closed month reads one header and one month of rows
+    const QString period = m_statementsPeriodCombo->currentData().toString();
+    const StatementHeader header = period.isEmpty() ? StatementHeader()
+                                                    : DBManager::statementHeader(accountId, period);
+    m_statementsSummaryLabel->setVisible(header.isValid());
+    if (header.isValid()) m_statementsSummaryLabel->setText(statementSummary(header));
+
+    UiSpan reset("statements model reset");
+    QSqlQuery q(DBManager::readDatabase(DBManager::shardForUser(m_userId)));
+    const QString search = m_statementsSearchEdit->text().trimmed();
+    bool searched = true;
+    bool keyed = false;
+    if (!search.isEmpty()) {
+        searched = DBManager::searchTransactions(q, accountId, search, kStatementPageSize,
+                                                 m_statementsPage * kStatementPageSize);
+    } else if (header.isValid()) {
+        q.prepare("SELECT timestamp AS 'When', type AS 'Type', "
+                  "printf('%.2f', amount) AS 'Amount', printf('%.2f', balance_after) AS 'Balance', "
+                  "description AS 'Description' "
+                  "FROM transactions WHERE account_id = :acc AND id > :after AND id <= :last "
+                  "ORDER BY id DESC LIMIT :n OFFSET :off");
+        q.bindValue(":acc", accountId);
+        q.bindValue(":after", header.afterTransactionId);
+        q.bindValue(":last", header.lastTransactionId);
+        q.bindValue(":n", kStatementPageSize);
+        q.bindValue(":off", m_statementsPage * kStatementPageSize);
+        SlowQueryLog::exec(q);
+    } else {
+        // Keyset paging on idx_transactions_account: a page starts below the
+        // last ID of the one before, so deep pages cost the same as the first
+        if (m_statementsPage == 0) m_statementsPageBefore = {std::numeric_limits<qint64>::max()};
+        q.prepare("SELECT id, timestamp AS 'When', type AS 'Type', "
+                  "printf('%.2f', amount) AS 'Amount', printf('%.2f', balance_after) AS 'Balance', "
+                  "description AS 'Description' "
+                  "FROM transactions WHERE account_id = :acc AND id < :before "
+                  "ORDER BY id DESC LIMIT :n");
+        q.bindValue(":acc", accountId);
+        q.bindValue(":before", m_statementsPageBefore.value(m_statementsPage, std::numeric_limits<qint64>::max()));
+        q.bindValue(":n", kStatementPageSize);
+        SlowQueryLog::exec(q);
+        keyed = true;
+    }
+    requery(m_statementsTable, m_statementsModel, q);
+    m_statementsTable->setColumnHidden(0, keyed);
+
+    const int rows = m_statementsModel->rowCount();
+    if (keyed && rows > 0) {
+        m_statementsPageBefore.resize(m_statementsPage + 1);
+        m_statementsPageBefore.append(m_statementsModel->record(rows - 1).value(0).toLongLong());
+    }
+    m_statementsPrevButton->setEnabled(m_statementsPage > 0);
+    m_statementsNextButton->setEnabled(rows == kStatementPageSize);
+    if (!searched) {
+        m_statementsPageLabel->setText(QString("Type at least %1 characters to search")
+                                           .arg(DBManager::searchMinWordLength));
+    } else {
+        m_statementsPageLabel->setText(rows == 0 ? QString("No transactions")
+                                                 : QString("Page %1").arg(m_statementsPage + 1));
+    }
+}
+
+void MainWindow::refreshStatementPeriods() {
+    OpTimer timer("MainWindow::refreshStatementPeriods");
+    UiSpan span("refreshStatementPeriods");
+    if (!m_statementsPeriodCombo) return;
+    const int accountId = m_statementsAccountCombo->currentData().toInt();
+    {
+        QSignalBlocker block(m_statementsPeriodCombo);
+        m_statementsPeriodCombo->clear();
+        m_statementsPeriodCombo->addItem("Recent activity", QString());
+        if (accountId > 0) {
+            for (const QString &period : DBManager::statementPeriods(accountId)) {
+                const QDate month = QDate::fromString(period + "-01", "yyyy-MM-dd");
+                m_statementsPeriodCombo->addItem(month.toString("MMMM yyyy"), period);
+            }
+        }
+    }
+    refreshStatements();
 }
 
 void MainWindow::refreshBillPayees() {
+    OpTimer timer("MainWindow::refreshBillPayees");
+    UiSpan span("refreshBillPayees");
     if (!m_billPayeeCombo) return;
     m_billPayeeCombo->clear();
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT id, name, category FROM bill_payees ORDER BY name");
-    if (q.exec()) {
-        while (q.next()) {
-            int id = q.value(0).toInt();
-            QString name = q.value(1).toString();
-            QString cat  = q.value(2).toString();
-            QString label = cat.isEmpty() ? name : QString("%1 (%2)").arg(name, cat);
-            m_billPayeeCombo->addItem(label, id);
-        }
+    m_payeeList = SessionCache::payees();
+    for (const SessionCache::Item &payee : *m_payeeList) {
+        m_billPayeeCombo->addItem(payee.label, payee.id);
+    }
+}
+
+void MainWindow::refreshScheduledPayments() {
+    OpTimer timer("MainWindow::refreshScheduledPayments");
+    UiSpan span("refreshScheduledPayments");
+    if (!m_scheduledTable) return;
+    UiSpan reset("scheduled model reset");
+    QSqlQuery q(DBManager::userDatabase(m_userId));
+    q.prepare("SELECT s.id, p.name AS 'Payee', a.account_number AS 'From', "
+              "printf('%.2f', s.amount) AS 'Amount', s.frequency AS 'Frequency', "
+              "s.next_due AS 'Next due', s.status AS 'Status' "
+              "FROM scheduled_payments s "
+              "JOIN bill_payees p ON p.id = s.payee_id "
+              "JOIN accounts a ON a.id = s.from_account_id "
+              "WHERE s.user_id = :user AND s.status IN ('Active', 'Failed') "
+              "ORDER BY s.next_due");
+    q.bindValue(":user", m_userId);
+    SlowQueryLog::exec(q);
+    requery(m_scheduledTable, m_scheduledModel, q);
+    m_scheduledTable->hideColumn(0); // internal id
+}
+
+void MainWindow::handleCancelScheduledPayment() {
+    UiProfiler::instance().markInteraction("Cancel schedule");
+    QModelIndex current = m_scheduledTable->currentIndex();
+    if (!current.isValid()) {
+        QMessageBox::warning(this, "Nothing selected", "Select a scheduled payment first.");
+        return;
+    }
+    int scheduleId = m_scheduledTable->model()->index(current.row(), 0).data().toInt();
+    if (DBManager::cancelScheduledPayment(m_userId, scheduleId)) {
+        refreshScheduledPayments();
+    } else {
+        QMessageBox::warning(this, "Cancel failed",
+                             "This scheduled payment could not be cancelled.");
     }
 }
 
 void MainWindow::refreshFaqs() {
+    OpTimer timer("MainWindow::refreshFaqs");
+    UiSpan span("refreshFaqs");
+    if (!m_faqList) return;
     m_faqList->clear();
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT question, answer FROM faqs ORDER BY id");
-    if (q.exec()) {
-        while (q.next()) {
-            QString text = QString("Q: %1\nA: %2")
-                           .arg(q.value(0).toString())
-                           .arg(q.value(1).toString());
-            m_faqList->addItem(text);
-        }
+    m_faqItems = SessionCache::faqs();
+    for (const SessionCache::Item &faq : *m_faqItems) {
+        m_faqList->addItem(faq.label);
     }
 }
 
@@ -791,41 +1348,85 @@ void MainWindow::exportStatementsAsPdf()
     if (filePath.isEmpty())
         return;
 
+    // The rows are read on a pool thread from a read snapshot so a long
+    // statement neither blocks postings nor freezes the window.
+    const QString accountLabel = m_statementsAccountCombo->currentText();
+    const QString period = m_statementsPeriodCombo->currentData().toString();
+    const StatementHeader header = period.isEmpty() ? StatementHeader()
+                                                    : DBManager::statementHeader(accountId, period);
+    m_exportButton->setEnabled(false);
+    m_exportButton->setText("Exporting…");
+
+    QPointer<MainWindow> self(this);
+    const int shard = DBManager::shardForUser(m_userId);
+    QThreadPool::globalInstance()->start([self, accountId, accountLabel, filePath, shard, header]() {
+        // Build HTML contents
+        QString html;
+        html += "<h2>Sudbury Student Bank – Account Statement</h2>";
+        html += "<p><b>Account:</b> " + accountLabel + "</p>";
+        if (header.isValid()) {
+            html += "<p><b>Period:</b> " + header.period + "<br>"
+                    + statementSummary(header).toHtmlEscaped().replace("\n", "<br>") + "</p>";
+        }
+        html += "<hr>";
+
+        html += "<table border='1' cellspacing='0' cellpadding='4' width='100%'>";
+        html += "<tr style='background:#EEE; font-weight:bold;'>"
+                "<td>Date</td><td>Type</td><td>Amount</td><td>Balance</td><td>Description</td>"
+                "</tr>";
+
+        {
+            ReadSnapshot snapshot(shard);
+            QSqlQuery q(snapshot.database());
+            q.setForwardOnly(true);
+            if (header.isValid()) {
+                q.prepare("SELECT timestamp, type, amount, description, balance_after "
+                          "FROM transactions WHERE account_id = :acc AND id > :after AND id <= :last "
+                          "ORDER BY id DESC");
+                q.bindValue(":after", header.afterTransactionId);
+                q.bindValue(":last", header.lastTransactionId);
+            } else {
+                q.prepare("SELECT timestamp, type, amount, description, balance_after "
+                          "FROM transactions WHERE account_id = :acc "
+                          "ORDER BY id DESC");
+            }
+            q.bindValue(":acc", accountId);
+            SlowQueryLog::exec(q);
+
+            while (q.next()) {
+                html += "<tr>";
+                html += "<td>" + q.value(0).toString() + "</td>";
+                html += "<td>" + q.value(1).toString() + "</td>";
+                html += "<td>$" + QString::number(q.value(2).toDouble(), 'f', 2) + "</td>";
+                html += "<td>" + (q.value(4).isNull() ? QString()
+                                                      : "$" + QString::number(q.value(4).toDouble(), 'f', 2))
+                        + "</td>";
+                html += "<td>" + q.value(3).toString() + "</td>";
+                html += "</tr>";
+            }
+        }
+        DBManager::releaseThreadConnection();
+
+        html += "</table>";
+
+        QMetaObject::invokeMethod(qApp, [self, filePath, html]() {
+            if (self) self->finishStatementExport(filePath, html);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::finishStatementExport(const QString &filePath, const QString &html)
+{
+    UiSpan span("statement PDF render");
+    m_exportButton->setEnabled(true);
+    m_exportButton->setText("Export as PDF");
+
     // QPrinter in PDF mode
     QPrinter printer(QPrinter::HighResolution);
     printer.setOutputFormat(QPrinter::PdfFormat);
     printer.setOutputFileName(filePath);
     printer.setPageMargins(QMarginsF(15, 15, 15, 15));
 
-    // Build HTML contents
-    QString html;
-    html += "<h2>Sudbury Student Bank – Account Statement</h2>";
-    html += "<p><b>Account:</b> " + m_statementsAccountCombo->currentText() + "</p>";
-    html += "<hr>";
-
-    html += "<table border='1' cellspacing='0' cellpadding='4' width='100%'>";
-    html += "<tr style='background:#EEE; font-weight:bold;'>"
-            "<td>Date</td><td>Type</td><td>Amount</td><td>Description</td>"
-            "</tr>";
-
-    QSqlQuery q(DBManager::database());
-    q.prepare("SELECT timestamp, type, amount, description "
-              "FROM transactions WHERE account_id = :acc "
-              "ORDER BY datetime(timestamp) DESC");
-    q.bindValue(":acc", accountId);
-    q.exec();
-
-    while (q.next()) {
-        html += "<tr>";
-        html += "<td>" + q.value(0).toString() + "</td>";
-        html += "<td>" + q.value(1).toString() + "</td>";
-        html += "<td>$" + QString::number(q.value(2).toDouble(), 'f', 2) + "</td>";
-        html += "<td>" + q.value(3).toString() + "</td>";
-        html += "</tr>";
-    }
-
-    html += "</table>";
-
     // Generate PDF using HTML
     QTextDocument doc;
     doc.setHtml(html);
@@ -3,20 +3,35 @@
 
 #include <QMainWindow>
 #include <QPushButton>
+#include <QElapsedTimer>
+#include "spendingsnapshot.h"
+#include "sessioncache.h"
+#include "dbmanager.h"
 
 class QTabWidget;
 class QTableView;
+class QSqlQueryModel;
+class QTableWidget;
 class QComboBox;
 class QLineEdit;
 class QLabel;
 class QTextEdit;
 class QListWidget;
+class QDateEdit;
+class QPlainTextEdit;
+class QTimer;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
+    friend class DashboardSoak; // drives the refreshes directly (soakmain.cpp)
 public:
     explicit MainWindow(int userId, QWidget *parent = nullptr);
 
+    // Teller mode: the window is one page of a TellerWindow. Tabs are built
+    // only when opened, and the teller closes the session instead of Logout.
+    void setEmbedded(bool embedded);
+    int userId() const { return m_userId; }
+
 private slots:
     void refreshOverview();
     void createNewAccount();
@@ -31,8 +46,13 @@ private slots:
     void refreshAccountsTables();
     void refreshCreditCards();
     void refreshStatements();
+    void refreshStatementPeriods();
     void refreshFaqs();
     void refreshBillPayees();
+    void refreshScheduledPayments();
+    void handleCancelScheduledPayment();
+    void toggleDiagnosticsTab();
+    void refreshDiagnostics();
 
     void handleLogout();              // <-- LOGOUT
     void exportStatementsAsPdf();     // <-- NEW PDF EXPORT SLOT
@@ -47,18 +67,34 @@ private:
     QWidget* buildProfileTab();
     QWidget* buildFaqTab();
     QWidget* buildStatementsTab();
+    QWidget* buildDiagnosticsTab();
+    void finishStatementExport(const QString &filePath, const QString &html);
+
+    // Startup: only the Overview is built before the first frame. Other
+    // tabs are built and filled when first opened, or by the idle-time
+    // prefetch that starts after the first frame.
+    void ensureTabBuilt(int index);
+    void loadAfterFirstFrame();
+    void prefetchNextTab();
+    void refreshSpendingInsights();
 
     void resizeEvent(QResizeEvent *event) override;   // <-- logout button positioning
+    void paintEvent(QPaintEvent *event) override;
 
     int m_userId;
+    bool m_embedded;
 
     bool eventFilter(QObject *obj, QEvent *event) override;
     QLabel *avatar;  // reuse your existing avatar pointer
 
 
     QTabWidget *m_tabs;
+    QList<QWidget *> m_lazyPages;   // placeholder per tab, null once built
+    QElapsedTimer m_startupClock;
+    qint64 m_firstFrameMs;
 
     QTableView *m_accountsTable;
+    QSqlQueryModel *m_accountsModel;
     QComboBox  *m_accountTypeCombo;
     QLineEdit  *m_initialDepositEdit;
     QLineEdit  *m_savingsRateEdit;
@@ -78,6 +114,7 @@ private:
     QLineEdit  *m_interacAmountEdit;
 
     QTableView *m_cardsTable;
+    QSqlQueryModel *m_cardsModel;
     QLineEdit  *m_cardLimitEdit;
 
     QComboBox  *m_cardSpendCardCombo;
@@ -89,15 +126,43 @@ private:
     QComboBox  *m_billFromCombo;
     QComboBox  *m_billPayeeCombo;
     QLineEdit  *m_billAmountEdit;
+    QComboBox  *m_billWhenCombo;
+    QDateEdit  *m_billDateEdit;
+    QTableView *m_scheduledTable;
+    QSqlQueryModel *m_scheduledModel;
 
     QLabel     *m_overviewBalanceLabel;
     QLabel     *m_overviewSavingsLabel;
+    QLabel       *m_overviewMonthLabel;
+    QTableWidget *m_overviewBreakdownTable;
+    QTableWidget *m_overviewTrendTable;
+    SpendingSnapshot m_spending;
+    RowSet<AccountBalanceRow> m_balanceRows; // reused by every overview refresh
 
     QTableView *m_statementsTable;
+    QSqlQueryModel *m_statementsModel;
     QComboBox  *m_statementsAccountCombo;
+    QComboBox  *m_statementsPeriodCombo;
+    QLabel     *m_statementsSummaryLabel;
+    QLineEdit  *m_statementsSearchEdit;
+    QTimer     *m_statementsSearchTimer;
+    QPushButton *m_statementsPrevButton;
+    QPushButton *m_statementsNextButton;
+    QLabel     *m_statementsPageLabel;
+    int         m_statementsPage;
+    QVector<qint64> m_statementsPageBefore; // per page visited: the ID it starts below
+    QPushButton *m_exportButton;
 
     QListWidget *m_faqList;
 
+    // Shared with the other open sessions (see SessionCache)
+    SessionCache::Handle m_accountList;
+    SessionCache::Handle m_payeeList;
+    SessionCache::Handle m_faqItems;
+
+    QWidget        *m_diagnosticsPage;
+    QPlainTextEdit *m_diagnosticsText;
+
     QPushButton *logoutButton;
 
 };
@@ -0,0 +1,374 @@
+#include "memorybackend.h"
+#include "opmetrics.h"
+#include "riskengine.h"
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+MemoryBackend::MemoryBackend() {
+    // Same payees as DBManager adds to a new database
+    m_payeeCount = 4; // Hydro One, Bell Canada, Netflix, City of Sudbury Property Tax
+}
+
+bool MemoryBackend::seedSampleData() {
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_users.empty()) return false;
+    }
+    createUser("alice@example.com", "Password123!", "Alice Blue", QDate(2002, 1, 15));
+    createUser("bob@example.com", "Password123!", "Bob Noir", QDate(2001, 4, 3));
+    const int aliceId = m_userByEmail.value("alice@example.com");
+    const int bobId = m_userByEmail.value("bob@example.com");
+
+    const int aliceChequing = createAccount(aliceId, "Chequing", 3500.0, 0.0);
+    createAccount(aliceId, "Savings", 8200.0, 0.012);
+    const int bobChequing = createAccount(bobId, "Chequing", 900.0, 0.0);
+
+    registerInteracEmail(aliceId, aliceChequing, "alice.interac@example.com");
+    registerInteracEmail(bobId, bobChequing, "bob.interac@example.com");
+
+    applyForCreditCard(aliceId, 5000.0);
+    return true;
+}
+
+MemoryBackend::Account *MemoryBackend::account(int accountId) {
+    if (accountId <= 0 || accountId > int(m_accounts.size())) return nullptr;
+    return &m_accounts[accountId - 1];
+}
+
+MemoryBackend::Card *MemoryBackend::card(int cardId) {
+    if (cardId <= 0 || cardId > int(m_cards.size())) return nullptr;
+    return &m_cards[cardId - 1];
+}
+
+void MemoryBackend::record(int accountId, const char *type, double amount,
+                           const char *description, int relatedAccountId) {
+    m_transactions.push_back({accountId, type, amount, description, relatedAccountId});
+}
+
+bool MemoryBackend::createUser(const QString &email, const QString &password,
+                               const QString &username, const QDate &dob) {
+    OpTimer timer("MemoryBackend::createUser");
+    QMutexLocker locker(&m_mutex);
+    const QString key = email.trimmed();
+    if (key.isEmpty() || m_userByEmail.contains(key)) return timer.finish(false);
+    m_users.push_back({key, password, username.trimmed(), dob});
+    m_userByEmail.insert(key, int(m_users.size()));
+    return timer.finish(true);
+}
+
+int MemoryBackend::authenticateUser(const QString &email, const QString &password) {
+    OpTimer timer("MemoryBackend::authenticateUser");
+    QMutexLocker locker(&m_mutex);
+    const int userId = m_userByEmail.value(email.trimmed(), -1);
+    if (userId < 0 || m_users[userId - 1].password != password) return timer.finish(-1);
+    return timer.finish(userId);
+}
+
+int MemoryBackend::createAccount(int userId, const QString &type,
+                                 double initialBalance, double interestRate) {
+    OpTimer timer("MemoryBackend::createAccount");
+    QMutexLocker locker(&m_mutex);
+    if (userId <= 0 || userId > int(m_users.size())) return timer.finish(-1);
+    m_accounts.push_back({userId, type, initialBalance, interestRate, QDate::currentDate()});
+    return timer.finish(int(m_accounts.size()));
+}
+
+bool MemoryBackend::deposit(int accountId, double amount) {
+    OpTimer timer("MemoryBackend::deposit");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    Account *acc = account(accountId);
+    if (!acc) return timer.finish(false);
+    acc->balance += amount;
+    record(accountId, "Deposit", amount, "Cash deposit");
+    return timer.finish(true);
+}
+
+bool MemoryBackend::withdraw(int accountId, double amount) {
+    OpTimer timer("MemoryBackend::withdraw");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Account, accountId, amount, [&]() {
+        Account *acc = account(accountId);
+        if (!acc || acc->balance < amount) return false;
+        acc->balance -= amount;
+        record(accountId, "Withdrawal", amount, "Cash withdrawal");
+        return true;
+    }));
+}
+
+bool MemoryBackend::transferLocked(int fromAccountId, int toAccountId, double amount) {
+    Account *from = account(fromAccountId);
+    Account *to = account(toAccountId);
+    if (!from || !to || from->balance < amount) return false;
+    from->balance -= amount;
+    to->balance += amount;
+    return true;
+}
+
+bool MemoryBackend::transferAccountToAccount(int fromAccountId, int toAccountId, double amount) {
+    OpTimer timer("MemoryBackend::transferAccountToAccount");
+    if (amount <= 0 || fromAccountId == toAccountId) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    if (!transferLocked(fromAccountId, toAccountId, amount)) return timer.finish(false);
+    record(fromAccountId, "Transfer Out", amount, "Transfer to another account", toAccountId);
+    record(toAccountId, "Transfer In", amount, "Transfer from another account", fromAccountId);
+    return timer.finish(true);
+}
+
+bool MemoryBackend::registerInteracEmail(int userId, int accountId, const QString &email) {
+    OpTimer timer("MemoryBackend::registerInteracEmail");
+    QMutexLocker locker(&m_mutex);
+    Account *acc = account(accountId);
+    if (!acc || acc->userId != userId) return timer.finish(false);
+    m_interac.insert(email.trimmed().toLower(), accountId);
+    return timer.finish(true);
+}
+
+bool MemoryBackend::interacTransfer(int fromAccountId, const QString &toEmail, double amount) {
+    OpTimer timer("MemoryBackend::interacTransfer");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    const int destAccountId = m_interac.value(toEmail.trimmed().toLower(), -1);
+    if (destAccountId < 0 || destAccountId == fromAccountId) return timer.finish(false);
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Account, fromAccountId, amount, [&]() {
+        if (!transferLocked(fromAccountId, destAccountId, amount)) return false;
+        record(fromAccountId, "Interac Out", amount, "Interac e-Transfer sent", destAccountId);
+        record(destAccountId, "Interac In", amount, "Interac e-Transfer received", fromAccountId);
+        return true;
+    }));
+}
+
+MemoryBackend::PostingResult MemoryBackend::postBillPayment(int userId, int fromAccountId,
+                                                            int payeeId, double amount) {
+    Account *acc = account(fromAccountId);
+    if (!acc || payeeId <= 0 || payeeId > m_payeeCount) return PostingResult::Failed;
+    if (acc->balance < amount) return PostingResult::InsufficientFunds;
+    acc->balance -= amount;
+    m_billPayments.push_back({userId, fromAccountId, payeeId, amount});
+    record(fromAccountId, "Bill Payment", amount, "Bill payment to registered payee");
+    return PostingResult::Ok;
+}
+
+bool MemoryBackend::payBill(int userId, int fromAccountId, int payeeId, double amount) {
+    OpTimer timer("MemoryBackend::payBill");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    return timer.finish(postBillPayment(userId, fromAccountId, payeeId, amount) == PostingResult::Ok);
+}
+
+int MemoryBackend::scheduleBillPayment(int userId, int fromAccountId, int payeeId, double amount,
+                                       const QString &frequency, const QDate &firstDue) {
+    OpTimer timer("MemoryBackend::scheduleBillPayment");
+    if (amount <= 0 || !firstDue.isValid()) return timer.finish(-1);
+    if (frequency != "Once" && frequency != "Weekly" && frequency != "Monthly") return timer.finish(-1);
+    QMutexLocker locker(&m_mutex);
+    // The schedule debits unattended, so the account must be the user's
+    const Account *acc = account(fromAccountId);
+    if (userId <= 0 || !acc || acc->userId != userId) return timer.finish(-1);
+    m_schedules.push_back({userId, fromAccountId, payeeId, amount, frequency, firstDue.day(), firstDue});
+    return timer.finish(int(m_schedules.size()));
+}
+
+bool MemoryBackend::cancelScheduledPayment(int userId, int scheduleId) {
+    OpTimer timer("MemoryBackend::cancelScheduledPayment");
+    QMutexLocker locker(&m_mutex);
+    if (scheduleId <= 0 || scheduleId > int(m_schedules.size())) return timer.finish(false);
+    Schedule &s = m_schedules[scheduleId - 1];
+    if (s.userId != userId || qstrcmp(s.status, "Active") != 0) return timer.finish(false);
+    s.status = "Cancelled";
+    return timer.finish(true);
+}
+
+ScheduledRunStats MemoryBackend::runDueScheduledPayments(const QDate &asOf, int userId) {
+    OpTimer opTimer("MemoryBackend::runDueScheduledPayments");
+    ScheduledRunStats stats;
+    QElapsedTimer timer;
+    timer.start();
+    const QDate retryDate = asOf.addDays(qMax(1, DBManager::scheduledRetryDelayDays));
+
+    QMutexLocker locker(&m_mutex);
+    for (Schedule &s : m_schedules) {
+        if (qstrcmp(s.status, "Active") != 0 || s.nextDue > asOf) continue;
+        if (userId > 0 && s.userId != userId) continue;
+        ++stats.due;
+
+        // Only a shortfall is worth retrying; later cycles follow the
+        // original due date, not the retry date
+        const QDate cycleDue = s.cycleDue.isValid() ? s.cycleDue : s.nextDue;
+        const PostingResult r = postBillPayment(s.userId, s.accountId, s.payeeId, s.amount);
+        if (r == PostingResult::InsufficientFunds && s.retries < DBManager::scheduledMaxRetries) {
+            ++stats.retried;
+            ++s.retries;
+            s.nextDue = retryDate;
+            s.cycleDue = cycleDue;
+            continue;
+        }
+        if (r == PostingResult::Ok) ++stats.paid;
+        else ++stats.failed;
+        s.retries = 0;
+        s.cycleDue = QDate();
+
+        if (r == PostingResult::Failed) {
+            s.status = "Failed";
+        } else if (s.frequency == "Once") {
+            s.status = (r == PostingResult::Ok) ? "Completed" : "Failed";
+        } else {
+            s.nextDue = DBManager::nextScheduledDate(s.frequency, cycleDue, s.dayOfMonth, asOf);
+        }
+    }
+
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+int MemoryBackend::applyForCreditCard(int userId, double creditLimit) {
+    OpTimer timer("MemoryBackend::applyForCreditCard");
+    if (creditLimit < 2000.0) creditLimit = 2000.0; // minimum limit
+    QMutexLocker locker(&m_mutex);
+    if (userId <= 0 || userId > int(m_users.size())) return timer.finish(-1);
+    Card c;
+    c.userId = userId;
+    c.creditLimit = creditLimit;
+    m_cards.push_back(c);
+    return timer.finish(int(m_cards.size()));
+}
+
+bool MemoryBackend::spendOnCard(int cardId, double amount) {
+    OpTimer timer("MemoryBackend::spendOnCard");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    return timer.finish(RiskEngine::instance().withinLimits(RiskEngine::Scope::Card, cardId, amount, [&]() {
+        Card *c = card(cardId);
+        if (!c || c->currentBalance + amount > c->creditLimit) return false;
+        c->currentBalance += amount;
+        return true;
+    }));
+}
+
+bool MemoryBackend::payCreditCard(int userId, int fromAccountId, int cardId, double amount) {
+    OpTimer timer("MemoryBackend::payCreditCard");
+    if (amount <= 0) return timer.finish(false);
+    QMutexLocker locker(&m_mutex);
+    Account *acc = account(fromAccountId);
+    Card *c = card(cardId);
+    if (!acc || !c || c->userId != userId) return timer.finish(false);
+    if (amount > c->currentBalance) amount = c->currentBalance; // cap to outstanding
+    if (amount <= 0 || acc->balance < amount) return timer.finish(false);
+
+    acc->balance -= amount;
+    c->currentBalance -= amount;
+    c->paidSinceStatement += amount;
+    record(fromAccountId, "Credit Card Payment", amount, "Payment to credit card");
+    return timer.finish(true);
+}
+
+CardCycleStats MemoryBackend::closeCardBillingCycle(const QDate &statementDate, int threadCount) {
+    Q_UNUSED(threadCount); // one lock covers every card, so workers would only queue on it
+    OpTimer opTimer("MemoryBackend::closeCardBillingCycle");
+    CardCycleStats stats;
+    QElapsedTimer timer;
+    timer.start();
+    const QDate dueDate = statementDate.addDays(21);
+
+    QMutexLocker locker(&m_mutex);
+    qint64 interestCents = 0;
+    for (Card &c : m_cards) {
+        if (c.lastStatementDate.isValid() && c.lastStatementDate >= statementDate) continue;
+        const CardStatementTerms terms = DBManager::statementTerms(c.currentBalance, c.statementBalance,
+                                                                   c.paidSinceStatement, c.apr);
+        c.currentBalance += terms.interest;
+        c.statementBalance = terms.statementBalance;
+        c.minPayment = terms.minPayment;
+        c.paidSinceStatement = 0.0;
+        c.lastStatementDate = statementDate;
+        c.paymentDueDate = dueDate;
+        interestCents += qRound64(terms.interest * 100.0);
+        ++stats.cardsClosed;
+    }
+
+    stats.totalInterest = interestCents / 100.0;
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
+bool MemoryBackend::applyInterestLocked(Account &acc, const QDate &today) {
+    if (acc.interestRate <= 0.0 || !acc.lastInterestApplied.isValid()) return false;
+    const int monthsDiff = acc.lastInterestApplied.daysTo(today) / 30;
+    if (monthsDiff <= 0) return false;
+
+    const double before = acc.balance;
+    const double monthlyRate = acc.interestRate / 12.0;
+    for (int i = 0; i < monthsDiff; ++i) {
+        acc.balance += acc.balance * monthlyRate;
+    }
+    acc.lastInterestApplied = today;
+    record(int(&acc - m_accounts.data()) + 1, "Interest", acc.balance - before,
+           "Monthly interest credited");
+    return true;
+}
+
+void MemoryBackend::applyMonthlyInterestForUser(int userId) {
+    OpTimer timer("MemoryBackend::applyMonthlyInterestForUser");
+    const QDate today = QDate::currentDate();
+    QMutexLocker locker(&m_mutex);
+    for (Account &acc : m_accounts) {
+        if (acc.userId == userId) applyInterestLocked(acc, today);
+    }
+}
+
+int MemoryBackend::applyMonthlyInterestForAllUsers() {
+    OpTimer timer("MemoryBackend::applyMonthlyInterestForAllUsers");
+    const QDate today = QDate::currentDate();
+    int credited = 0;
+    QMutexLocker locker(&m_mutex);
+    for (Account &acc : m_accounts) {
+        if (applyInterestLocked(acc, today)) ++credited;
+    }
+    return timer.finish(credited);
+}
+
+bool MemoryBackend::generate(int users, int cardsPerUser, int schedulesPerUser) {
+    QMutexLocker locker(&m_mutex);
+    const QDate today = QDate::currentDate();
+    const qint64 offset = qint64(m_users.size());
+
+    m_users.reserve(m_users.size() + users);
+    m_accounts.reserve(m_accounts.size() + users);
+    m_cards.reserve(m_cards.size() + size_t(users) * qMax(0, cardsPerUser));
+    m_schedules.reserve(m_schedules.size() + size_t(users) * qMax(0, schedulesPerUser));
+
+    for (int i = 1; i <= users; ++i) {
+        const qint64 n = offset + i;
+        const QString email = QString("user%1@bench.local").arg(n);
+        m_users.push_back({email, "Password123!", QString("Bench User %1").arg(n), QDate()});
+        const int userId = int(m_users.size());
+        m_userByEmail.insert(email, userId);
+
+        m_accounts.push_back({userId, "Chequing", 1000.0, 0.0, today});
+        const int accountId = int(m_accounts.size());
+
+        for (int k = 0; k < cardsPerUser; ++k) {
+            Card c;
+            c.userId = userId;
+            c.creditLimit = 5000.0;
+            c.currentBalance = double((n * 37 + k) % 4000);
+            c.statementBalance = double((n * 17 + k) % 2000);
+            m_cards.push_back(c);
+        }
+        for (int k = 0; k < schedulesPerUser; ++k) {
+            m_schedules.push_back({userId, accountId, 1, 10.0 + k, "Monthly", 1, today});
+        }
+    }
+    return true;
+}
+
+QList<int> MemoryBackend::accountIds(int partition, int limit) {
+    Q_UNUSED(partition);
+    QMutexLocker locker(&m_mutex);
+    QList<int> ids;
+    const int count = qMin(limit, int(m_accounts.size()));
+    ids.reserve(count);
+    for (int id = 1; id <= count; ++id) ids << id;
+    return ids;
+}
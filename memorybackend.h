@@ -0,0 +1,132 @@
+#ifndef MEMORYBACKEND_H
+#define MEMORYBACKEND_H
+
+#include "storagebackend.h"
+#include <QHash>
+#include <QMutex>
+#include <vector>
+
+// Keeps every record in flat vectors indexed by ID - 1, behind one mutex.
+// Applies the same business rules as DBManager (funds and limit checks,
+// velocity limits, retry policy, statement terms) without any storage cost.
+// Starts without clients, like a new SQLite database. Nothing is persisted.
+class MemoryBackend : public StorageBackend {
+public:
+    MemoryBackend();
+
+    // The demo clients DBManager::seedSampleData() adds; true if it seeded
+    bool seedSampleData();
+
+    QString name() const override { return "memory"; }
+
+    bool createUser(const QString &email, const QString &password,
+                    const QString &username, const QDate &dob) override;
+    int authenticateUser(const QString &email, const QString &password) override;
+
+    int createAccount(int userId, const QString &type,
+                      double initialBalance, double interestRate) override;
+    bool deposit(int accountId, double amount) override;
+    bool withdraw(int accountId, double amount) override;
+    bool transferAccountToAccount(int fromAccountId, int toAccountId, double amount) override;
+    bool registerInteracEmail(int userId, int accountId, const QString &email) override;
+    bool interacTransfer(int fromAccountId, const QString &toEmail, double amount) override;
+
+    bool payBill(int userId, int fromAccountId, int payeeId, double amount) override;
+    int scheduleBillPayment(int userId, int fromAccountId, int payeeId, double amount,
+                            const QString &frequency, const QDate &firstDue) override;
+    bool cancelScheduledPayment(int userId, int scheduleId) override;
+    ScheduledRunStats runDueScheduledPayments(const QDate &asOf, int userId) override;
+
+    int applyForCreditCard(int userId, double creditLimit) override;
+    bool spendOnCard(int cardId, double amount) override;
+    bool payCreditCard(int userId, int fromAccountId, int cardId, double amount) override;
+    CardCycleStats closeCardBillingCycle(const QDate &statementDate, int threadCount) override;
+
+    void applyMonthlyInterestForUser(int userId) override;
+    int applyMonthlyInterestForAllUsers() override;
+
+    // Every operation is applied immediately
+    bool beginBatch() override { return true; }
+    bool commitBatch() override { return true; }
+    void rollbackBatch() override {}
+
+    bool generate(int users, int cardsPerUser, int schedulesPerUser) override;
+    int partitionCount() const override { return 1; }
+    QList<int> accountIds(int partition, int limit) override;
+
+private:
+    enum class PostingResult { Ok, InsufficientFunds, Failed };
+
+    struct User {
+        QString email;
+        QString password;
+        QString username;
+        QDate dob;
+    };
+    struct Account {
+        int userId;
+        QString type;
+        double balance;
+        double interestRate;
+        QDate lastInterestApplied;
+    };
+    struct Card {
+        int userId;
+        double creditLimit;
+        double currentBalance = 0.0;
+        double statementBalance = 0.0;
+        double paidSinceStatement = 0.0;
+        double minPayment = 0.0;
+        double apr = 0.1999;
+        QDate lastStatementDate;
+        QDate paymentDueDate;
+    };
+    // type and description point at string literals
+    struct Transaction {
+        int accountId;
+        const char *type;
+        double amount;
+        const char *description;
+        int relatedAccountId;
+    };
+    struct Schedule {
+        int userId;
+        int accountId;
+        int payeeId;
+        double amount;
+        QString frequency;
+        int dayOfMonth;
+        QDate nextDue;
+        int retries = 0;
+        const char *status = "Active";
+        QDate cycleDue; // due date of the cycle being retried
+    };
+    struct BillPayment {
+        int userId;
+        int accountId;
+        int payeeId;
+        double amount;
+    };
+
+    // Callers hold m_mutex
+    Account *account(int accountId);
+    Card *card(int cardId);
+    void record(int accountId, const char *type, double amount, const char *description,
+                int relatedAccountId = 0);
+    bool transferLocked(int fromAccountId, int toAccountId, double amount);
+    PostingResult postBillPayment(int userId, int fromAccountId, int payeeId, double amount);
+    bool applyInterestLocked(Account &account, const QDate &today);
+
+    QMutex m_mutex;
+    std::vector<User> m_users;
+    QHash<QString, int> m_userByEmail;
+    std::vector<Account> m_accounts;
+    std::vector<Card> m_cards;
+    std::vector<Transaction> m_transactions;
+    std::vector<Schedule> m_schedules;
+    std::vector<BillPayment> m_billPayments;
+    QHash<QString, int> m_interac; // email -> account ID
+    int m_payeeCount = 0;
+};
+
+#endif // MEMORYBACKEND_H
@@ -0,0 +1,185 @@
+#include "nativestatement.h"
+#include "slowquerylog.h"
+#include <QSqlDriver>
+#include <QVariant>
+#include <QHash>
+#include <QDebug>
+#include <sqlite3.h>
+#include <utility>
+
+namespace {
+
+struct CachedStatement {
+    sqlite3_stmt *stmt = nullptr;
+    bool busy = false;
+};
+
+struct CachedConnection {
+    sqlite3 *handle = nullptr; // the handle the statements were prepared on
+    QHash<QByteArray, CachedStatement> statements;
+
+    void finalize() {
+        for (const CachedStatement &cached : std::as_const(statements)) sqlite3_finalize(cached.stmt);
+        statements.clear();
+    }
+};
+
+// The calling thread's prepared statements, per connection name and SQL
+// text. Keyed by name, not handle: a connection opened after another was
+// closed can get the same sqlite3 address.
+struct ThreadCache {
+    QHash<QString, CachedConnection> connections;
+
+    ~ThreadCache() { clear(); }
+    void clear() {
+        for (CachedConnection &connection : connections) connection.finalize();
+        connections.clear();
+    }
+};
+
+ThreadCache &threadCache() {
+    static thread_local ThreadCache cache;
+    return cache;
+}
+
+// The sqlite3 connection behind a QSQLITE database. It is only usable
+// because Qt's driver is built against the same library (see CMakeLists).
+sqlite3 *nativeHandle(const QSqlDatabase &db) {
+    const QVariant handle = db.driver() ? db.driver()->handle() : QVariant();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0) return nullptr;
+    return *static_cast<sqlite3 *const *>(handle.constData());
+}
+
+} // namespace
+
+NativeStatement::NativeStatement(const QSqlDatabase &db, const char *sql) : m_sql(sql), m_db(db) {
+    if (SlowQueryLog::enabled()) m_timer.start();
+    sqlite3 *handle = nativeHandle(db);
+    if (!handle) {
+        qWarning() << "NativeStatement: not an open SQLite connection:" << db.connectionName();
+        m_failed = true;
+        return;
+    }
+
+    // A reopened connection starts with an empty cache
+    CachedConnection &connection = threadCache().connections[db.connectionName()];
+    if (connection.handle != handle) {
+        connection.finalize();
+        connection.handle = handle;
+    }
+    // The lookup key borrows sql; only a new entry copies it
+    QHash<QByteArray, CachedStatement> &statements = connection.statements;
+    const auto it = statements.find(QByteArray::fromRawData(sql, qstrlen(sql)));
+    if (it != statements.end() && !it->busy) {
+        it->busy = true;
+        m_stmt = it->stmt;
+        m_cached = true;
+        return;
+    }
+
+    if (sqlite3_prepare_v3(handle, sql, -1, SQLITE_PREPARE_PERSISTENT, &m_stmt, nullptr) != SQLITE_OK) {
+        qWarning() << "NativeStatement: prepare failed:" << sqlite3_errmsg(handle) << sql;
+        sqlite3_finalize(m_stmt);
+        m_stmt = nullptr;
+        m_failed = true;
+        return;
+    }
+    // A statement nested inside its own use (rare) gets a private copy
+    if (it == statements.end()) {
+        statements.insert(QByteArray(sql), {m_stmt, true});
+        m_cached = true;
+    }
+}
+
+NativeStatement::~NativeStatement() {
+    if (!m_stmt) return;
+    const qint64 rows = sqlite3_stmt_readonly(m_stmt) ? m_rows : sqlite3_changes(sqlite3_db_handle(m_stmt));
+    sqlite3_reset(m_stmt);
+    sqlite3_clear_bindings(m_stmt);
+    if (m_cached) {
+        auto &statements = threadCache().connections[m_db.connectionName()].statements;
+        const auto it = statements.find(QByteArray::fromRawData(m_sql, qstrlen(m_sql)));
+        if (it != statements.end()) it->busy = false;
+    } else {
+        sqlite3_finalize(m_stmt);
+    }
+    if (m_timer.isValid()) SlowQueryLog::recordNative(m_db, m_sql, m_timer.nsecsElapsed(), !m_failed, rows);
+}
+
+void NativeStatement::bind(int index, qint64 value) {
+    if (!m_stmt || sqlite3_bind_int64(m_stmt, index, value) != SQLITE_OK) m_failed = true;
+}
+
+void NativeStatement::bind(int index, double value) {
+    if (!m_stmt || sqlite3_bind_double(m_stmt, index, value) != SQLITE_OK) m_failed = true;
+}
+
+void NativeStatement::bind(int index, QByteArrayView utf8) {
+    if (!m_stmt || sqlite3_bind_text(m_stmt, index, utf8.data(), int(utf8.size()), SQLITE_TRANSIENT) != SQLITE_OK) {
+        m_failed = true;
+    }
+}
+
+void NativeStatement::bind(int index, const QString &value) {
+    bind(index, QByteArrayView(value.toUtf8()));
+}
+
+void NativeStatement::bindStatic(int index, const char *text) {
+    if (!m_stmt || sqlite3_bind_text(m_stmt, index, text, -1, SQLITE_STATIC) != SQLITE_OK) m_failed = true;
+}
+
+void NativeStatement::bindNull(int index) {
+    if (!m_stmt || sqlite3_bind_null(m_stmt, index) != SQLITE_OK) m_failed = true;
+}
+
+bool NativeStatement::next() {
+    if (m_failed) return false;
+    const int rc = sqlite3_step(m_stmt);
+    if (rc == SQLITE_ROW) {
+        ++m_rows;
+        return true;
+    }
+    if (rc != SQLITE_DONE) {
+        qWarning() << "NativeStatement: step failed:" << errorString() << m_sql;
+        m_failed = true;
+    }
+    return false;
+}
+
+bool NativeStatement::exec() {
+    while (next()) {}
+    return !m_failed;
+}
+
+QString NativeStatement::errorString() const {
+    return m_stmt ? QString::fromUtf8(sqlite3_errmsg(sqlite3_db_handle(m_stmt))) : QString("not prepared");
+}
+
+qint64 NativeStatement::int64(int column) const {
+    return sqlite3_column_int64(m_stmt, column);
+}
+
+double NativeStatement::real(int column) const {
+    return sqlite3_column_double(m_stmt, column);
+}
+
+bool NativeStatement::isNull(int column) const {
+    return sqlite3_column_type(m_stmt, column) == SQLITE_NULL;
+}
+
+QByteArrayView NativeStatement::text(int column) const {
+    const auto *bytes = reinterpret_cast<const char *>(sqlite3_column_text(m_stmt, column));
+    return QByteArrayView(bytes, sqlite3_column_bytes(m_stmt, column));
+}
+
+void NativeStatement::releaseThreadCache() {
+    threadCache().clear();
+}
+
+void NativeStatement::releaseConnection(const QString &connectionName) {
+    ThreadCache &cache = threadCache();
+    const auto it = cache.connections.find(connectionName);
+    if (it == cache.connections.end()) return;
+    it->finalize();
+    cache.connections.erase(it);
+}
@@ -0,0 +1,68 @@
+#ifndef NATIVESTATEMENT_H
+#define NATIVESTATEMENT_H
+
+#include <QByteArrayView>
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QString>
+
+struct sqlite3_stmt;
+
+// A statement run directly on the sqlite3 connection behind a DBManager
+// connection: int64, double and UTF-8 values are bound and read as they
+// are, with no QVariant or QString in between. Each thread keeps its
+// statements prepared per connection name and SQL text, so only the first use
+// pays for sqlite3_prepare. The statement is reset (and its read lock
+// dropped) when the object goes out of scope. Statements are recorded by
+// the slow-query log like SlowQueryLog::exec.
+class NativeStatement {
+public:
+    NativeStatement(const QSqlDatabase &db, const char *sql);
+    ~NativeStatement();
+    NativeStatement(const NativeStatement &) = delete;
+    NativeStatement &operator=(const NativeStatement &) = delete;
+
+    bool isValid() const { return m_stmt != nullptr; }
+
+    // Parameters are numbered from 1 (?1, ?2, ...). Text is copied.
+    void bind(int index, int value) { bind(index, qint64(value)); }
+    void bind(int index, qint64 value);
+    void bind(int index, double value);
+    void bind(int index, QByteArrayView utf8);
+    void bind(int index, const QString &value);
+    // Not copied: for string literals and other text that outlives the object
+    void bindStatic(int index, const char *text);
+    void bindNull(int index);
+
+    // Steps once; true while a row is available. Stepping past the last
+    // row, or a failure, returns false; ok() tells the two apart.
+    bool next();
+    // Runs a statement that returns no rows
+    bool exec();
+    bool ok() const { return !m_failed; }
+    QString errorString() const;
+
+    qint64 int64(int column) const;
+    double real(int column) const;
+    bool isNull(int column) const;
+    // UTF-8 bytes of a cell, valid until the next step
+    QByteArrayView text(int column) const;
+
+    // Finalizes the calling thread's prepared statements. Must run before
+    // the thread's connections are closed.
+    static void releaseThreadCache();
+    // Finalizes the calling thread's statements on one connection. Must run
+    // before that connection is closed.
+    static void releaseConnection(const QString &connectionName);
+
+private:
+    const char *m_sql;
+    QSqlDatabase m_db; // a copy: callers may pass a temporary
+    sqlite3_stmt *m_stmt = nullptr;
+    bool m_cached = false; // false when the cached copy was already in use
+    QElapsedTimer m_timer;
+    qint64 m_rows = 0;
+    bool m_failed = false;
+};
+
+#endif // NATIVESTATEMENT_H
@@ -0,0 +1,245 @@
+#include "onlinebackup.h"
+#include "dbmanager.h"
+#include "opmetrics.h"
+#include <QFile>
+#include <QThread>
+#include <QDebug>
+#include <functional>
+#include <sqlite3.h>
+
+namespace {
+
+// Owns a native connection for the length of one copy or check
+struct NativeDb {
+    sqlite3 *handle = nullptr;
+    ~NativeDb() { sqlite3_close(handle); }
+
+    bool open(const QString &path, bool readOnly, QString *error) {
+        const int flags = readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        if (sqlite3_open_v2(QFile::encodeName(path).constData(), &handle, flags, nullptr) != SQLITE_OK) {
+            if (error) *error = QString("Cannot open %1: %2").arg(path, sqlite3_errmsg(handle));
+            return false;
+        }
+        sqlite3_busy_timeout(handle, 10000);
+        return true;
+    }
+
+    // First column of every row, as text
+    bool query(const char *sql, QStringList *rows) {
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (rows) *rows << QString::fromUtf8(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+};
+
+using StepCallback = std::function<void(int remaining, int pageCount)>;
+
+// Copies source to dest through dest.partial. The source is read from a
+// single snapshot: with WAL, the open read transaction keeps it stable
+// without blocking the writer, so the copy never restarts.
+bool copyDatabase(const QString &source, const QString &dest, int pagesPerStep, int pauseMs,
+                  const StepCallback &onStep, QString *error) {
+    const QString partial = dest + ".partial";
+    QFile::remove(partial);
+
+    bool ok = false;
+    {
+        NativeDb src;
+        NativeDb dst;
+        if (!src.open(source, true, error) || !dst.open(partial, false, error)) return false;
+
+        if (sqlite3_exec(src.handle, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK
+            || !src.query("SELECT 1 FROM sqlite_master LIMIT 1", nullptr)) {
+            if (error) *error = QString("Cannot read %1: %2").arg(source, sqlite3_errmsg(src.handle));
+            return false;
+        }
+
+        sqlite3_backup *backup = sqlite3_backup_init(dst.handle, "main", src.handle, "main");
+        if (!backup) {
+            if (error) *error = QString("Cannot back up %1: %2").arg(source, sqlite3_errmsg(dst.handle));
+            return false;
+        }
+        int rc;
+        do {
+            rc = sqlite3_backup_step(backup, pagesPerStep);
+            if (onStep) onStep(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup));
+            if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+                QThread::msleep(qMax(pauseMs, rc == SQLITE_OK ? 0 : 1));
+            }
+        } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+        ok = rc == SQLITE_DONE && sqlite3_backup_finish(backup) == SQLITE_OK;
+        if (rc != SQLITE_DONE) sqlite3_backup_finish(backup);
+        if (!ok && error) *error = QString("Backup of %1 failed: %2").arg(source, sqlite3_errmsg(dst.handle));
+        sqlite3_exec(src.handle, "COMMIT", nullptr, nullptr, nullptr);
+    }
+
+    if (!ok) {
+        QFile::remove(partial);
+        return false;
+    }
+    QFile::remove(dest);
+    QFile::remove(dest + "-wal");
+    QFile::remove(dest + "-shm");
+    if (!QFile::rename(partial, dest)) {
+        if (error) *error = QString("Cannot move %1 into place").arg(dest);
+        return false;
+    }
+    return true;
+}
+
+// Directory file first, then shard files as recorded in its bank_meta
+QStringList backupFiles(const QString &path, QString *error) {
+    NativeDb db;
+    QStringList shardCount;
+    if (!db.open(path, true, error)) return {};
+    db.query("SELECT value FROM bank_meta WHERE key = 'shard_count'", &shardCount);
+
+    QStringList files{path};
+    const int shards = shardCount.value(0, "1").toInt();
+    for (int shard = 0; shards > 1 && shard < shards; ++shard) {
+        files << DBManager::shardPath(path, shard);
+    }
+    return files;
+}
+
+// Row count of every ordinary table, "name=count"
+QStringList tableCounts(const QString &path, QString *error) {
+    NativeDb db;
+    QStringList tables;
+    if (!db.open(path, true, error)
+        || !db.query("SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' "
+                     "AND sql NOT LIKE 'CREATE VIRTUAL%' ORDER BY name", &tables)) {
+        return {};
+    }
+    QStringList counts;
+    for (const QString &table : tables) {
+        QStringList count;
+        const QByteArray sql = QString("SELECT COUNT(*) FROM \"%1\"").arg(table).toUtf8();
+        db.query(sql.constData(), &count);
+        counts << table + '=' + count.value(0);
+    }
+    return counts;
+}
+
+} // namespace
+
+OnlineBackup::OnlineBackup(int pagesPerStep, int pauseMs)
+    : m_pagesPerStep(qMax(1, pagesPerStep)), m_pauseMs(qMax(0, pauseMs)) {}
+
+OnlineBackup::~OnlineBackup() {
+    wait();
+}
+
+bool OnlineBackup::start(const QString &destPath) {
+    if (m_running.load()) return false;
+    wait();
+
+    const QStringList sources = DBManager::databaseFiles();
+    QStringList targets{destPath};
+    for (int shard = 0; sources.size() > 1 && shard < sources.size() - 1; ++shard) {
+        targets << DBManager::shardPath(destPath, shard);
+    }
+
+    m_ok = false;
+    m_pagesCopied = 0;
+    m_pagesTotal = 0;
+    m_steps = 0;
+    {
+        QMutexLocker lock(&m_errorMutex);
+        m_error.clear();
+    }
+    m_running = true;
+    m_thread = QThread::create([this, sources, targets]() {
+        OpTimer timer("OnlineBackup::run");
+        qint64 doneBefore = 0;
+        qint64 totalBefore = 0;
+        bool ok = true;
+        for (int i = 0; ok && i < sources.size(); ++i) {
+            int filePages = 0;
+            QString error;
+            ok = copyDatabase(sources[i], targets[i], m_pagesPerStep, m_pauseMs,
+                              [&](int remaining, int pageCount) {
+                                  filePages = pageCount;
+                                  ++m_steps;
+                                  m_pagesCopied = doneBefore + pageCount - remaining;
+                                  m_pagesTotal = totalBefore + pageCount;
+                              }, &error);
+            if (!ok) fail(error);
+            doneBefore += filePages;
+            totalBefore += filePages;
+        }
+        m_ok = timer.finish(ok);
+        m_running = false;
+    });
+    m_thread->start();
+    return true;
+}
+
+bool OnlineBackup::wait() {
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    return m_ok.load();
+}
+
+QString OnlineBackup::errorString() const {
+    QMutexLocker lock(&m_errorMutex);
+    return m_error;
+}
+
+void OnlineBackup::fail(const QString &error) {
+    qWarning() << "Backup failed:" << error;
+    QMutexLocker lock(&m_errorMutex);
+    m_error = error;
+}
+
+bool OnlineBackup::verifyFile(const QString &path, QString *error) {
+    NativeDb db;
+    QStringList result;
+    if (!db.open(path, true, error)) return false;
+    if (!db.query("PRAGMA integrity_check", &result) || result != QStringList{"ok"}) {
+        if (error) *error = QString("%1 failed integrity check: %2").arg(path, result.join("; "));
+        return false;
+    }
+    return true;
+}
+
+bool OnlineBackup::restore(const QString &backupPath, const QString &dbPath, QString *error) {
+    OpTimer timer("OnlineBackup::restore");
+    const QStringList sources = backupFiles(backupPath, error);
+    if (sources.isEmpty()) return timer.finish(false);
+
+    QStringList expected;
+    for (const QString &source : sources) {
+        if (!verifyFile(source, error)) return timer.finish(false);
+        expected << tableCounts(source, error);
+    }
+
+    QStringList targets{dbPath};
+    for (int shard = 0; shard < sources.size() - 1; ++shard) {
+        targets << DBManager::shardPath(dbPath, shard);
+    }
+    QStringList restored;
+    for (int i = 0; i < sources.size(); ++i) {
+        // Nothing else has the files open, so copy in one step
+        if (!copyDatabase(sources[i], targets[i], -1, 0, nullptr, error)
+            || !verifyFile(targets[i], error)) {
+            return timer.finish(false);
+        }
+        restored << tableCounts(targets[i], error);
+    }
+
+    if (restored != expected) {
+        if (error) *error = QString("Restored row counts differ from the backup");
+        return timer.finish(false);
+    }
+    return timer.finish(true);
+}
@@ -0,0 +1,56 @@
+#ifndef ONLINEBACKUP_H
+#define ONLINEBACKUP_H
+
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <atomic>
+
+class QThread;
+
+// Copies the live database (directory and every shard file) with SQLite's
+// backup API while the bank keeps posting. Each file is copied from one
+// read snapshot, pagesPerStep pages at a time with a pause between steps,
+// so the writer never waits on the backup. Backups are written to
+// <dest>.partial and renamed into place only once complete.
+class OnlineBackup {
+public:
+    explicit OnlineBackup(int pagesPerStep = 64, int pauseMs = 5);
+    ~OnlineBackup();
+
+    // Starts backing up the files DBManager has open to destPath (shard
+    // copies are named like the originals). Returns false if a backup is
+    // already running.
+    bool start(const QString &destPath);
+    // Blocks until the running backup ends. Returns its outcome.
+    bool wait();
+    bool isRunning() const { return m_running.load(); }
+
+    qint64 pagesCopied() const { return m_pagesCopied.load(); }
+    qint64 pagesTotal() const { return m_pagesTotal.load(); }
+    int steps() const { return m_steps.load(); }
+    QString errorString() const;
+
+    // Runs PRAGMA integrity_check on one file
+    static bool verifyFile(const QString &path, QString *error);
+    // Offline: checks every file of the backup at backupPath, copies it over
+    // dbPath and its shard files, then checks the result and compares row
+    // counts table by table. The application must not be running.
+    static bool restore(const QString &backupPath, const QString &dbPath, QString *error);
+
+private:
+    void fail(const QString &error);
+
+    int m_pagesPerStep;
+    int m_pauseMs;
+    QThread *m_thread = nullptr;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_ok{false};
+    std::atomic<qint64> m_pagesCopied{0};
+    std::atomic<qint64> m_pagesTotal{0};
+    std::atomic<int> m_steps{0};
+    mutable QMutex m_errorMutex;
+    QString m_error;
+};
+
+#endif // ONLINEBACKUP_H
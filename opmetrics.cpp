@@ -0,0 +1,159 @@
+#include "opmetrics.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QFile>
+#include <QtAlgorithms>
+#include <QDebug>
+#include <algorithm>
+
+std::atomic<bool> OpMetrics::s_enabled{false};
+
+namespace {
+
+struct OperationStats {
+    LatencyHistogram histogram;
+    quint64 ok = 0;
+    quint64 failed = 0;
+};
+
+QMutex &registryMutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
+QHash<QByteArray, OperationStats> &registry() {
+    static QHash<QByteArray, OperationStats> stats;
+    return stats;
+}
+
+double toMicros(quint64 nanos) {
+    return nanos / 1000.0;
+}
+
+} // namespace
+
+int LatencyHistogram::bucketFor(quint64 nanos) {
+    if (nanos < quint64(kSubBuckets)) return int(nanos);
+    const int msb = 63 - int(qCountLeadingZeroBits(nanos));
+    const int shift = msb - kSubBucketBits;
+    const int sub = int((nanos >> shift) - kSubBuckets);
+    return kSubBuckets + shift * kSubBuckets + sub;
+}
+
+quint64 LatencyHistogram::bucketUpperBound(int index) {
+    if (index < kSubBuckets) return quint64(index);
+    const int shift = (index - kSubBuckets) / kSubBuckets;
+    const quint64 sub = quint64((index - kSubBuckets) % kSubBuckets);
+    return ((kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(quint64 nanos) {
+    ++m_counts[bucketFor(nanos)];
+    ++m_count;
+    m_sum += nanos;
+    m_min = std::min(m_min, nanos);
+    m_max = std::max(m_max, nanos);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (int i = 0; i < kBuckets; ++i) m_counts[i] += other.m_counts[i];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::reset() {
+    m_counts.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_min = ~quint64(0);
+    m_max = 0;
+}
+
+quint64 LatencyHistogram::percentile(double p) const {
+    if (m_count == 0) return 0;
+    const quint64 rank = std::max<quint64>(1, quint64(p / 100.0 * m_count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += m_counts[i];
+        if (seen >= rank) return std::min(bucketUpperBound(i), m_max);
+    }
+    return m_max;
+}
+
+void OpMetrics::record(const char *operation, quint64 nanos, bool ok) {
+    QMutexLocker locker(&registryMutex());
+    OperationStats &stats = registry()[QByteArray::fromRawData(operation, int(qstrlen(operation)))];
+    stats.histogram.record(nanos);
+    if (ok) ++stats.ok; else ++stats.failed;
+}
+
+void OpMetrics::reset() {
+    QMutexLocker locker(&registryMutex());
+    registry().clear();
+}
+
+QJsonObject OpMetrics::toJson() {
+    QMutexLocker locker(&registryMutex());
+
+    QJsonObject operations;
+    for (auto it = registry().cbegin(); it != registry().cend(); ++it) {
+        const LatencyHistogram &h = it.value().histogram;
+        QJsonObject op;
+        op["count"] = double(h.count());
+        op["ok"] = double(it.value().ok);
+        op["failed"] = double(it.value().failed);
+        op["min_us"] = toMicros(h.minNanos());
+        op["mean_us"] = h.meanNanos() / 1000.0;
+        op["p50_us"] = toMicros(h.percentile(50));
+        op["p90_us"] = toMicros(h.percentile(90));
+        op["p99_us"] = toMicros(h.percentile(99));
+        op["p999_us"] = toMicros(h.percentile(99.9));
+        op["max_us"] = toMicros(h.maxNanos());
+        operations[QString::fromLatin1(it.key())] = op;
+    }
+
+    QJsonObject root;
+    root["generated_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["enabled"] = enabled();
+    root["operations"] = operations;
+    return root;
+}
+
+QString OpMetrics::toText() {
+    const QJsonObject operations = toJson()["operations"].toObject();
+    QStringList names = operations.keys();
+    std::sort(names.begin(), names.end());
+
+    QString text = QString("%1 %2 %3 %4 %5 %6 %7\n")
+                       .arg("operation", -48)
+                       .arg("count", 8).arg("failed", 7)
+                       .arg("p50 us", 10).arg("p99 us", 10)
+                       .arg("p99.9 us", 10).arg("max us", 10);
+    for (const QString &name : names) {
+        const QJsonObject op = operations[name].toObject();
+        text += QString("%1 %2 %3 %4 %5 %6 %7\n")
+                    .arg(name, -48)
+                    .arg(op["count"].toDouble(), 8, 'f', 0)
+                    .arg(op["failed"].toDouble(), 7, 'f', 0)
+                    .arg(op["p50_us"].toDouble(), 10, 'f', 1)
+                    .arg(op["p99_us"].toDouble(), 10, 'f', 1)
+                    .arg(op["p999_us"].toDouble(), 10, 'f', 1)
+                    .arg(op["max_us"].toDouble(), 10, 'f', 1);
+    }
+    return text;
+}
+
+bool OpMetrics::dumpJson(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write metrics to" << path << ":" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef OPMETRICS_H
+#define OPMETRICS_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <array>
+#include <atomic>
+
+// Log-linear (HDR-style) latency histogram: 16 linear sub-buckets per
+// power of two, so any recorded value is within ~6% of its bucket bound.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kBuckets = kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+
+    void record(quint64 nanos);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    quint64 count() const { return m_count; }
+    quint64 minNanos() const { return m_count ? m_min : 0; }
+    quint64 maxNanos() const { return m_max; }
+    double meanNanos() const { return m_count ? double(m_sum) / m_count : 0.0; }
+    quint64 percentile(double p) const;
+
+private:
+    static int bucketFor(quint64 nanos);
+    static quint64 bucketUpperBound(int index);
+
+    std::array<quint64, kBuckets> m_counts{};
+    quint64 m_count = 0;
+    quint64 m_sum = 0;
+    quint64 m_min = ~quint64(0);
+    quint64 m_max = 0;
+};
+
+// Process-wide registry of per-operation latency histograms and
+// success/failure counters. Recording is off by default; when off, an
+// OpTimer costs one relaxed atomic load.
+class OpMetrics {
+public:
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { s_enabled.store(on, std::memory_order_relaxed); }
+
+    static void record(const char *operation, quint64 nanos, bool ok);
+    static void reset();
+
+    static QJsonObject toJson();
+    static QString toText();
+    static bool dumpJson(const QString &path);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Times the enclosing scope and records it under 'operation' (which must be
+// a string literal). Wrap return values in finish() to record the outcome.
+class OpTimer {
+public:
+    explicit OpTimer(const char *operation)
+        : m_operation(operation), m_active(OpMetrics::enabled()) {
+        if (m_active) m_timer.start();
+    }
+    ~OpTimer() {
+        if (m_active) OpMetrics::record(m_operation, m_timer.nsecsElapsed(), m_ok);
+    }
+
+    bool finish(bool ok) { m_ok = ok; return ok; }
+    int finish(int id) { m_ok = id >= 0; return id; }
+
+    OpTimer(const OpTimer &) = delete;
+    OpTimer &operator=(const OpTimer &) = delete;
+
+private:
+    const char *m_operation;
+    bool m_active;
+    bool m_ok = true;
+    QElapsedTimer m_timer;
+};
+
+#endif // OPMETRICS_H
@@ -0,0 +1,207 @@
+#include "riskengine.h"
+#include <QStringList>
+#include <QDebug>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// Expired counters are swept from a stripe every this many admits
+constexpr quint32 kPruneInterval = 4096;
+
+thread_local QString t_lastDenial;
+
+const char *windowName(RiskEngine::Window window) {
+    switch (window) {
+    case RiskEngine::Minute: return "1m";
+    case RiskEngine::Hour: return "1h";
+    default: return "24h";
+    }
+}
+
+} // namespace
+
+template <int Buckets, qint64 WidthMs>
+void RiskEngine::Ring<Buckets, WidthMs>::advance(qint64 atMs) {
+    const qint64 bucket = atMs / WidthMs;
+    if (bucket <= head) return;
+    if (head < 0 || bucket - head >= Buckets) {
+        // Idle for a whole window: everything has expired
+        *this = Ring();
+        head = bucket;
+        return;
+    }
+    while (head < bucket) {
+        const int slot = int(++head % Buckets);
+        totalCount -= count[slot];
+        totalCents -= cents[slot];
+        count[slot] = 0;
+        cents[slot] = 0;
+    }
+}
+
+template <int Buckets, qint64 WidthMs>
+void RiskEngine::Ring<Buckets, WidthMs>::add(qint64 atMs, qint32 n, qint64 amount) {
+    const qint64 bucket = atMs / WidthMs;
+    // A timestamp older than the window (a late cancel) has nothing to undo
+    if (bucket > head || head - bucket >= Buckets) return;
+    const int slot = int(bucket % Buckets);
+    count[slot] += n;
+    cents[slot] += amount;
+    totalCount += n;
+    totalCents += amount;
+}
+
+void RiskEngine::Counters::advance(qint64 atMs) {
+    minute.advance(atMs);
+    hour.advance(atMs);
+    day.advance(atMs);
+}
+
+void RiskEngine::Counters::add(qint64 atMs, qint32 n, qint64 amount) {
+    minute.add(atMs, n, amount);
+    hour.add(atMs, n, amount);
+    day.add(atMs, n, amount);
+}
+
+qint64 RiskEngine::Counters::count(Window window) const {
+    return window == Minute ? minute.totalCount : (window == Hour ? hour.totalCount : day.totalCount);
+}
+
+qint64 RiskEngine::Counters::cents(Window window) const {
+    return window == Minute ? minute.totalCents : (window == Hour ? hour.totalCents : day.totalCents);
+}
+
+RiskEngine &RiskEngine::instance() {
+    static RiskEngine engine;
+    return engine;
+}
+
+void RiskEngine::setRules(const QVector<Rule> &rules) {
+    std::atomic_store(&m_rules, std::make_shared<const QVector<Rule>>(rules));
+    m_enabled.store(!rules.isEmpty(), std::memory_order_relaxed);
+}
+
+QVector<RiskEngine::Rule> RiskEngine::rules() const {
+    const auto rules = std::atomic_load(&m_rules);
+    return rules ? *rules : QVector<Rule>();
+}
+
+QVector<RiskEngine::Rule> RiskEngine::defaultRules() {
+    return {
+        {Scope::Account, Minute, 10, 0},
+        {Scope::Account, Hour, 0, 500000},
+        {Scope::Account, Day, 0, 1000000},
+        {Scope::Card, Minute, 5, 0},
+        {Scope::Card, Hour, 0, 250000},
+        {Scope::Card, Day, 50, 500000},
+    };
+}
+
+bool RiskEngine::parseRules(const QString &text, QVector<Rule> *rules) {
+    QVector<Rule> parsed;
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts)) {
+        const QStringList sides = item.trimmed().split('=');
+        const QStringList path = sides.value(0).trimmed().toLower().split('.');
+        if (sides.size() != 2 || path.size() != 3) return false;
+
+        Rule rule;
+        if (path[0] == "account") rule.scope = Scope::Account;
+        else if (path[0] == "card") rule.scope = Scope::Card;
+        else return false;
+
+        if (path[1] == "1m") rule.window = Minute;
+        else if (path[1] == "1h") rule.window = Hour;
+        else if (path[1] == "24h") rule.window = Day;
+        else return false;
+
+        bool ok = false;
+        const double limit = sides[1].trimmed().toDouble(&ok);
+        if (!ok || limit <= 0) return false;
+        if (path[2] == "count") rule.maxCount = qint64(limit);
+        else if (path[2] == "sum") rule.maxCents = std::llround(limit * 100.0);
+        else return false;
+        parsed << rule;
+    }
+    *rules = parsed;
+    return true;
+}
+
+QString RiskEngine::describe(const Rule &rule) {
+    QStringList limits;
+    if (rule.maxCount > 0) limits << QString("%1 debits").arg(rule.maxCount);
+    if (rule.maxCents > 0) limits << QString("$%1").arg(rule.maxCents / 100.0, 0, 'f', 2);
+    return QString("%1 %2 limit of %3")
+        .arg(rule.scope == Scope::Account ? "account" : "card", windowName(rule.window),
+             limits.join(" / "));
+}
+
+qint64 RiskEngine::nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool RiskEngine::admit(Scope scope, int id, qint64 cents, qint64 atMs) {
+    if (!enabled()) return true;
+    const auto rules = std::atomic_load(&m_rules);
+    const qint64 k = key(scope, id);
+    Stripe &s = stripe(k);
+
+    QMutexLocker lock(&s.mutex);
+    if (++s.admits % kPruneInterval == 0) prune(s, atMs);
+    Counters &counters = s.counters[k];
+    counters.advance(atMs);
+    for (const Rule &rule : *rules) {
+        if (rule.scope != scope) continue;
+        if ((rule.maxCount > 0 && counters.count(rule.window) + 1 > rule.maxCount)
+            || (rule.maxCents > 0 && counters.cents(rule.window) + cents > rule.maxCents)) {
+            lock.unlock();
+            m_denied.fetch_add(1, std::memory_order_relaxed);
+            t_lastDenial = describe(rule);
+            return false;
+        }
+    }
+    counters.add(atMs, 1, cents);
+    if (!t_lastDenial.isEmpty()) t_lastDenial.clear();
+    return true;
+}
+
+void RiskEngine::cancel(Scope scope, int id, qint64 cents, qint64 atMs) {
+    if (!enabled()) return;
+    const qint64 k = key(scope, id);
+    Stripe &s = stripe(k);
+    QMutexLocker lock(&s.mutex);
+    const auto it = s.counters.find(k);
+    if (it != s.counters.end()) it->add(atMs, -1, -cents);
+}
+
+QString RiskEngine::takeLastDenial() {
+    return std::exchange(t_lastDenial, QString());
+}
+
+int RiskEngine::trackedKeys() const {
+    int keys = 0;
+    for (const Stripe &s : m_stripes) {
+        QMutexLocker lock(&s.mutex);
+        keys += int(s.counters.size());
+    }
+    return keys;
+}
+
+void RiskEngine::reset() {
+    for (Stripe &s : m_stripes) {
+        QMutexLocker lock(&s.mutex);
+        s.counters.clear();
+    }
+    m_denied = 0;
+}
+
+void RiskEngine::prune(Stripe &stripe, qint64 atMs) {
+    // Keys with nothing left in the day window carry no state
+    for (auto it = stripe.counters.begin(); it != stripe.counters.end();) {
+        it->advance(atMs);
+        if (it->day.totalCount == 0) it = stripe.counters.erase(it);
+        else ++it;
+    }
+}
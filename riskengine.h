@@ -0,0 +1,123 @@
+#ifndef RISKENGINE_H
+#define RISKENGINE_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+
+// Velocity limits on debits (withdrawals, Interac transfers, card spends).
+// Every account and card with recent debits has a count and a sum over the
+// last minute, hour and day. Each window is a ring of fixed-width buckets
+// with running totals, so recording a debit and checking all the rules is
+// O(1), well under a microsecond. The windows slide a bucket at a time
+// (5 s, 5 min and 1 h). Counters live in memory only; a restart starts
+// them empty.
+class RiskEngine {
+public:
+    enum class Scope { Account, Card };
+    enum Window { Minute, Hour, Day, WindowCount };
+
+    // A limit on one window of every account (or card): at most maxCount
+    // debits and maxCents in total; 0 = no limit on that measure
+    struct Rule {
+        Scope scope = Scope::Account;
+        Window window = Minute;
+        qint64 maxCount = 0;
+        qint64 maxCents = 0;
+    };
+
+    static RiskEngine &instance();
+
+    // No rules turns the engine off; checks then cost one atomic load
+    void setRules(const QVector<Rule> &rules);
+    QVector<Rule> rules() const;
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // The dashboard's limits
+    static QVector<Rule> defaultRules();
+    // Comma-separated "<account|card>.<1m|1h|24h>.<count|sum>=<limit>",
+    // sums in dollars, e.g. "account.1m.count=10,card.24h.sum=2500"
+    static bool parseRules(const QString &text, QVector<Rule> *rules);
+    static QString describe(const Rule &rule);
+
+    // Milliseconds on a monotonic clock
+    static qint64 nowMs();
+
+    // Counts a debit of cents against the key's windows if every rule
+    // still holds with it included. Otherwise records nothing, remembers
+    // the rule for takeLastDenial() and returns false.
+    bool admit(Scope scope, int id, qint64 cents, qint64 atMs);
+    // Takes back an admitted debit whose posting then failed
+    void cancel(Scope scope, int id, qint64 cents, qint64 atMs);
+    // Runs post() for a debit of amount if the limits admit it, and takes
+    // the debit back if post() fails. Every storage backend posts debits
+    // through this.
+    template <typename Post>
+    bool withinLimits(Scope scope, int id, double amount, Post post);
+
+    // Rule that refused the calling thread's last admit(), or empty.
+    // Clears it.
+    static QString takeLastDenial();
+    quint64 denied() const { return m_denied.load(std::memory_order_relaxed); }
+    int trackedKeys() const;
+    // Forgets every counter (rules stay)
+    void reset();
+
+private:
+    template <int Buckets, qint64 WidthMs>
+    struct Ring {
+        qint64 head = -1; // absolute index of the newest bucket
+        qint64 totalCount = 0;
+        qint64 totalCents = 0;
+        qint32 count[Buckets] = {};
+        qint64 cents[Buckets] = {};
+
+        void advance(qint64 atMs);
+        void add(qint64 atMs, qint32 n, qint64 amount);
+    };
+
+    struct Counters {
+        Ring<12, 5000> minute;
+        Ring<12, 300000> hour;
+        Ring<24, 3600000> day;
+
+        void advance(qint64 atMs);
+        void add(qint64 atMs, qint32 n, qint64 amount);
+        qint64 count(Window window) const;
+        qint64 cents(Window window) const;
+    };
+
+    // Keys are spread over stripes so threads rarely share a lock
+    struct Stripe {
+        mutable QMutex mutex;
+        QHash<qint64, Counters> counters;
+        quint32 admits = 0;
+    };
+    static constexpr int kStripes = 64;
+
+    RiskEngine() = default;
+    static qint64 key(Scope scope, int id) { return (qint64(scope) << 32) | quint32(id); }
+    Stripe &stripe(qint64 key) { return m_stripes[quint64(key * 0x9E3779B97F4A7C15ull) >> 58]; }
+    void prune(Stripe &stripe, qint64 atMs);
+
+    Stripe m_stripes[kStripes];
+    std::shared_ptr<const QVector<Rule>> m_rules;
+    std::atomic<bool> m_enabled{false};
+    std::atomic<quint64> m_denied{0};
+};
+
+template <typename Post>
+bool RiskEngine::withinLimits(Scope scope, int id, double amount, Post post) {
+    if (!enabled()) return post();
+    const qint64 cents = qRound64(amount * 100.0);
+    const qint64 now = nowMs();
+    if (!admit(scope, id, cents, now)) return false;
+    const bool ok = post();
+    if (!ok) cancel(scope, id, cents, now);
+    return ok;
+}
+
+#endif // RISKENGINE_H
@@ -0,0 +1,112 @@
+#include "sessioncache.h"
+#include "dbmanager.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include <QSqlQuery>
+#include <QVariant>
+
+QMutex SessionCache::s_mutex;
+std::weak_ptr<const SessionCache::List> SessionCache::s_payees;
+std::weak_ptr<const SessionCache::List> SessionCache::s_faqs;
+QHash<int, std::weak_ptr<const SessionCache::List>> SessionCache::s_accounts;
+
+namespace {
+
+SessionCache::List loadPayees(int) {
+    OpTimer timer("SessionCache::loadPayees");
+    SessionCache::List list;
+    QSqlQuery q(DBManager::directoryDatabase());
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, name, category FROM bill_payees ORDER BY name");
+    if (SlowQueryLog::exec(q)) {
+        while (q.next()) {
+            const QString name = q.value(1).toString();
+            const QString category = q.value(2).toString();
+            list.append({q.value(0).toInt(),
+                         category.isEmpty() ? name : QString("%1 (%2)").arg(name, category)});
+        }
+    }
+    return list;
+}
+
+SessionCache::List loadFaqs(int) {
+    OpTimer timer("SessionCache::loadFaqs");
+    SessionCache::List list;
+    QSqlQuery q(DBManager::directoryDatabase());
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, question, answer FROM faqs ORDER BY id");
+    if (SlowQueryLog::exec(q)) {
+        while (q.next()) {
+            list.append({q.value(0).toInt(),
+                         QString("Q: %1\nA: %2").arg(q.value(1).toString(), q.value(2).toString())});
+        }
+    }
+    return list;
+}
+
+SessionCache::List loadAccounts(int userId) {
+    OpTimer timer("SessionCache::loadAccounts");
+    SessionCache::List list;
+    QSqlQuery q(DBManager::userDatabase(userId));
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, account_number, type FROM accounts WHERE user_id = :user");
+    q.bindValue(":user", userId);
+    if (SlowQueryLog::exec(q)) {
+        while (q.next()) {
+            list.append({q.value(0).toInt(),
+                         QString("%1 (%2)").arg(q.value(1).toString(), q.value(2).toString())});
+        }
+    }
+    return list;
+}
+
+} // namespace
+
+SessionCache::Handle SessionCache::lookup(std::weak_ptr<const List> &slot, List (*load)(int), int key) {
+    if (Handle live = slot.lock()) return live;
+    Handle loaded = std::make_shared<const List>(load(key));
+    slot = loaded;
+    return loaded;
+}
+
+SessionCache::Handle SessionCache::payees() {
+    QMutexLocker lock(&s_mutex);
+    return lookup(s_payees, loadPayees, 0);
+}
+
+SessionCache::Handle SessionCache::faqs() {
+    QMutexLocker lock(&s_mutex);
+    return lookup(s_faqs, loadFaqs, 0);
+}
+
+SessionCache::Handle SessionCache::accounts(int userId) {
+    QMutexLocker lock(&s_mutex);
+    // Drop slots whose sessions have all closed
+    for (auto it = s_accounts.begin(); it != s_accounts.end();) {
+        if (it.key() != userId && it.value().expired()) it = s_accounts.erase(it);
+        else ++it;
+    }
+    return lookup(s_accounts[userId], loadAccounts, userId);
+}
+
+void SessionCache::invalidateAccounts(int userId) {
+    QMutexLocker lock(&s_mutex);
+    s_accounts.remove(userId);
+}
+
+void SessionCache::invalidateAllAccounts() {
+    QMutexLocker lock(&s_mutex);
+    s_accounts.clear();
+}
+
+void SessionCache::invalidatePayees() {
+    QMutexLocker lock(&s_mutex);
+    s_payees.reset();
+}
+
+int SessionCache::liveLists() {
+    QMutexLocker lock(&s_mutex);
+    int live = int(!s_payees.expired()) + int(!s_faqs.expired());
+    for (const auto &slot : std::as_const(s_accounts)) live += int(!slot.expired());
+    return live;
+}
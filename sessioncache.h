@@ -0,0 +1,50 @@
+#ifndef SESSIONCACHE_H
+#define SESSIONCACHE_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <memory>
+
+// Read-mostly lists shared by every open customer session (teller mode runs
+// many MainWindows in one process). A session keeps the shared_ptrs it was
+// handed; the cache itself only holds weak references, so a list lives as
+// long as some session uses it and one copy serves them all.
+class SessionCache {
+public:
+    struct Item {
+        int id = 0;
+        QString label;
+    };
+    using List = QVector<Item>;
+    using Handle = std::shared_ptr<const List>;
+
+    // "Name (Category)" for every bill payee
+    static Handle payees();
+    // "FAQ question and answer" entries, in display order
+    static Handle faqs();
+    // "Account number (Type)" for each of the user's accounts
+    static Handle accounts(int userId);
+
+    // The next accounts() call for this user reads the database again.
+    // Sessions already holding the old list keep it until they ask again.
+    static void invalidateAccounts(int userId);
+    // Every user's accounts(), after a bulk import of accounts or balances
+    static void invalidateAllAccounts();
+    // Same for payees(), after payees are added
+    static void invalidatePayees();
+
+    // Lists currently alive, for the teller status line
+    static int liveLists();
+
+private:
+    static Handle lookup(std::weak_ptr<const List> &slot, List (*load)(int), int key);
+
+    static QMutex s_mutex;
+    static std::weak_ptr<const List> s_payees;
+    static std::weak_ptr<const List> s_faqs;
+    static QHash<int, std::weak_ptr<const List>> s_accounts;
+};
+
+#endif // SESSIONCACHE_H
@@ -0,0 +1,221 @@
+#include "slowquerylog.h"
+#include <QSqlQuery>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QSqlResult>
+#include <QVariant>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QDebug>
+#include <QRegularExpression>
+#include <QSet>
+#include <sqlite3.h>
+
+std::atomic<bool> SlowQueryLog::s_enabled{false};
+
+namespace {
+
+struct LogConfig {
+    QMutex mutex;
+    QString path;
+    qint64 thresholdNanos = 0;
+    qint64 maxFileBytes = 0;
+    int keepFiles = 0;
+};
+
+LogConfig &config() {
+    static LogConfig cfg;
+    return cfg;
+}
+
+// The sqlite3 statement behind a QSQLITE query, or null before it is
+// prepared (see NativeStatement for why the handle is usable)
+sqlite3_stmt *nativeStatement(const QSqlQuery &q) {
+    const QSqlResult *result = q.result();
+    const QVariant handle = result ? result->handle() : QVariant();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3_stmt*") != 0) return nullptr;
+    return *static_cast<sqlite3_stmt *const *>(handle.constData());
+}
+
+// Prepared queries are reused, so their step counters restart before each run
+void resetStepCounters(const QSqlQuery &q) {
+    if (sqlite3_stmt *stmt = nativeStatement(q)) {
+        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    }
+}
+
+} // namespace
+
+void SlowQueryLog::enable(const QString &path, int thresholdMs,
+                          qint64 maxFileBytes, int keepFiles) {
+    LogConfig &cfg = config();
+    QMutexLocker locker(&cfg.mutex);
+    cfg.path = path;
+    cfg.thresholdNanos = qint64(qMax(0, thresholdMs)) * 1000000;
+    cfg.maxFileBytes = qMax<qint64>(64 * 1024, maxFileBytes);
+    cfg.keepFiles = qMax(1, keepFiles);
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void SlowQueryLog::disable() {
+    s_enabled.store(false, std::memory_order_relaxed);
+}
+
+bool SlowQueryLog::exec(QSqlQuery &q) {
+    if (!enabled()) return q.exec();
+
+    resetStepCounters(q);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = q.exec();
+    record(q, timer.nsecsElapsed(), ok);
+    return ok;
+}
+
+bool SlowQueryLog::exec(QSqlQuery &q, const QString &sql) {
+    if (!enabled()) return q.exec(sql);
+
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = q.exec(sql);
+    record(q, timer.nsecsElapsed(), ok);
+    return ok;
+}
+
+bool SlowQueryLog::execBatch(QSqlQuery &q) {
+    if (!enabled()) return q.execBatch();
+
+    resetStepCounters(q);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = q.execBatch();
+    record(q, timer.nsecsElapsed(), ok);
+    return ok;
+}
+
+QString SlowQueryLog::explain(QSqlQuery &q) {
+    // Runs on the same connection as the original statement
+    const QSqlDriver *driver = q.driver();
+    if (!driver) return QString();
+
+    QSqlQuery plan(driver->createResult());
+    if (!plan.prepare("EXPLAIN QUERY PLAN " + q.lastQuery())) return QString();
+    // A name can appear more than once in the SQL (":amt" in payCreditCard),
+    // so named values are replayed by name; index order would shift them.
+    // Names inside string literals are not placeholders.
+    static const QRegularExpression literal("'[^']*'");
+    static const QRegularExpression placeholder(":[A-Za-z_]\\w*");
+    const QString sql = q.lastQuery().remove(literal);
+    QSet<QString> names;
+    for (const QRegularExpressionMatch &m : placeholder.globalMatch(sql)) names.insert(m.captured());
+    if (names.isEmpty()) {
+        const QVariantList values = q.boundValues();
+        for (int i = 0; i < values.size(); ++i) {
+            plan.bindValue(i, values.at(i));
+        }
+    } else {
+        for (const QString &name : std::as_const(names)) {
+            plan.bindValue(name, q.boundValue(name));
+        }
+    }
+    if (!plan.exec()) return QString();
+
+    QStringList steps;
+    while (plan.next()) {
+        steps << plan.value(3).toString(); // id, parent, notused, detail
+    }
+    return steps.join(" | ");
+}
+
+void SlowQueryLog::rotateIfNeeded() {
+    LogConfig &cfg = config();
+    if (QFileInfo(cfg.path).size() < cfg.maxFileBytes) return;
+
+    QFile::remove(QString("%1.%2").arg(cfg.path).arg(cfg.keepFiles));
+    for (int i = cfg.keepFiles - 1; i >= 1; --i) {
+        QFile::rename(QString("%1.%2").arg(cfg.path).arg(i),
+                      QString("%1.%2").arg(cfg.path).arg(i + 1));
+    }
+    QFile::rename(cfg.path, cfg.path + ".1");
+}
+
+bool SlowQueryLog::slowEnough(qint64 nanos) {
+    LogConfig &cfg = config();
+    QMutexLocker locker(&cfg.mutex);
+    return nanos >= cfg.thresholdNanos;
+}
+
+void SlowQueryLog::record(QSqlQuery &q, qint64 nanos, bool ok) {
+    if (!slowEnough(nanos)) return;
+
+    // Parameter shapes only – never the values, which may be credentials
+    QJsonArray params;
+    const QVariantList values = q.boundValues();
+    for (const QVariant &v : values) {
+        QString shape = v.isNull() ? QString("null") : QString::fromLatin1(v.metaType().name());
+        if (v.typeId() == QMetaType::QString) {
+            shape += QString("(%1)").arg(v.toString().size());
+        }
+        params.append(shape);
+    }
+
+    QJsonObject entry;
+    entry["ts"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    entry["duration_ms"] = nanos / 1e6;
+    entry["ok"] = ok;
+    if (q.isSelect()) {
+        // What the read cost: rows visited by full table scans, and
+        // virtual machine steps (index lookups, sorting and so on)
+        sqlite3_stmt *stmt = nativeStatement(q);
+        entry["fullscan_rows"] = stmt ? sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0) : 0;
+        entry["vm_steps"] = stmt ? sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0) : 0;
+    } else {
+        entry["rows"] = q.numRowsAffected();
+    }
+    entry["sql"] = q.lastQuery();
+    entry["params"] = params;
+    entry["plan"] = explain(q);
+    write(entry);
+}
+
+void SlowQueryLog::recordNative(const QSqlDatabase &db, const char *sql, qint64 nanos, bool ok, qint64 rows) {
+    if (!slowEnough(nanos)) return;
+
+    // Unbound parameters read as NULL, which does not change the plan
+    QSqlQuery plan(db);
+    QStringList steps;
+    if (plan.exec(QString("EXPLAIN QUERY PLAN ") + sql)) {
+        while (plan.next()) steps << plan.value(3).toString();
+    }
+
+    QJsonObject entry;
+    entry["ts"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    entry["duration_ms"] = nanos / 1e6;
+    entry["ok"] = ok;
+    entry["rows"] = rows;
+    entry["sql"] = QString::fromUtf8(sql);
+    entry["native"] = true;
+    entry["plan"] = steps.join(" | ");
+    write(entry);
+}
+
+void SlowQueryLog::write(const QJsonObject &entry) {
+    LogConfig &cfg = config();
+    QMutexLocker locker(&cfg.mutex);
+    rotateIfNeeded();
+    QFile file(cfg.path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Slow query log: cannot open" << cfg.path << ":" << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+    file.write("\n");
+}
@@ -0,0 +1,41 @@
+#ifndef SLOWQUERYLOG_H
+#define SLOWQUERYLOG_H
+
+#include <QString>
+#include <atomic>
+
+class QSqlQuery;
+class QSqlDatabase;
+class QJsonObject;
+
+// Opt-in slow-query log. Every statement in the DB layer is executed
+// through SlowQueryLog::exec; when enabled, statements slower than the
+// threshold are appended as JSON lines (SQL, parameter types, duration,
+// rows touched and EXPLAIN QUERY PLAN) to a size-rotated local file.
+class SlowQueryLog {
+public:
+    static void enable(const QString &path,
+                       int thresholdMs,
+                       qint64 maxFileBytes = 5 * 1024 * 1024,
+                       int keepFiles = 3);
+    static void disable();
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static bool exec(QSqlQuery &q);
+    static bool exec(QSqlQuery &q, const QString &sql);
+    static bool execBatch(QSqlQuery &q);
+    // For statements run on the native handle (see NativeStatement); the
+    // caller times them only while the log is enabled
+    static void recordNative(const QSqlDatabase &db, const char *sql, qint64 nanos, bool ok, qint64 rows);
+
+private:
+    static void record(QSqlQuery &q, qint64 nanos, bool ok);
+    static QString explain(QSqlQuery &q);
+    static bool slowEnough(qint64 nanos);
+    static void write(const QJsonObject &entry);
+    static void rotateIfNeeded();
+
+    static std::atomic<bool> s_enabled;
+};
+
+#endif // SLOWQUERYLOG_H
@@ -0,0 +1,99 @@
+#include <QApplication>
+#include <QTemporaryDir>
+#include <QTabWidget>
+#include <QSqlQuery>
+#include <QElapsedTimer>
+#include <QDebug>
+#include "dbmanager.h"
+#include "slowquerylog.h"
+#include "uiprofiler.h"
+#include "riskengine.h"
+#include "mainwindow.h"
+
+// Dashboard memory soak test. Opens the dashboard of the first sample
+// client in a throwaway database and runs 'operations' rounds of a $1
+// deposit or withdrawal followed by every table refresh. Fails if resident
+// memory is still growing after the first fifth of the run.
+class DashboardSoak {
+public:
+    static bool run(int operations, QString *report);
+};
+
+bool DashboardSoak::run(int operations, QString *report) {
+    // Growth allowed after the warm-up, for SQLite's page cache and allocator slack
+    constexpr qint64 kToleranceBytes = 4 * 1024 * 1024;
+
+    QSqlQuery first(DBManager::shardDatabase(0));
+    if (!SlowQueryLog::exec(first, "SELECT id, user_id FROM accounts ORDER BY id LIMIT 1") || !first.next()) {
+        *report = "soak: the sample clients could not be added";
+        return false;
+    }
+    const int accountId = first.value(0).toInt();
+    const int userId = first.value(1).toInt();
+    first.finish();
+    if (UiProfiler::residentBytes() < 0) {
+        *report = "soak: resident memory cannot be read on this platform";
+        return false;
+    }
+
+    // Velocity limits would refuse most of the withdrawals
+    RiskEngine::instance().setRules({});
+
+    MainWindow window(userId);
+    window.show();
+    for (int i = 0; i < window.m_tabs->count(); ++i) window.ensureTabBuilt(i);
+    QApplication::processEvents();
+
+    const int warmup = qMax(1, operations / 5);
+    qint64 warmRss = 0;
+    qint64 peakRss = 0;
+    int failed = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = 0; i < operations; ++i) {
+        const bool ok = (i % 2 == 0) ? DBManager::deposit(accountId, 1.0) : DBManager::withdraw(accountId, 1.0);
+        if (!ok) ++failed;
+        window.refreshOverview();
+        window.refreshAccountsTables();
+        window.refreshCreditCards();
+        window.refreshScheduledPayments();
+        window.refreshStatements();
+        // Paint, and run the deleteLater()s a real event loop would
+        QApplication::processEvents();
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+
+        const qint64 rss = UiProfiler::residentBytes();
+        if (i + 1 == warmup) warmRss = rss;
+        if (i + 1 >= warmup) peakRss = qMax(peakRss, rss);
+    }
+
+    const qint64 growth = peakRss - warmRss;
+    const bool flat = failed == 0 && growth <= kToleranceBytes;
+    *report = QString("soak: operations=%1 failed=%2 elapsed_ms=%3 rss_after_warmup_kb=%4 peak_rss_kb=%5 "
+                      "growth_kb=%6 limit_kb=%7 -> %8")
+                  .arg(operations).arg(failed).arg(clock.elapsed())
+                  .arg(warmRss / 1024).arg(peakRss / 1024).arg(growth / 1024).arg(kToleranceBytes / 1024)
+                  .arg(flat ? "flat" : "GROWING");
+    return flat;
+}
+
+// BlueBankSoak [operations]: exits with 1 if resident memory kept growing
+int main(int argc, char *argv[]) {
+    // Runs without a display unless a platform is chosen explicitly
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QTemporaryDir dir;
+    if (!dir.isValid() || !DBManager::init(dir.filePath("soak.db"))) {
+        qCritical() << "soak: could not create a temporary database";
+        return 2;
+    }
+    DBManager::seedSampleData();
+
+    bool countOk = false;
+    const int operations = app.arguments().value(1).toInt(&countOk);
+    QString report;
+    const bool flat = DashboardSoak::run(countOk ? qMax(10, operations) : 5000, &report);
+    qInfo().noquote() << report;
+    return flat ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include "spendingsnapshot.h"
+#include "opmetrics.h"
+#include "slowquerylog.h"
+#include "dbmanager.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <algorithm>
+
+void SpendingSnapshot::clear() {
+    m_userId = -1;
+    m_lastId = 0;
+    m_amountCents.clear();
+    m_month.clear();
+    m_type.clear();
+    m_category.clear();
+    m_types.clear();
+    m_categories = QStringList{QString()};
+}
+
+quint8 SpendingSnapshot::intern(QStringList &dictionary, const QString &text) {
+    int code = dictionary.indexOf(text);
+    if (code < 0) {
+        if (dictionary.size() > 0xFF) return 0xFF; // folded into the last label
+        dictionary << text;
+        code = int(dictionary.size()) - 1;
+    }
+    return quint8(code);
+}
+
+int SpendingSnapshot::refresh(const QSqlDatabase &db, int userId) {
+    OpTimer timer("SpendingSnapshot::refresh");
+    if (userId != m_userId) {
+        clear();
+        m_userId = userId;
+    }
+
+    // IDs only grow and a shard has one writer, so every row committed
+    // after the last refresh has a larger ID than any row loaded so far.
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    static const QString sql = QString("SELECT t.id, t.type, "
+                                       "CASE WHEN %1 THEN t.amount ELSE -t.amount END, "
+                                       "CAST(substr(t.timestamp, 1, 4) AS INTEGER) * 12 "
+                                       "+ CAST(substr(t.timestamp, 6, 2) AS INTEGER) - 1, "
+                                       "COALESCE(p.category, '') "
+                                       "FROM accounts a "
+                                       "JOIN transactions t ON t.account_id = a.id AND t.id > :last "
+                                       "LEFT JOIN bill_payees p ON p.id = t.payee_id "
+                                       "WHERE a.user_id = :user "
+                                       "ORDER BY t.id")
+                                   .arg(DBManager::creditTypeCondition("t.type"));
+    q.prepare(sql);
+    q.bindValue(":last", m_lastId);
+    q.bindValue(":user", userId);
+    if (!SlowQueryLog::exec(q)) {
+        qWarning() << "Spending snapshot refresh failed:" << q.lastError().text();
+        return timer.finish(-1);
+    }
+
+    int added = 0;
+    while (q.next()) {
+        m_lastId = qMax(m_lastId, q.value(0).toLongLong());
+        m_type.push_back(intern(m_types, q.value(1).toString()));
+        m_amountCents.push_back(qRound64(q.value(2).toDouble() * 100.0));
+        m_month.push_back(q.value(3).toInt());
+        m_category.push_back(intern(m_categories, q.value(4).toString()));
+        ++added;
+    }
+    return timer.finish(added);
+}
+
+QVector<SpendingSnapshot::Totals> SpendingSnapshot::totalsBy(const std::vector<quint8> &codes,
+                                                             const QStringList &labels,
+                                                             int monthIndex) const {
+    const size_t n = m_amountCents.size();
+    const qint64 *amount = m_amountCents.data();
+    const qint32 *month = m_month.data();
+    const quint8 *code = codes.data();
+
+    // One branch-free masked sum per label; the compiler vectorizes these
+    // loops, and there are only a handful of labels.
+    QVector<Totals> totals;
+    for (int c = 0; c < labels.size(); ++c) {
+        qint64 sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const qint64 mask = -qint64(month[i] == monthIndex && code[i] == c);
+            sum += amount[i] & mask;
+        }
+        if (sum != 0 && !labels[c].isEmpty()) totals.append({labels[c], qAbs(sum)});
+    }
+    std::sort(totals.begin(), totals.end(),
+              [](const Totals &a, const Totals &b) { return a.cents > b.cents; });
+    return totals;
+}
+
+QVector<SpendingSnapshot::Totals> SpendingSnapshot::totalsByType(int monthIndex) const {
+    OpTimer timer("SpendingSnapshot::totalsByType");
+    return totalsBy(m_type, m_types, monthIndex);
+}
+
+QVector<SpendingSnapshot::Totals> SpendingSnapshot::totalsByCategory(int monthIndex) const {
+    OpTimer timer("SpendingSnapshot::totalsByCategory");
+    return totalsBy(m_category, m_categories, monthIndex);
+}
+
+QVector<SpendingSnapshot::MonthFlow> SpendingSnapshot::trend(int lastMonthIndex, int months) const {
+    OpTimer timer("SpendingSnapshot::trend");
+    QVector<MonthFlow> flows(qMax(0, months));
+    const int first = lastMonthIndex - months + 1;
+    for (int m = 0; m < months; ++m) flows[m].monthIndex = first + m;
+
+    const size_t n = m_amountCents.size();
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned bucket = unsigned(m_month[i] - first);
+        if (bucket >= unsigned(months)) continue;
+        const qint64 a = m_amountCents[i];
+        flows[int(bucket)].incomeCents += qMax<qint64>(a, 0);
+        flows[int(bucket)].spendingCents += qMax<qint64>(-a, 0);
+    }
+    return flows;
+}
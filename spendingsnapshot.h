@@ -0,0 +1,60 @@
+#ifndef SPENDINGSNAPSHOT_H
+#define SPENDINGSNAPSHOT_H
+
+#include <QSqlDatabase>
+#include <QDate>
+#include <QStringList>
+#include <QVector>
+#include <vector>
+
+// One user's transaction history held column by column (amount, month,
+// type, payee category) for the Overview insights. refresh() only reads
+// rows newer than the last one loaded; aggregation runs over the columns in
+// memory, so it stays in the low milliseconds at 100k+ transactions.
+class SpendingSnapshot {
+public:
+    struct Totals {
+        QString label;
+        qint64 cents = 0;
+    };
+    struct MonthFlow {
+        int monthIndex = 0; // year * 12 + month - 1
+        qint64 incomeCents = 0;
+        qint64 spendingCents = 0;
+    };
+
+    // Loads the user's transactions added since the last call. Switching
+    // users starts over. Returns the number of new rows, or -1.
+    int refresh(const QSqlDatabase &db, int userId);
+    void clear();
+
+    int size() const { return int(m_amountCents.size()); }
+    static int monthIndex(const QDate &date) { return date.year() * 12 + date.month() - 1; }
+
+    // Money moved in one month, per transaction type and per bill payee
+    // category, largest first
+    QVector<Totals> totalsByType(int monthIndex) const;
+    QVector<Totals> totalsByCategory(int monthIndex) const;
+    // Income and spending for 'months' months ending with lastMonthIndex
+    QVector<MonthFlow> trend(int lastMonthIndex, int months) const;
+
+private:
+    static quint8 intern(QStringList &dictionary, const QString &text);
+    QVector<Totals> totalsBy(const std::vector<quint8> &codes, const QStringList &labels,
+                             int monthIndex) const;
+
+    int m_userId = -1;
+    qint64 m_lastId = 0;
+
+    // Columns, one entry per transaction. amount is signed: credits to the
+    // user's accounts are positive.
+    std::vector<qint64> m_amountCents;
+    std::vector<qint32> m_month;
+    std::vector<quint8> m_type;
+    std::vector<quint8> m_category; // 0 = not a bill payment
+
+    QStringList m_types;
+    QStringList m_categories{QString()};
+};
+
+#endif // SPENDINGSNAPSHOT_H
@@ -0,0 +1,125 @@
+#include "sqlitebackend.h"
+#include "slowquerylog.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <vector>
+
+bool SqliteBackend::generate(int users, int cardsPerUser, int schedulesPerUser) {
+    QSqlDatabase directory = DBManager::directoryDatabase();
+    const int shards = DBManager::shardCount();
+    const int commitEvery = 20000;
+    const QString today = QDate::currentDate().toString("yyyy-MM-dd");
+
+    int payeeId = -1;
+    QSqlQuery payee(directory);
+    if (SlowQueryLog::exec(payee, "SELECT MIN(id) FROM bill_payees") && payee.next()) {
+        payeeId = payee.value(0).toInt();
+    }
+    if (schedulesPerUser > 0 && payeeId <= 0) {
+        qWarning() << "generate: no bill payees to schedule payments to";
+        return false;
+    }
+
+    QSqlQuery base(directory);
+    qint64 offset = 0;
+    if (SlowQueryLog::exec(base, "SELECT COALESCE(MAX(id), 0) FROM users") && base.next()) {
+        offset = base.value(0).toLongLong();
+    }
+
+    QSqlQuery user(directory);
+    user.prepare("INSERT INTO users (email, password, username) VALUES (?, 'Password123!', ?)");
+
+    // Per-shard statements; with one shard the directory is the shard
+    struct ShardWriter {
+        QSqlDatabase db;
+        QSqlQuery home, account, card, schedule;
+    };
+    std::vector<ShardWriter> writers;
+    QList<QSqlDatabase> files{directory};
+    for (int s = 0; s < shards; ++s) {
+        QSqlDatabase db = DBManager::shardDatabase(s);
+        if (shards > 1) files << db;
+        ShardWriter w{db, QSqlQuery(db), QSqlQuery(db), QSqlQuery(db), QSqlQuery(db)};
+        w.home.prepare("INSERT INTO users (id, email, password, username) VALUES (?, ?, '', ?)");
+        w.account.prepare("INSERT INTO accounts (user_id, account_number, type, balance, last_interest_applied) "
+                          "VALUES (?, ?, 'Chequing', 1000, ?)");
+        w.card.prepare("INSERT INTO credit_cards (user_id, card_number, cvv, expiry_month, expiry_year, "
+                       "credit_limit, current_balance, statement_balance) "
+                       "VALUES (?, ?, '123', 12, 2030, 5000, ?, ?)");
+        w.schedule.prepare("INSERT INTO scheduled_payments "
+                           "(user_id, from_account_id, payee_id, amount, frequency, day_of_month, next_due) "
+                           "VALUES (?, ?, ?, ?, 'Monthly', 1, ?)");
+        writers.push_back(std::move(w));
+    }
+
+    auto beginAll = [&files]() { for (QSqlDatabase &db : files) db.transaction(); };
+    auto commitAll = [&files]() {
+        bool ok = true;
+        for (QSqlDatabase &db : files) ok = db.commit() && ok;
+        return ok;
+    };
+
+    beginAll();
+    for (int i = 1; i <= users; ++i) {
+        const qint64 n = offset + i;
+        const QString email = QString("user%1@bench.local").arg(n);
+        const QString name = QString("Bench User %1").arg(n);
+        user.addBindValue(email);
+        user.addBindValue(name);
+        if (!SlowQueryLog::exec(user)) {
+            qWarning() << "generate: user insert failed:" << user.lastError().text();
+            for (QSqlDatabase &db : files) db.rollback();
+            return false;
+        }
+        const qint64 userId = user.lastInsertId().toLongLong();
+        ShardWriter &w = writers[DBManager::shardForUser(int(userId))];
+
+        if (shards > 1) {
+            w.home.addBindValue(userId);
+            w.home.addBindValue(email);
+            w.home.addBindValue(name);
+            SlowQueryLog::exec(w.home);
+        }
+
+        w.account.addBindValue(userId);
+        w.account.addBindValue(QString("77%1").arg(n, 10, 10, QChar('0')));
+        w.account.addBindValue(today);
+        SlowQueryLog::exec(w.account);
+        const qint64 accountId = w.account.lastInsertId().toLongLong();
+
+        for (int k = 0; k < cardsPerUser; ++k) {
+            w.card.addBindValue(userId);
+            w.card.addBindValue(QString("4%1%2").arg(n, 13, 10, QChar('0')).arg(k, 2, 10, QChar('0')));
+            w.card.addBindValue(double((n * 37 + k) % 4000));
+            w.card.addBindValue(double((n * 17 + k) % 2000));
+            SlowQueryLog::exec(w.card);
+        }
+        for (int k = 0; k < schedulesPerUser; ++k) {
+            w.schedule.addBindValue(userId);
+            w.schedule.addBindValue(accountId);
+            w.schedule.addBindValue(payeeId);
+            w.schedule.addBindValue(10.0 + k);
+            w.schedule.addBindValue(today);
+            SlowQueryLog::exec(w.schedule);
+        }
+
+        if (i % commitEvery == 0) {
+            commitAll();
+            beginAll();
+        }
+    }
+    return commitAll();
+}
+
+QList<int> SqliteBackend::accountIds(int partition, int limit) {
+    QList<int> ids;
+    QSqlQuery q(DBManager::shardDatabase(partition));
+    q.setForwardOnly(true);
+    q.prepare("SELECT id FROM accounts ORDER BY id LIMIT :n");
+    q.bindValue(":n", limit);
+    if (!SlowQueryLog::exec(q)) return ids;
+    while (q.next()) ids << q.value(0).toInt();
+    return ids;
+}
@@ -0,0 +1,84 @@
+#ifndef SQLITEBACKEND_H
+#define SQLITEBACKEND_H
+
+#include "storagebackend.h"
+
+// The production backend: forwards every operation to DBManager, which
+// must have been initialised with DBManager::init().
+class SqliteBackend : public StorageBackend {
+public:
+    QString name() const override { return "sqlite"; }
+
+    bool createUser(const QString &email, const QString &password,
+                    const QString &username, const QDate &dob) override {
+        return DBManager::createUser(email, password, username, dob);
+    }
+    int authenticateUser(const QString &email, const QString &password) override {
+        return DBManager::authenticateUser(email, password);
+    }
+
+    int createAccount(int userId, const QString &type,
+                      double initialBalance, double interestRate) override {
+        return DBManager::createAccount(userId, type, initialBalance, interestRate);
+    }
+    bool deposit(int accountId, double amount) override {
+        return DBManager::deposit(accountId, amount);
+    }
+    bool withdraw(int accountId, double amount) override {
+        return DBManager::withdraw(accountId, amount);
+    }
+    bool transferAccountToAccount(int fromAccountId, int toAccountId, double amount) override {
+        return DBManager::transferAccountToAccount(fromAccountId, toAccountId, amount);
+    }
+    bool registerInteracEmail(int userId, int accountId, const QString &email) override {
+        return DBManager::registerInteracEmail(userId, accountId, email);
+    }
+    bool interacTransfer(int fromAccountId, const QString &toEmail, double amount) override {
+        return DBManager::interacTransfer(fromAccountId, toEmail, amount);
+    }
+
+    bool payBill(int userId, int fromAccountId, int payeeId, double amount) override {
+        return DBManager::payBill(userId, fromAccountId, payeeId, amount);
+    }
+    int scheduleBillPayment(int userId, int fromAccountId, int payeeId, double amount,
+                            const QString &frequency, const QDate &firstDue) override {
+        return DBManager::scheduleBillPayment(userId, fromAccountId, payeeId, amount, frequency, firstDue);
+    }
+    bool cancelScheduledPayment(int userId, int scheduleId) override {
+        return DBManager::cancelScheduledPayment(userId, scheduleId);
+    }
+    ScheduledRunStats runDueScheduledPayments(const QDate &asOf, int userId) override {
+        return DBManager::runDueScheduledPayments(asOf, userId);
+    }
+
+    int applyForCreditCard(int userId, double creditLimit) override {
+        return DBManager::applyForCreditCard(userId, creditLimit);
+    }
+    bool spendOnCard(int cardId, double amount) override {
+        return DBManager::spendOnCard(cardId, amount);
+    }
+    bool payCreditCard(int userId, int fromAccountId, int cardId, double amount) override {
+        return DBManager::payCreditCard(userId, fromAccountId, cardId, amount);
+    }
+    CardCycleStats closeCardBillingCycle(const QDate &statementDate, int threadCount) override {
+        return DBManager::closeCardBillingCycle(statementDate, threadCount);
+    }
+
+    void applyMonthlyInterestForUser(int userId) override {
+        DBManager::applyMonthlyInterestForUser(userId);
+    }
+    int applyMonthlyInterestForAllUsers() override {
+        return DBManager::applyMonthlyInterestForAllUsers();
+    }
+
+    bool beginBatch() override { return DBManager::beginBatch(); }
+    bool commitBatch() override { return DBManager::commitBatch(); }
+    void rollbackBatch() override { DBManager::rollbackBatch(); }
+
+    // Bulk-loads with prepared statements, bypassing the per-posting path
+    bool generate(int users, int cardsPerUser, int schedulesPerUser) override;
+    int partitionCount() const override { return DBManager::shardCount(); }
+    QList<int> accountIds(int partition, int limit) override;
+};
+
+#endif // SQLITEBACKEND_H
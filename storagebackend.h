@@ -0,0 +1,62 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include "dbmanager.h"
+#include <QList>
+#include <QString>
+#include <QDate>
+
+// Banking operations independent of where the data lives. SqliteBackend
+// runs them through DBManager; MemoryBackend keeps everything in flat
+// in-process containers, which separates business-logic cost from storage
+// cost in benchmarks and simulations.
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    virtual QString name() const = 0;
+
+    // Users
+    virtual bool createUser(const QString &email, const QString &password,
+                            const QString &username, const QDate &dob) = 0;
+    virtual int authenticateUser(const QString &email, const QString &password) = 0;
+
+    // Accounts and postings
+    virtual int createAccount(int userId, const QString &type,
+                              double initialBalance, double interestRate) = 0;
+    virtual bool deposit(int accountId, double amount) = 0;
+    virtual bool withdraw(int accountId, double amount) = 0;
+    virtual bool transferAccountToAccount(int fromAccountId, int toAccountId, double amount) = 0;
+    virtual bool registerInteracEmail(int userId, int accountId, const QString &email) = 0;
+    virtual bool interacTransfer(int fromAccountId, const QString &toEmail, double amount) = 0;
+
+    // Bills
+    virtual bool payBill(int userId, int fromAccountId, int payeeId, double amount) = 0;
+    virtual int scheduleBillPayment(int userId, int fromAccountId, int payeeId, double amount,
+                                    const QString &frequency, const QDate &firstDue) = 0;
+    virtual bool cancelScheduledPayment(int userId, int scheduleId) = 0;
+    virtual ScheduledRunStats runDueScheduledPayments(const QDate &asOf, int userId) = 0;
+
+    // Credit cards
+    virtual int applyForCreditCard(int userId, double creditLimit) = 0;
+    virtual bool spendOnCard(int cardId, double amount) = 0;
+    virtual bool payCreditCard(int userId, int fromAccountId, int cardId, double amount) = 0;
+    virtual CardCycleStats closeCardBillingCycle(const QDate &statementDate, int threadCount) = 0;
+
+    // Interest
+    virtual void applyMonthlyInterestForUser(int userId) = 0;
+    virtual int applyMonthlyInterestForAllUsers() = 0;
+
+    // Grouping of postings; a no-op for backends without transactions
+    virtual bool beginBatch() = 0;
+    virtual bool commitBatch() = 0;
+    virtual void rollbackBatch() = 0;
+
+    // Benchmark support: synthetic clients, and account IDs grouped by
+    // partitions that can be written independently (SQLite shards).
+    virtual bool generate(int users, int cardsPerUser, int schedulesPerUser) = 0;
+    virtual int partitionCount() const = 0;
+    virtual QList<int> accountIds(int partition, int limit) = 0;
+};
+
+#endif // STORAGEBACKEND_H
@@ -0,0 +1,158 @@
+#include "tellerwindow.h"
+#include "mainwindow.h"
+#include "loginwindow.h"
+#include "dbmanager.h"
+#include "sessioncache.h"
+#include "slowquerylog.h"
+#include "uiprofiler.h"
+
+#include <QListWidget>
+#include <QStackedWidget>
+#include <QSplitter>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QLabel>
+#include <QStatusBar>
+#include <QSqlQuery>
+#include <QTimer>
+#include <QDebug>
+
+namespace {
+constexpr int kStatusIntervalMs = 2000;
+
+QString megabytes(qint64 bytes) {
+    return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+}
+
+TellerWindow::TellerWindow(QWidget *parent)
+    : QMainWindow(parent),
+      m_customerList(nullptr),
+      m_sessions(nullptr),
+      m_statusLabel(nullptr),
+      m_statusTimer(new QTimer(this)),
+      m_firstSessionRss(-1)
+{
+    setWindowTitle("Sudbury Student Bank – Teller");
+    resize(1440, 780);
+
+    auto *side = new QWidget(this);
+    auto *sideLayout = new QVBoxLayout(side);
+    auto *title = new QLabel("Customers", side);
+    title->setObjectName("pageTitle");
+    m_customerList = new QListWidget(side);
+    auto *openBtn = new QPushButton("Open customer…", side);
+    auto *closeBtn = new QPushButton("Close session", side);
+    sideLayout->addWidget(title);
+    sideLayout->addWidget(m_customerList, 1);
+    sideLayout->addWidget(openBtn);
+    sideLayout->addWidget(closeBtn);
+
+    m_sessions = new QStackedWidget(this);
+    auto *empty = new QLabel("Open a customer to start a session.", m_sessions);
+    empty->setAlignment(Qt::AlignCenter);
+    m_sessions->addWidget(empty);
+
+    auto *splitter = new QSplitter(this);
+    splitter->addWidget(side);
+    splitter->addWidget(m_sessions);
+    splitter->setStretchFactor(1, 1);
+    splitter->setSizes({240, 1200});
+    setCentralWidget(splitter);
+
+    m_statusLabel = new QLabel(this);
+    statusBar()->addWidget(m_statusLabel, 1);
+
+    connect(openBtn, &QPushButton::clicked, this, &TellerWindow::openCustomer);
+    connect(closeBtn, &QPushButton::clicked, this, &TellerWindow::closeSession);
+    // Switching customers only flips the visible page
+    connect(m_customerList, &QListWidget::currentRowChanged, this, [this](int row) {
+        if (MainWindow *session = sessionAt(row)) m_sessions->setCurrentWidget(session);
+    });
+
+    m_statusTimer->setInterval(kStatusIntervalMs);
+    connect(m_statusTimer, &QTimer::timeout, this, &TellerWindow::updateStatus);
+    m_statusTimer->start();
+    updateStatus();
+}
+
+MainWindow *TellerWindow::sessionAt(int row) const {
+    // Page 0 is the empty placeholder
+    return qobject_cast<MainWindow *>(m_sessions->widget(row + 1));
+}
+
+void TellerWindow::openCustomer() {
+    if (m_login) {
+        m_login->raise();
+        m_login->activateWindow();
+        return;
+    }
+    m_login = new LoginWindow();
+    m_login->setAttribute(Qt::WA_DeleteOnClose);
+    connect(m_login, &LoginWindow::loginSucceeded, this, [this](int userId) {
+        m_login->close();
+        addSession(userId);
+    });
+    m_login->show();
+}
+
+void TellerWindow::addSession(int userId) {
+    // One session per customer; opening them again switches to it
+    for (int row = 0; row < m_customerList->count(); ++row) {
+        if (sessionAt(row)->userId() == userId) {
+            m_customerList->setCurrentRow(row);
+            return;
+        }
+    }
+
+    QString name = QString("Customer %1").arg(userId);
+    QSqlQuery q(DBManager::directoryDatabase());
+    q.prepare("SELECT username FROM users WHERE id = :id");
+    q.bindValue(":id", userId);
+    if (SlowQueryLog::exec(q) && q.next()) name = q.value(0).toString();
+
+    auto *session = new MainWindow(userId, m_sessions);
+    session->setEmbedded(true);
+    m_sessions->addWidget(session);
+    m_customerList->addItem(name);
+    m_customerList->setCurrentRow(m_customerList->count() - 1);
+
+    // Measure once the session's first frame and loads have run
+    QTimer::singleShot(kStatusIntervalMs / 2, this, [this]() {
+        if (m_firstSessionRss < 0 && m_customerList->count() == 1) {
+            m_firstSessionRss = UiProfiler::residentBytes();
+        }
+        updateStatus();
+    });
+}
+
+void TellerWindow::closeSession() {
+    const int row = m_customerList->currentRow();
+    MainWindow *session = sessionAt(row);
+    if (!session) return;
+    m_sessions->removeWidget(session);
+    session->deleteLater();
+    delete m_customerList->takeItem(row);
+    if (m_customerList->count() == 0) {
+        m_sessions->setCurrentIndex(0);
+        m_firstSessionRss = -1;
+    }
+    updateStatus();
+}
+
+void TellerWindow::updateStatus() {
+    const int sessions = m_customerList->count();
+    const qint64 rss = UiProfiler::residentBytes();
+    QString text = QString("%1 session%2 · %3 shared lists")
+                       .arg(sessions).arg(sessions == 1 ? "" : "s")
+                       .arg(SessionCache::liveLists());
+    if (rss >= 0) {
+        text += " · RSS " + megabytes(rss);
+        if (sessions > 1 && m_firstSessionRss >= 0) {
+            const qint64 perSession = (rss - m_firstSessionRss) / (sessions - 1);
+            text += QString(" · %1 KB per extra session").arg(perSession / 1024);
+        }
+    }
+    m_statusLabel->setText(text);
+}
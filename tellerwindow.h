@@ -0,0 +1,41 @@
+#ifndef TELLERWINDOW_H
+#define TELLERWINDOW_H
+
+#include <QMainWindow>
+#include <QPointer>
+
+class QListWidget;
+class QStackedWidget;
+class QLabel;
+class QTimer;
+class LoginWindow;
+class MainWindow;
+
+// Teller mode: many customer sessions open at once in one window. Each
+// session is an embedded MainWindow; the customer list on the left switches
+// between them without reloading anything. Sessions share the account,
+// payee and FAQ lists through SessionCache, and the status line shows what
+// each extra session costs in resident memory.
+class TellerWindow : public QMainWindow {
+    Q_OBJECT
+public:
+    explicit TellerWindow(QWidget *parent = nullptr);
+
+private slots:
+    void openCustomer();
+    void addSession(int userId);
+    void closeSession();
+    void updateStatus();
+
+private:
+    MainWindow *sessionAt(int row) const;
+
+    QListWidget    *m_customerList;
+    QStackedWidget *m_sessions;
+    QLabel         *m_statusLabel;
+    QTimer         *m_statusTimer;
+    QPointer<LoginWindow> m_login;
+    qint64 m_firstSessionRss;   // after the first session was loaded
+};
+
+#endif // TELLERWINDOW_H
@@ -0,0 +1,205 @@
+#include "txlog.h"
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[8] = {'B', 'B', 'T', 'X', 'L', 'O', 'G', '\0'};
+constexpr quint32 kVersion = 1;
+constexpr int kFlushRecords = 4096;
+
+struct TxLogHeader {
+    char magic[8];
+    quint32 version;
+    quint32 recordSize;
+    char reserved[48];
+};
+static_assert(sizeof(TxLogHeader) == 64, "TxLogHeader is the on-disk layout");
+
+bool validHeader(const TxLogHeader &header) {
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+           && header.version == kVersion && header.recordSize == sizeof(TxRecord);
+}
+
+} // namespace
+
+TxLogWriter::~TxLogWriter() {
+    close();
+}
+
+bool TxLogWriter::open(const QString &path, bool truncate) {
+    close();
+    m_file.setFileName(path);
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (truncate) mode |= QIODevice::Truncate;
+    if (!m_file.open(mode)) {
+        qWarning() << "Cannot open transaction log" << path << ":" << m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() == 0) {
+        TxLogHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.recordSize = sizeof(TxRecord);
+        if (m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) {
+            m_file.close();
+            return false;
+        }
+        m_count = 0;
+    } else {
+        TxLogHeader header{};
+        if (m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+            || !validHeader(header)) {
+            qWarning() << path << "is not a transaction log";
+            m_file.close();
+            return false;
+        }
+        // Drop a record torn by a crash mid-write
+        m_count = (m_file.size() - qint64(sizeof(TxLogHeader))) / qint64(sizeof(TxRecord));
+        const qint64 end = qint64(sizeof(TxLogHeader)) + m_count * qint64(sizeof(TxRecord));
+        if (m_file.size() != end) m_file.resize(end);
+        m_file.seek(end);
+    }
+
+    m_dict.setFileName(path + ".dict");
+    if (!m_dict.open(m_count == 0 ? (QIODevice::ReadWrite | QIODevice::Truncate) : QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open transaction log dictionary:" << m_dict.errorString();
+        m_file.close();
+        return false;
+    }
+    const QList<QByteArray> lines = m_dict.readAll().split('\n');
+    for (int i = 0; i + 1 < lines.size(); ++i) {
+        m_codes.insert(QString::fromUtf8(lines[i]), quint16(i));
+    }
+    m_dict.seek(m_dict.size());
+
+    m_buffer.reserve(kFlushRecords);
+    return true;
+}
+
+bool TxLogWriter::intern(const QString &text, quint16 *code) {
+    auto it = m_codes.constFind(text);
+    if (it != m_codes.constEnd()) {
+        *code = it.value();
+        return true;
+    }
+    if (m_codes.size() > 0xFFFF) return false;
+
+    QString line = text;
+    line.replace('\n', ' ');
+    if (m_dict.write(line.toUtf8() + '\n') < 0) return false;
+    *code = quint16(m_codes.size());
+    m_codes.insert(text, *code);
+    return true;
+}
+
+bool TxLogWriter::append(qint32 accountId, qint32 relatedAccountId, const QString &type,
+                         const QString &description, qint64 amountCents, qint64 timestampMs) {
+    if (!m_file.isOpen()) return false;
+    TxRecord record{};
+    if (!intern(type, &record.typeCode) || !intern(description, &record.descriptionCode)) {
+        qWarning() << "Transaction log dictionary is full";
+        return false;
+    }
+    record.timestampMs = timestampMs;
+    record.amountCents = amountCents;
+    record.accountId = accountId;
+    record.relatedAccountId = relatedAccountId;
+    m_buffer.push_back(record);
+    ++m_count;
+
+    if (int(m_buffer.size()) >= kFlushRecords) return flush();
+    return true;
+}
+
+bool TxLogWriter::flush() {
+    if (!m_file.isOpen()) return false;
+    // Dictionary first, so every code a record uses is on disk before it
+    if (!m_dict.flush()) return false;
+    if (!m_buffer.empty()) {
+        const qint64 size = qint64(m_buffer.size() * sizeof(TxRecord));
+        if (m_file.write(reinterpret_cast<const char *>(m_buffer.data()), size) != size) {
+            qWarning() << "Transaction log write failed:" << m_file.errorString();
+            return false;
+        }
+        m_buffer.clear();
+    }
+    return m_file.flush();
+}
+
+void TxLogWriter::close() {
+    if (!m_file.isOpen()) return;
+    flush();
+    m_file.close();
+    m_dict.close();
+    m_codes.clear();
+    m_count = 0;
+}
+
+TxLogReader::~TxLogReader() {
+    close();
+}
+
+bool TxLogReader::open(const QString &path) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < qint64(sizeof(TxLogHeader))) {
+        qWarning() << "Cannot open transaction log" << path;
+        return false;
+    }
+    m_map = m_file.map(0, m_file.size());
+    if (!m_map || !validHeader(*reinterpret_cast<const TxLogHeader *>(m_map))) {
+        qWarning() << path << "is not a transaction log";
+        close();
+        return false;
+    }
+    m_records = reinterpret_cast<const TxRecord *>(m_map + sizeof(TxLogHeader));
+    m_count = (m_file.size() - qint64(sizeof(TxLogHeader))) / qint64(sizeof(TxRecord));
+
+    QFile dict(path + ".dict");
+    if (dict.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> lines = dict.readAll().split('\n');
+        for (int i = 0; i + 1 < lines.size(); ++i) m_dict << QString::fromUtf8(lines[i]);
+    }
+    return true;
+}
+
+void TxLogReader::close() {
+    if (m_map) m_file.unmap(m_map);
+    m_map = nullptr;
+    m_records = nullptr;
+    m_count = 0;
+    m_dict.clear();
+    m_file.close();
+}
+
+QHash<qint32, qint64> TxLogReader::netBalances() const {
+    QHash<qint32, qint64> balances;
+    if (m_count == 0) return balances;
+
+    qint32 minId = m_records[0].accountId;
+    qint32 maxId = minId;
+    for (const TxRecord &r : *this) {
+        minId = qMin(minId, r.accountId);
+        maxId = qMax(maxId, r.accountId);
+    }
+
+    // Dense accumulation when the IDs are close together (one shard's
+    // range), otherwise a hash per record
+    const qint64 span = qint64(maxId) - minId + 1;
+    if (span <= (1 << 24)) {
+        std::vector<qint64> sums(size_t(span), 0);
+        std::vector<char> seen(size_t(span), 0);
+        for (const TxRecord &r : *this) {
+            sums[size_t(r.accountId - minId)] += r.amountCents;
+            seen[size_t(r.accountId - minId)] = 1;
+        }
+        for (qint64 i = 0; i < span; ++i) {
+            if (seen[size_t(i)]) balances.insert(qint32(minId + i), sums[size_t(i)]);
+        }
+    } else {
+        for (const TxRecord &r : *this) balances[r.accountId] += r.amountCents;
+    }
+    return balances;
+}
@@ -0,0 +1,77 @@
+#ifndef TXLOG_H
+#define TXLOG_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QFile>
+#include <vector>
+
+// One posting in the binary transaction log. amountCents is the signed
+// effect on the account's balance; type and description are codes into the
+// log's string dictionary. Stored in host byte order (little-endian on every
+// platform the app ships for).
+struct TxRecord {
+    qint64 timestampMs; // UTC, milliseconds since the epoch
+    qint64 amountCents;
+    qint32 accountId;
+    qint32 relatedAccountId; // 0 when none
+    quint16 typeCode;
+    quint16 descriptionCode;
+    quint32 reserved;
+};
+static_assert(sizeof(TxRecord) == 32, "TxRecord is the on-disk layout");
+
+// Append-only log of TxRecords. <path> holds a 64-byte header followed by
+// the records; <path>.dict holds the interned strings, one per line, line
+// number = code. A torn trailing record is dropped on the next open.
+class TxLogWriter {
+public:
+    ~TxLogWriter();
+
+    // Continues an existing log unless truncate is set
+    bool open(const QString &path, bool truncate = false);
+    bool append(qint32 accountId, qint32 relatedAccountId, const QString &type,
+                const QString &description, qint64 amountCents, qint64 timestampMs);
+    bool flush();
+    void close();
+
+    qint64 recordCount() const { return m_count; }
+
+private:
+    bool intern(const QString &text, quint16 *code);
+
+    QFile m_file;
+    QFile m_dict;
+    QHash<QString, quint16> m_codes;
+    std::vector<TxRecord> m_buffer;
+    qint64 m_count = 0;
+};
+
+// Read-only view of a log through a memory mapping. Records are read in
+// place; nothing is copied or parsed.
+class TxLogReader {
+public:
+    ~TxLogReader();
+
+    bool open(const QString &path);
+    void close();
+
+    qint64 count() const { return m_count; }
+    qint64 bytes() const { return m_count * qint64(sizeof(TxRecord)); }
+    const TxRecord *begin() const { return m_records; }
+    const TxRecord *end() const { return m_records + m_count; }
+    QString text(quint16 code) const { return m_dict.value(code); }
+
+    // Net balance change per account in cents over the whole log
+    QHash<qint32, qint64> netBalances() const;
+
+private:
+    QFile m_file;
+    uchar *m_map = nullptr;
+    const TxRecord *m_records = nullptr;
+    qint64 m_count = 0;
+    QStringList m_dict;
+};
+
+#endif // TXLOG_H
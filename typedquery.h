@@ -0,0 +1,126 @@
+#ifndef TYPEDQUERY_H
+#define TYPEDQUERY_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include <optional>
+#include <type_traits>
+#include "nativestatement.h"
+
+// A text cell of a RowSet: a slice of the set's text buffer
+struct TextRef {
+    quint32 offset = 0;
+    quint32 size = 0;
+};
+
+// The columns of a row struct in SELECT order, bound at compile time:
+//
+//   struct BalanceRow {
+//       qint64 id;
+//       TextRef type;
+//       double balance;
+//       using Columns = RowColumns<&BalanceRow::id, &BalanceRow::type, &BalanceRow::balance>;
+//   };
+//
+// Members may be int, qint64, double, std::optional<double> (NULL = empty)
+// or TextRef.
+template <auto... Members>
+struct RowColumns {
+    static constexpr int count = sizeof...(Members);
+};
+
+// Rows of one query, stored contiguously, with all their text in a single
+// buffer. A RowSet kept between queries reuses both allocations.
+template <typename Row>
+class RowSet {
+public:
+    int size() const { return int(m_rows.size()); }
+    bool isEmpty() const { return m_rows.isEmpty(); }
+    const Row &operator[](int i) const { return m_rows[i]; }
+    const Row &last() const { return m_rows.last(); }
+    typename QVector<Row>::const_iterator begin() const { return m_rows.cbegin(); }
+    typename QVector<Row>::const_iterator end() const { return m_rows.cend(); }
+
+    // UTF-8 bytes of a cell, valid until the next query into this set
+    QByteArrayView text(TextRef ref) const { return QByteArrayView(m_text.constData() + ref.offset, ref.size); }
+    QString string(TextRef ref) const { return QString::fromUtf8(text(ref)); }
+
+    void reserve(int rows, int textBytes) {
+        m_rows.reserve(rows);
+        m_text.reserve(textBytes);
+    }
+
+private:
+    friend class TypedQuery;
+    QVector<Row> m_rows;
+    QByteArray m_text;
+};
+
+// Reads through NativeStatement. Cells are decoded straight from SQLite
+// into the row structs, so a read allocates nothing per cell: no QVariant,
+// and no QString unless the caller asks for one.
+class TypedQuery {
+public:
+    // Runs sql with positional parameters ?1..?n taken from args (int,
+    // qint64, double, QByteArrayView as UTF-8, or QString) and replaces
+    // the contents of rows with the result
+    template <typename Row, typename... Args>
+    static bool select(const QSqlDatabase &db, const char *sql, RowSet<Row> *rows, const Args &...args);
+
+private:
+    static void read(const NativeStatement &statement, int column, int &value) {
+        value = int(statement.int64(column));
+    }
+    static void read(const NativeStatement &statement, int column, qint64 &value) {
+        value = statement.int64(column);
+    }
+    static void read(const NativeStatement &statement, int column, double &value) {
+        value = statement.real(column);
+    }
+    static void read(const NativeStatement &statement, int column, std::optional<double> &value) {
+        if (statement.isNull(column)) value.reset();
+        else value = statement.real(column);
+    }
+    static void read(const NativeStatement &statement, int column, TextRef &value, QByteArray &text) {
+        const QByteArrayView bytes = statement.text(column);
+        value.offset = quint32(text.size());
+        value.size = quint32(bytes.size());
+        text.append(bytes.data(), bytes.size());
+    }
+
+    template <typename Row, auto Member>
+    static void decode(const NativeStatement &statement, int column, Row &row, QByteArray &text) {
+        if constexpr (std::is_same_v<std::remove_reference_t<decltype(row.*Member)>, TextRef>) {
+            read(statement, column, row.*Member, text);
+        } else {
+            read(statement, column, row.*Member);
+        }
+    }
+
+    template <typename Row, auto... Members>
+    static void decodeRow(const NativeStatement &statement, Row &row, QByteArray &text, RowColumns<Members...>) {
+        int column = 0;
+        (decode<Row, Members>(statement, column++, row, text), ...);
+    }
+};
+
+template <typename Row, typename... Args>
+bool TypedQuery::select(const QSqlDatabase &db, const char *sql, RowSet<Row> *rows, const Args &...args) {
+    static_assert(std::is_trivially_copyable_v<Row>, "row structs must be plain data");
+    rows->m_rows.resize(0);
+    rows->m_text.resize(0);
+
+    NativeStatement statement(db, sql);
+    int index = 0;
+    (statement.bind(++index, args), ...);
+    while (statement.next()) {
+        Row &row = rows->m_rows.emplace_back();
+        decodeRow(statement, row, rows->m_text, typename Row::Columns());
+    }
+    return statement.ok();
+}
+
+#endif // TYPEDQUERY_H
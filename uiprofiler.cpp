@@ -0,0 +1,224 @@
+#include "uiprofiler.h"
+#include <QTimer>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int kHeartbeatMs = 20;
+constexpr int kMaxInteractions = 2000;
+
+} // namespace
+
+UiProfiler &UiProfiler::instance() {
+    static UiProfiler profiler;
+    return profiler;
+}
+
+UiProfiler::UiProfiler(QObject *parent)
+    : QObject(parent) {
+    m_clock.start();
+}
+
+void UiProfiler::setEnabled(bool on) {
+    if (on == m_enabled) return;
+    m_enabled = on;
+
+    if (!m_heartbeat) {
+        m_heartbeat = new QTimer(this);
+        m_heartbeat->setInterval(kHeartbeatMs);
+        m_heartbeat->setTimerType(Qt::PreciseTimer);
+        connect(m_heartbeat, &QTimer::timeout, this, &UiProfiler::heartbeat);
+        // The profiler is a function static and outlives the application;
+        // its timer must not, so it goes when the event loop ends
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]() {
+            delete m_heartbeat;
+            m_heartbeat = nullptr;
+            m_enabled = false;
+        });
+    }
+
+    m_pending.clear();
+    m_pendingName.clear();
+    m_depth = 0;
+    if (on) {
+        m_lastTickNs = nowNs();
+        m_heartbeat->start();
+    } else {
+        m_heartbeat->stop();
+    }
+}
+
+void UiProfiler::markInteraction(const QString &name) {
+    if (m_enabled) m_pendingName = name;
+}
+
+int UiProfiler::beginSpan() {
+    Span span;
+    span.depth = m_depth++;
+    span.startNs = nowNs();
+    m_pending.append(span);
+    return m_pending.size() - 1;
+}
+
+void UiProfiler::endSpan(int index, const QString &name) {
+    if (index >= m_pending.size()) return; // profiler was reset mid-span
+    Span &span = m_pending[index];
+    span.name = name;
+    span.durationNs = nowNs() - span.startNs;
+    m_depth = qMax(0, m_depth - 1);
+}
+
+void UiProfiler::heartbeat() {
+    // A nested event loop can tick while a span is still open
+    if (m_depth > 0) return;
+
+    const qint64 now = nowNs();
+    const qint64 lagMs = qMax<qint64>(0, (now - m_lastTickNs) / 1000000 - kHeartbeatMs);
+    m_lastTickNs = now;
+
+    const bool stalled = lagMs >= m_stallThresholdMs;
+    if (m_pending.isEmpty() && !stalled) return;
+
+    Interaction interaction;
+    interaction.startedAtMs = QDateTime::currentMSecsSinceEpoch() - lagMs;
+    interaction.lagMs = lagMs;
+    interaction.stalled = stalled;
+    interaction.spans = m_pending;
+    if (!m_pendingName.isEmpty()) {
+        interaction.name = m_pendingName;
+    } else if (!m_pending.isEmpty()) {
+        interaction.name = m_pending.first().name;
+    } else {
+        interaction.name = "(uninstrumented)";
+    }
+
+    if (!m_pending.isEmpty()) {
+        qint64 first = m_pending.first().startNs;
+        qint64 last = first;
+        for (const Span &span : std::as_const(m_pending)) {
+            last = qMax(last, span.startNs + span.durationNs);
+            SpanTotals &totals = m_totals[span.name];
+            ++totals.count;
+            totals.totalNs += span.durationNs;
+            totals.maxNs = qMax(totals.maxNs, span.durationNs);
+        }
+        interaction.wallNs = last - first;
+    }
+
+    if (stalled) {
+        qWarning().noquote() << QString("UI stall: %1 ms during \"%2\"").arg(lagMs).arg(interaction.name);
+    }
+
+    m_interactions.append(interaction);
+    if (m_interactions.size() > kMaxInteractions) {
+        m_interactions.remove(0, m_interactions.size() - kMaxInteractions);
+    }
+    m_pending.clear();
+    m_pendingName.clear();
+}
+
+void UiProfiler::clear() {
+    m_pending.clear();
+    m_pendingName.clear();
+    m_interactions.clear();
+    m_totals.clear();
+    m_depth = 0;
+}
+
+QJsonObject UiProfiler::toJson() const {
+    QJsonArray interactions;
+    QJsonArray stalls;
+    for (const Interaction &interaction : m_interactions) {
+        QJsonArray spans;
+        for (const Span &span : interaction.spans) {
+            QJsonObject s;
+            s["name"] = span.name;
+            s["depth"] = span.depth;
+            s["ms"] = span.durationNs / 1e6;
+            spans.append(s);
+        }
+        QJsonObject entry;
+        entry["name"] = interaction.name;
+        entry["at"] = QDateTime::fromMSecsSinceEpoch(interaction.startedAtMs).toString(Qt::ISODateWithMs);
+        entry["wall_ms"] = interaction.wallNs / 1e6;
+        entry["lag_ms"] = double(interaction.lagMs);
+        entry["spans"] = spans;
+        interactions.append(entry);
+        if (interaction.stalled) stalls.append(entry);
+    }
+
+    QJsonObject summary;
+    for (auto it = m_totals.cbegin(); it != m_totals.cend(); ++it) {
+        QJsonObject s;
+        s["count"] = double(it.value().count);
+        s["mean_ms"] = it.value().count ? it.value().totalNs / 1e6 / it.value().count : 0.0;
+        s["max_ms"] = it.value().maxNs / 1e6;
+        summary[it.key()] = s;
+    }
+
+    QJsonObject root;
+    root["build"] = QString("%1 %2, Qt %3").arg(__DATE__, __TIME__, QT_VERSION_STR);
+    root["saved_at"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["stall_threshold_ms"] = m_stallThresholdMs;
+    root["summary"] = summary;
+    root["stalls"] = stalls;
+    root["interactions"] = interactions;
+    return root;
+}
+
+bool UiProfiler::save(const QString &path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write UI trace to" << path << ":" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+QString UiProfiler::compare(const QJsonObject &baseline, const QJsonObject &current) {
+    const QJsonObject before = baseline["summary"].toObject();
+    const QJsonObject after = current["summary"].toObject();
+
+    QStringList names = before.keys() + after.keys();
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    QString text = QString("baseline: %1\ncurrent:  %2\n\n")
+                       .arg(baseline["build"].toString(), current["build"].toString());
+    text += QString("%1 %2 %3 %4\n").arg("span", -40).arg("base ms", 10)
+                .arg("now ms", 10).arg("delta", 9);
+    for (const QString &name : std::as_const(names)) {
+        const double a = before[name].toObject()["mean_ms"].toDouble();
+        const double b = after[name].toObject()["mean_ms"].toDouble();
+        const QString delta = a > 0 ? QString("%1%").arg((b - a) / a * 100.0, 0, 'f', 1) : QString("new");
+        text += QString("%1 %2 %3 %4\n").arg(name, -40).arg(a, 10, 'f', 2)
+                    .arg(b, 10, 'f', 2).arg(delta, 9);
+    }
+    text += QString("\nstalls: %1 -> %2\n")
+                .arg(baseline["stalls"].toArray().size())
+                .arg(current["stalls"].toArray().size());
+    return text;
+}
+
+qint64 UiProfiler::residentBytes() {
+#ifdef Q_OS_LINUX
+    // Second field of statm: resident pages
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) return -1;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) return -1;
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
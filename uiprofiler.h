@@ -0,0 +1,104 @@
+#ifndef UIPROFILER_H
+#define UIPROFILER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+class QTimer;
+
+// Per-interaction timing trace for the GUI thread.
+//
+// Code marks the work it does with UiSpan scopes (refresh slots, model
+// resets, widget repopulation). A heartbeat timer on the GUI event loop
+// groups the spans recorded between two ticks into one interaction. When a
+// tick arrives later than the stall threshold, it records a stall with that
+// span breakdown. Traces can be saved to JSON and compared between builds.
+class UiProfiler : public QObject {
+    Q_OBJECT
+public:
+    struct Span {
+        QString name;
+        int depth = 0;
+        qint64 startNs = 0;
+        qint64 durationNs = 0;
+    };
+
+    struct Interaction {
+        QString name;
+        qint64 startedAtMs = 0;
+        qint64 wallNs = 0;
+        qint64 lagMs = 0;
+        bool stalled = false;
+        QVector<Span> spans;
+    };
+
+    static UiProfiler &instance();
+
+    void setEnabled(bool on);
+    bool enabled() const { return m_enabled; }
+    void setStallThresholdMs(int ms) { m_stallThresholdMs = ms; }
+
+    // Names the next interaction (e.g. "Deposit") instead of its first span
+    void markInteraction(const QString &name);
+
+    QJsonObject toJson() const;
+    bool save(const QString &path) const;
+    void clear();
+
+    // Human-readable per-span comparison of two saved traces
+    static QString compare(const QJsonObject &baseline, const QJsonObject &current);
+
+    // Resident set size of this process, or -1 where it can't be read
+    static qint64 residentBytes();
+
+private:
+    friend class UiSpan;
+
+    explicit UiProfiler(QObject *parent = nullptr);
+    int beginSpan();
+    void endSpan(int index, const QString &name);
+    void heartbeat();
+    qint64 nowNs() const { return m_clock.nsecsElapsed(); }
+
+    struct SpanTotals {
+        quint64 count = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+    };
+
+    bool m_enabled = false;
+    int m_stallThresholdMs = 100;
+    int m_depth = 0;
+    QString m_pendingName;
+    QVector<Span> m_pending;
+    QVector<Interaction> m_interactions;
+    QHash<QString, SpanTotals> m_totals;
+    QTimer *m_heartbeat = nullptr;
+    QElapsedTimer m_clock;
+    qint64 m_lastTickNs = 0;
+};
+
+// Times the enclosing scope as one span of the current interaction
+class UiSpan {
+public:
+    explicit UiSpan(const char *name)
+        : m_name(name), m_index(-1) {
+        if (UiProfiler::instance().enabled()) m_index = UiProfiler::instance().beginSpan();
+    }
+    ~UiSpan() {
+        if (m_index >= 0) UiProfiler::instance().endSpan(m_index, QString::fromLatin1(m_name));
+    }
+
+    UiSpan(const UiSpan &) = delete;
+    UiSpan &operator=(const UiSpan &) = delete;
+
+private:
+    const char *m_name;
+    int m_index;
+};
+
+#endif // UIPROFILER_H